@@ -1,7 +0,0 @@
-#!/bin/bash
-
-TOOL=`/usr/bin/xcrun -find clang++`
-
-${TOOL} "${@}"
-
-exit ${?}
@@ -35,11 +35,14 @@
 #include <getopt.h>
 #include <limits.h>
 #include <errno.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 
 #define TOOL_VERSION "1.0.0"
 #define SDK_CFG ".xcdev.dat"
+#define XCRUN_PROG "xcrun"
 
 /**
  * @func usage -- Print helpful information about this tool.
@@ -92,78 +95,150 @@ static int validate_directory_path(const char *dir)
 	return retval;
 }
 
+/**
+ * @func get_config_path -- get the absolute path of the configuration file
+ * @arg buf - buffer to place the path in
+ * @arg size - size of buf
+ * @return: 0 on success, -1 on failure
+ */
+static int get_config_path(char *buf, size_t size)
+{
+	char *pathtocfg = NULL;
+
+	if ((pathtocfg = getenv("HOME")) == NULL) {
+		fprintf(stderr, "xcode-select: error: failed to read HOME environment variable.\n");
+		return -1;
+	}
+
+	/* Don't append to HOME itself, xcrun still needs it. */
+	snprintf(buf, size, "%s/%s", pathtocfg, SDK_CFG);
+
+	return 0;
+}
+
+/**
+ * @func read_config -- read the developer path and generation from the configuration file
+ * @arg cfg_path - path of the configuration file
+ * @arg devpath - buffer to place the developer path in
+ * @arg size - size of devpath
+ * @arg generation - set to the generation, 0 if the file has none
+ * @return: 0 on success, -1 on failure
+ */
+static int read_config(const char *cfg_path, char *devpath, size_t size, unsigned long *generation)
+{
+	FILE *fp = NULL;
+	size_t len;
+	char *eol = NULL;
+
+	if ((fp = fopen(cfg_path, "r")) == NULL)
+		return -1;
+
+	len = fread(devpath, 1, (size - 1), fp);
+	devpath[len] = '\0';
+	fclose(fp);
+
+	/* The path, optionally followed by a line holding the generation. */
+	*generation = 0;
+	if ((eol = strchr(devpath, '\n')) != NULL) {
+		*eol++ = '\0';
+		*generation = strtoul(eol, NULL, 10);
+	}
+
+	return 0;
+}
+
 /**
  * @func get_developer_path -- retrieve current developer path
  * @return: string of current path on success, NULL string on failure
  */
 static char *get_developer_path(void)
 {
-	FILE *fp = NULL;
-	char devpath[PATH_MAX - 1];
-	char *pathtocfg = NULL;
-	char *cfg_path = NULL;
+	static char devpath[PATH_MAX + 32];
+	char cfg_path[PATH_MAX];
 	char *value = NULL;
+	unsigned long generation;
 
 	if ((value = getenv("DEVELOPER_DIR")) != NULL)
 		return value;
 
-	memset(devpath, 0, sizeof(devpath));
-
-	if ((pathtocfg = getenv("HOME")) == NULL) {
-		fprintf(stderr, "xcode-select: error: failed to read HOME environment variable.\n");
+	if (get_config_path(cfg_path, sizeof(cfg_path)) != 0)
 		return NULL;
-	}
-
-	cfg_path = (char *)malloc((strlen(pathtocfg) + sizeof(SDK_CFG)));
 
-	strcat(pathtocfg, "/");
-	strcat(cfg_path, strcat(pathtocfg, SDK_CFG));
-
-	if ((fp = fopen(cfg_path, "r")) != NULL) {
-		fseek(fp, SEEK_SET, 0);
-		(void)fread(devpath, (PATH_MAX - 1), 1, fp);
-		value = devpath;
-		fclose(fp);
-	} else {
+	if (read_config(cfg_path, devpath, sizeof(devpath), &generation) != 0) {
 		fprintf(stderr, "xcode-select: error: unable to read configuration file. (errno=%s)\n", strerror(errno));
 		return NULL;
 	}
 
-	free(cfg_path);
-
-	return value;
+	return devpath;
 }
 
 /**
- * @func set_developer_path -- set the current developer path
+ * @func set_developer_path -- set the current developer path, bumping its generation
  * @arg path - path to set
  * @return: 0 on success, -1 on failure
  */
 static int set_developer_path(const char *path)
 {
+	int fd;
 	FILE *fp = NULL;
-	char *pathtocfg = NULL;
-	char *cfg_path = NULL;
+	char cfg_path[PATH_MAX];
+	char tmp_path[PATH_MAX + 16];
+	char devpath[PATH_MAX + 32];
+	unsigned long generation = 0;
 
-	if ((pathtocfg = getenv("HOME")) == NULL) {
-		fprintf(stderr, "xcode-select: error: failed to read HOME variable.\n");
+	if (get_config_path(cfg_path, sizeof(cfg_path)) != 0)
 		return -1;
-	}
 
-        cfg_path = (char *)malloc((strlen(pathtocfg) + sizeof(SDK_CFG)));
+	if (read_config(cfg_path, devpath, sizeof(devpath), &generation) != 0)
+		generation = 0;
 
-        strcat(pathtocfg, "/");
-	strcat(cfg_path, strcat(pathtocfg, SDK_CFG));
+	snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", cfg_path);
 
-	if ((fp = fopen(cfg_path, "w+")) != NULL) {
-		fwrite(path, 1, strlen(path), fp);
-		fclose(fp);
-	} else {
+	if ((fd = mkstemp(tmp_path)) == -1 || (fp = fdopen(fd, "w")) == NULL) {
 		fprintf(stderr, "xcode-select: error: unable to open configuration file. (errno=%s)\n", strerror(errno));
+		if (fd != -1) {
+			close(fd);
+			unlink(tmp_path);
+		}
+		return -1;
+	}
+
+	/* xcrun keys what it derives from the developer path on the generation, so
+	   selecting a folder (even the current one again) invalidates all of it. */
+	(void)fchmod(fd, 0644);
+	fprintf(fp, "%s\n%lu\n", path, generation + 1);
+
+	/* Readers never see a partially written file. */
+	if (fclose(fp) != 0 || rename(tmp_path, cfg_path) != 0) {
+		fprintf(stderr, "xcode-select: error: unable to write configuration file. (errno=%s)\n", strerror(errno));
+		unlink(tmp_path);
 		return -1;
 	}
 
-	free(cfg_path);
+	return 0;
+}
+
+/**
+ * @func warm_xcrun -- have xcrun compile its registry and index its tools for the selected developer path
+ * @return: 0 on success, -1 on failure
+ */
+static int warm_xcrun(void)
+{
+	pid_t pid;
+	int status;
+
+	if ((pid = fork()) == -1)
+		return -1;
+
+	if (pid == 0) {
+		/* Build for the path (and generation) just written, not the environment's. */
+		unsetenv("DEVELOPER_DIR");
+		execlp(XCRUN_PROG, XCRUN_PROG, "--warm", (char *)NULL);
+		_exit(127);
+	}
+
+	if (waitpid(pid, &status, 0) == -1 || WIFEXITED(status) == 0 || WEXITSTATUS(status) != 0)
+		return -1;
 
 	return 0;
 }
@@ -215,10 +290,12 @@ int main(int argc, char *argv[])
 		version();
 
 	if (switch_f == 1) {
-		if (validate_directory_path(path) == 0)
-			return set_developer_path(path);
-		else
+		if (validate_directory_path(path) != 0 || set_developer_path(path) != 0)
 			return -1;
+		/* Cold data only costs xcrun some speed, so this isn't fatal. */
+		if (warm_xcrun() != 0)
+			fprintf(stderr, "xcode-select: warning: failed to prepare xcrun for the new developer path.\n");
+		return 0;
 	}
 
 	if (printpath_f == 1) {
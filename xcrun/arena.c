@@ -0,0 +1,162 @@
+/* arena.c - allocation arena for xcrun
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Everything an invocation resolves (paths, ini values, the environment for the
+ * called tool) lives until it exits or execs, so it is carved out of one arena
+ * instead of being malloc'ed piece by piece. The first chunk is static, which
+ * covers a normal lookup without touching the heap; bigger requests grow the
+ * arena by chunks sized to what is asked for.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "arena.h"
+#include "resolve.h"
+
+/* Every allocation is aligned to this */
+#define ARENA_ALIGN (sizeof(void *) > sizeof(double) ? sizeof(void *) : sizeof(double))
+
+/* Heap chunk, the data follows the header */
+typedef struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+} arena_chunk;
+
+static char static_chunk[ARENA_STATIC_SIZE] __attribute__ ((aligned(16)));
+
+static char *cur = static_chunk;
+static size_t cur_left = ARENA_STATIC_SIZE;
+static arena_chunk *chunks = NULL;
+static size_t used = 0;
+
+/**
+ * @func arena_grow -- make room for at least size bytes
+ * @arg size - number of bytes needed
+ */
+static void arena_grow(size_t size)
+{
+	size_t chunk_size;
+	arena_chunk *chunk = NULL;
+
+	chunk_size = (size > ARENA_CHUNK_SIZE) ? size : ARENA_CHUNK_SIZE;
+
+	/* Fails like any other resolution error, so libxcrun gets it back instead of exiting. */
+	if ((chunk = (arena_chunk *)malloc(sizeof(arena_chunk) + ARENA_ALIGN + chunk_size)) == NULL)
+		resolve_fail("out of memory.");
+
+	chunk->next = chunks;
+	chunk->size = chunk_size;
+	chunks = chunk;
+
+	cur = (char *)chunk + ((sizeof(arena_chunk) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1));
+	cur_left = chunk_size;
+}
+
+void *arena_alloc(size_t size)
+{
+	void *p = NULL;
+
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	if (size > cur_left)
+		arena_grow(size);
+
+	p = cur;
+	cur += size;
+	cur_left -= size;
+	used += size;
+
+	return p;
+}
+
+char *arena_strndup(const char *str, size_t len)
+{
+	char *p = (char *)arena_alloc(len + 1);
+
+	memcpy(p, str, len);
+	p[len] = '\0';
+
+	return p;
+}
+
+char *arena_strdup(const char *str)
+{
+	return arena_strndup(str, strlen(str));
+}
+
+char *arena_printf(const char *fmt, ...)
+{
+	int len;
+	char *p = NULL;
+	va_list args;
+
+	/* Try the space that is left first, most strings fit. */
+	va_start(args, fmt);
+	len = vsnprintf(cur, cur_left, fmt, args);
+	va_end(args);
+
+	if (len < 0)
+		resolve_fail("failed to format string.");
+
+	if ((size_t)len < cur_left)
+		return (char *)arena_alloc(len + 1);
+
+	p = (char *)arena_alloc(len + 1);
+	va_start(args, fmt);
+	vsnprintf(p, len + 1, fmt, args);
+	va_end(args);
+
+	return p;
+}
+
+size_t arena_used(void)
+{
+	return used;
+}
+
+void arena_release(void)
+{
+	arena_chunk *next = NULL;
+
+	while (chunks != NULL) {
+		next = chunks->next;
+		free(chunks);
+		chunks = next;
+	}
+
+	cur = static_chunk;
+	cur_left = ARENA_STATIC_SIZE;
+	used = 0;
+}
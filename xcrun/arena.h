@@ -0,0 +1,60 @@
+/* arena.h - allocation arena for xcrun
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+/* Size of the arena's first (static) chunk */
+#define ARENA_STATIC_SIZE 8192
+
+/* Smallest chunk the arena grows by once the static chunk is used up */
+#define ARENA_CHUNK_SIZE 4096
+
+/* Allocate size bytes that live until arena_release. Calls resolve_fail if
+   out of memory. */
+void *arena_alloc(size_t size);
+
+/* Copy str (or its first len bytes) into the arena. */
+char *arena_strdup(const char *str);
+char *arena_strndup(const char *str, size_t len);
+
+/* Format a string into exactly as much arena space as it needs. */
+char *arena_printf(const char *fmt, ...);
+
+/* Number of bytes handed out so far. */
+size_t arena_used(void);
+
+/* Free everything the arena handed out. */
+void arena_release(void);
+
+#endif /* __ARENA_H__ */
@@ -0,0 +1,405 @@
+/* batch.c - batched job runner for xcrun --exec-batch
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Jobs are read from the input one at a time, so a slow producer doesn't hold
+ * up jobs that are already complete. Every job is started with posix_spawn and
+ * the same environment. One job may always run; every other concurrently
+ * running job needs a slot, either one of the -j slots or a token read from the
+ * make jobserver, which is written back as soon as the job has been reaped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "batch.h"
+
+/* How long to wait for a jobserver token before checking on running jobs, in milliseconds */
+#define JOBSERVER_POLL 50
+
+/* A running job */
+typedef struct {
+	pid_t pid;
+	int index;		/* position in the input, from 1 */
+	int token;		/* jobserver token held, or -1 */
+	char *tool;
+} batch_job;
+
+/* GNU make jobserver */
+typedef struct {
+	int read_fd;		/* -1 if there is no jobserver */
+	int write_fd;
+} jobserver;
+
+/* Jobs started but not yet reaped */
+static batch_job running[BATCH_MAX_JOBS];
+static int nrunning = 0;
+
+/* Number of jobs that failed */
+static int nfailed = 0;
+
+/**
+ * @func open_nonblocking -- open a second, non blocking, description of a jobserver fd
+ * @arg fd - fd inherited from make
+ * @return: the new fd, or fd itself where that isn't possible
+ */
+static int open_nonblocking(int fd)
+{
+	int new_fd;
+	char path[64];
+
+	/* Changing the flags of make's own description would affect every other client. */
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+	if ((new_fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC)) == -1)
+		return fd;
+
+	return new_fd;
+}
+
+/**
+ * @func jobserver_open -- find the GNU make jobserver in MAKEFLAGS
+ * @arg js - jobserver to fill in (read_fd is -1 if there is none)
+ */
+static void jobserver_open(jobserver *js)
+{
+	int r, w;
+	char *flags = NULL;
+	char *auth = NULL;
+	char *end = NULL;
+	char *copy = NULL;
+
+	js->read_fd = js->write_fd = -1;
+
+	if ((flags = getenv("MAKEFLAGS")) == NULL)
+		return;
+
+	if ((auth = strstr(flags, "--jobserver-auth=")) != NULL)
+		auth += strlen("--jobserver-auth=");
+	else if ((auth = strstr(flags, "--jobserver-fds=")) != NULL)
+		auth += strlen("--jobserver-fds=");
+	else
+		return;
+
+	/* make 4.4 and later: a named fifo */
+	if (strncmp(auth, "fifo:", 5) == 0) {
+		if ((copy = strdup(auth + 5)) == NULL)
+			return;
+		if ((end = strchr(copy, ' ')) != NULL)
+			*end = '\0';
+		if ((js->write_fd = open(copy, O_WRONLY | O_CLOEXEC)) != -1)
+			js->read_fd = open(copy, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+		if (js->read_fd == -1 && js->write_fd != -1) {
+			close(js->write_fd);
+			js->write_fd = -1;
+		}
+		free(copy);
+		return;
+	}
+
+	/* Older makes: a pipe, which is only inherited by recipes marked with '+' */
+	if (sscanf(auth, "%d,%d", &r, &w) != 2 || r < 0 || w < 0)
+		return;
+	if (fcntl(r, F_GETFD) == -1 || fcntl(w, F_GETFD) == -1)
+		return;
+
+	js->read_fd = open_nonblocking(r);
+	js->write_fd = w;
+}
+
+/**
+ * @func jobserver_acquire -- try to take a token from the jobserver
+ * @arg js - jobserver
+ * @return: the token, or -1 if none was available
+ */
+static int jobserver_acquire(const jobserver *js)
+{
+	unsigned char token;
+	struct pollfd pfd;
+
+	pfd.fd = js->read_fd;
+	pfd.events = POLLIN;
+
+	if (poll(&pfd, 1, JOBSERVER_POLL) != 1 || (pfd.revents & POLLIN) == 0)
+		return -1;
+
+	if (read(js->read_fd, &token, 1) != 1)
+		return -1;
+
+	return token;
+}
+
+/**
+ * @func jobserver_release -- hand a token back to the jobserver
+ * @arg js - jobserver
+ * @arg token - token to return
+ */
+static void jobserver_release(const jobserver *js, int token)
+{
+	unsigned char byte = (unsigned char)token;
+
+	while (write(js->write_fd, &byte, 1) == -1 && errno == EINTR)
+		;
+}
+
+/**
+ * @func read_job -- read one job's arguments
+ * @arg in - stream to read from
+ * @return: NULL terminated, malloc'ed argument vector, or NULL at the end of the input
+ */
+static char **read_job(FILE *in)
+{
+	int argc = 0;
+	int size = 0;
+	char **argv = NULL;
+	char **grown = NULL;
+	char *arg = NULL;
+	size_t arg_size = 0;
+	ssize_t len;
+
+	while ((len = getdelim(&arg, &arg_size, '\0', in)) != -1) {
+		/* An empty argument ends the job. */
+		if (len == 1 && arg[0] == '\0')
+			break;
+
+		if (argc + 2 > size) {
+			size = (size != 0) ? size * 2 : 16;
+			if ((grown = (char **)realloc(argv, size * sizeof(char *))) == NULL)
+				break;
+			argv = grown;
+		}
+
+		argv[argc++] = arg;
+		arg = NULL;
+		arg_size = 0;
+	}
+
+	free(arg);
+
+	if (argc == 0) {
+		free(argv);
+		return NULL;
+	}
+
+	argv[argc] = NULL;
+
+	return argv;
+}
+
+/**
+ * @func free_job -- free an argument vector made by read_job
+ */
+static void free_job(char **argv)
+{
+	int i;
+
+	for (i = 0; argv[i] != NULL; i++)
+		free(argv[i]);
+
+	free(argv);
+}
+
+/**
+ * @func report -- report how a job ended
+ * @arg index - job's position in the input
+ * @arg tool - job's tool
+ * @arg status - status from waitpid, or -1 if the job never started
+ * @arg verbose - report successful jobs too
+ */
+static void report(int index, const char *tool, int status, int verbose)
+{
+	if (status == -1) {
+		fprintf(stderr, "xcrun: error: job %d (\'%s\') could not be started.\n", index, tool);
+		nfailed++;
+	} else if (WIFSIGNALED(status)) {
+		fprintf(stderr, "xcrun: error: job %d (\'%s\') was killed by signal %d.\n", index, tool, WTERMSIG(status));
+		nfailed++;
+	} else if (WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "xcrun: error: job %d (\'%s\') exited with status %d.\n", index, tool, WEXITSTATUS(status));
+		nfailed++;
+	} else if (verbose == 1)
+		fprintf(stdout, "xcrun: info: job %d (\'%s\') exited with status 0.\n", index, tool);
+}
+
+/**
+ * @func reap -- wait for running jobs to finish
+ * @arg js - jobserver to return tokens to
+ * @arg block - wait for at least one job instead of only collecting those that are done
+ * @arg verbose - report successful jobs too
+ */
+static void reap(const jobserver *js, int block, int verbose)
+{
+	int i;
+	int status;
+	pid_t pid;
+
+	while (nrunning > 0 && (pid = waitpid(-1, &status, (block == 1) ? 0 : WNOHANG)) != 0) {
+		if (pid == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (i = 0; i < nrunning; i++) {
+			if (running[i].pid == pid)
+				break;
+		}
+
+		/* Not one of ours. */
+		if (i == nrunning)
+			continue;
+
+		report(running[i].index, running[i].tool, status, verbose);
+
+		if (running[i].token != -1)
+			jobserver_release(js, running[i].token);
+
+		free(running[i].tool);
+		running[i] = running[--nrunning];
+		block = 0;
+	}
+}
+
+int batch_run(FILE *in, int jobs, batch_resolver resolve, char *const envp[], int verbose, int log)
+{
+	int i;
+	int index = 0;
+	int token;
+	char **argv = NULL;
+	const char *tool = NULL;
+	const char *path = NULL;
+	const char *launcher = NULL;
+	char **args = NULL;
+	jobserver js;
+	pid_t pid;
+
+	js.read_fd = js.write_fd = -1;
+	if (jobs == 0)
+		jobserver_open(&js);
+	if (jobs <= 0 || jobs > BATCH_MAX_JOBS)
+		jobs = (js.read_fd != -1) ? BATCH_MAX_JOBS : 1;
+
+	nrunning = nfailed = 0;
+
+	while (1) {
+		reap(&js, 0, verbose);
+
+		if (argv == NULL) {
+			if ((argv = read_job(in)) != NULL)
+				index++;
+			else if (nrunning == 0)
+				break;
+			else {
+				reap(&js, 1, verbose);
+				continue;
+			}
+		}
+
+		/* One job can always run, every other one needs a slot. */
+		token = -1;
+		if (nrunning > 0) {
+			if (nrunning >= jobs) {
+				reap(&js, 1, verbose);
+				continue;
+			}
+			if (js.read_fd != -1 && (token = jobserver_acquire(&js)) == -1)
+				continue;
+		}
+
+		tool = ((tool = strrchr(argv[0], '/')) != NULL) ? tool + 1 : argv[0];
+
+		if ((path = resolve(tool, &launcher)) == NULL) {
+			report(index, tool, -1, verbose);
+			if (token != -1)
+				jobserver_release(&js, token);
+			free_job(argv);
+			argv = NULL;
+			continue;
+		}
+
+		/* launcher path args... */
+		for (i = 0; argv[i] != NULL; i++)
+			;
+		if ((args = (char **)malloc((i + 2) * sizeof(char *))) == NULL) {
+			report(index, tool, -1, verbose);
+			if (token != -1)
+				jobserver_release(&js, token);
+			free_job(argv);
+			argv = NULL;
+			continue;
+		}
+		if (launcher != NULL) {
+			args[0] = (char *)launcher;
+			args[1] = (char *)path;
+			memcpy(args + 2, argv + 1, i * sizeof(char *));
+			path = launcher;
+		} else
+			memcpy(args, argv, (i + 1) * sizeof(char *));
+
+		if (log == 1) {
+			fprintf(stdout, "xcrun: info: invoking command:\n\t\"%s", path);
+			for (i = 1; args[i] != NULL; i++)
+				fprintf(stdout, " %s", args[i]);
+			fprintf(stdout, "\"\n");
+		}
+
+		/* Anything still buffered would be written twice. */
+		fflush(stdout);
+
+		if ((errno = posix_spawn(&pid, path, NULL, NULL, args, envp)) != 0) {
+			report(index, tool, -1, verbose);
+			if (token != -1)
+				jobserver_release(&js, token);
+		} else {
+			running[nrunning].pid = pid;
+			running[nrunning].index = index;
+			running[nrunning].token = token;
+			running[nrunning].tool = strdup(tool);
+			nrunning++;
+		}
+
+		free(args);
+		free_job(argv);
+		argv = NULL;
+	}
+
+	if (js.read_fd != -1)
+		close(js.read_fd);
+
+	return nfailed;
+}
@@ -0,0 +1,54 @@
+/* batch.h - batched job runner for xcrun --exec-batch
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdio.h>
+
+/* Most jobs run at the same time, whatever -j or the jobserver allow */
+#define BATCH_MAX_JOBS 256
+
+/* Finds the absolute path of a job's tool. Returns NULL if it can't be found.
+   Sets launcher to a program the tool is run through (with the tool's path as
+   its first argument), or NULL to run the tool itself. */
+typedef const char *(*batch_resolver)(const char *name, const char **launcher);
+
+/* Run every job read from in, at most jobs at a time, or as many as the GNU
+   make jobserver in MAKEFLAGS hands out tokens for if jobs is 0 (one at a time
+   without a jobserver). A job is a sequence of NUL terminated arguments ended by
+   an empty one, its first argument naming the tool to resolve. Jobs are spawned
+   with envp as their environment. Failed jobs are reported on stderr (every job
+   if verbose is set) and commands are logged on stdout if log is set. Returns
+   the number of jobs that failed, or -1 if the jobs couldn't be run. */
+int batch_run(FILE *in, int jobs, batch_resolver resolve, char *const envp[], int verbose, int log);
+
+#endif /* __BATCH_H__ */
@@ -0,0 +1,445 @@
+/* bench.c - latency benchmark driver for xcrun
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Runs a command many times and reports the median and 99th percentile wall
+ * time of a run, plus (on Linux) the average number of system calls a run
+ * makes, counted with ptrace over a smaller number of extra runs. A file can
+ * be removed before every run, which is how the cold (no lookup cache) variants
+ * of the benchmark are made.
+ *
+ * With -j, that many runs are kept in flight at once and the throughput of the
+ * whole batch is reported too. With -b, the results are compared against (or,
+ * with -w, recorded in) a baseline file, and the benchmark fails when a case
+ * got slower than the baseline allows.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/ptrace.h>
+#endif
+
+/* Default number of timed runs */
+#define BENCH_RUNS 5000
+
+/* Default number of runs traced for counting system calls */
+#define BENCH_TRACED_RUNS 20
+
+/* Default slowdown over the baseline (in percent) before a case fails */
+#define BENCH_TOLERANCE 25
+
+/* Exit status of a run that regressed against the baseline */
+#define BENCH_REGRESSED 2
+
+static char *progname;
+
+/**
+ * @func usage -- Print helpful information about this program.
+ */
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: %s [-n runs] [-s traced runs] [-j jobs] [-r file] [-b baseline [-w] [-t percent]] <name> <command> ... arguments ...\n"
+		"\n"
+		"Time many runs of a command and report p50/p99 wall time, throughput and system calls per run.\n"
+		"\n"
+		"Options:\n"
+		"  -n <runs>     number of timed runs (default %d)\n"
+		"  -s <runs>     number of runs traced to count system calls (default %d, 0 to skip)\n"
+		"  -j <jobs>     number of runs kept in flight at once (default 1)\n"
+		"  -r <file>     remove file before every run (cold runs)\n"
+		"  -b <file>     compare the results against the baseline recorded in file\n"
+		"  -w            append the results to the baseline file instead\n"
+		"  -t <percent>  slowdown over the baseline that fails the benchmark (default %d)\n\n"
+		, progname, BENCH_RUNS, BENCH_TRACED_RUNS, BENCH_TOLERANCE);
+
+	exit(1);
+}
+
+/**
+ * @func now_usec -- Get a monotonic timestamp.
+ * @return: microseconds since an arbitrary point in time
+ */
+static double now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((double)ts.tv_sec * 1000000.0) + ((double)ts.tv_nsec / 1000.0);
+}
+
+/**
+ * @func start_command -- Fork and execute a command with its output discarded.
+ * @arg argv - command and arguments
+ * @arg traced - have the child stop for ptrace before it executes the command
+ * @return: the child's pid, or -1 on failure
+ */
+static pid_t start_command(char *argv[], int traced)
+{
+	int fd;
+	pid_t pid;
+
+	if ((pid = fork()) != 0)
+		return pid;
+
+	if ((fd = open("/dev/null", O_WRONLY)) != -1) {
+		dup2(fd, STDOUT_FILENO);
+		close(fd);
+	}
+
+#ifdef __linux__
+	if (traced == 1)
+		ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+#endif
+
+	execvp(argv[0], argv);
+	fprintf(stderr, "%s: error: can't exec \'%s\' (errno=%s)\n", progname, argv[0], strerror(errno));
+	_exit(127);
+}
+
+/**
+ * @func wait_command -- Wait for a command to finish.
+ * @arg pid - the command's pid, or -1 for any command
+ * @arg status - returns 0 if it exited successfully, -1 otherwise
+ * @return: the pid of the command that finished, or -1 on failure
+ */
+static pid_t wait_command(pid_t pid, int *status)
+{
+	int wstatus;
+	pid_t done;
+
+	while ((done = waitpid(pid, &wstatus, 0)) == -1) {
+		if (errno != EINTR)
+			return -1;
+	}
+
+	*status = (WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0) ? 0 : -1;
+
+	return done;
+}
+
+/**
+ * @func run_commands -- Run a command many times, keeping a number of runs in flight.
+ * @arg argv - command and arguments
+ * @arg runs - number of runs
+ * @arg jobs - number of runs kept in flight at once
+ * @arg remove_path - file to remove before every run, or NULL
+ * @arg times - returns the wall time of every run, in microseconds
+ * @return: number of runs that failed
+ */
+static int run_commands(char *argv[], int runs, int jobs, const char *remove_path, double *times)
+{
+	int i;
+	int status;
+	int started = 0;
+	int finished = 0;
+	int failures = 0;
+	pid_t pid;
+	pid_t *slot_pid = NULL;
+	double *slot_start = NULL;
+
+	slot_pid = (pid_t *)calloc(jobs, sizeof(pid_t));
+	slot_start = (double *)calloc(jobs, sizeof(double));
+
+	while (finished < runs) {
+		/* Fill every free slot... */
+		for (i = 0; i < jobs && started < runs; i++) {
+			if (slot_pid[i] != 0)
+				continue;
+
+			if (remove_path != NULL)
+				(void)unlink(remove_path);
+
+			slot_start[i] = now_usec();
+			if ((slot_pid[i] = start_command(argv, 0)) == -1) {
+				slot_pid[i] = 0;
+				times[finished++] = now_usec() - slot_start[i];
+				failures++;
+			}
+			started++;
+		}
+
+		if (finished == runs)
+			break;
+
+		/* ...and wait for any of them to finish. */
+		if ((pid = wait_command(-1, &status)) == -1) {
+			fprintf(stderr, "%s: error: can't wait for a run (errno=%s)\n", progname, strerror(errno));
+			exit(1);
+		}
+
+		for (i = 0; i < jobs; i++) {
+			if (slot_pid[i] != pid)
+				continue;
+
+			times[finished++] = now_usec() - slot_start[i];
+			if (status != 0)
+				failures++;
+			slot_pid[i] = 0;
+			break;
+		}
+	}
+
+	free(slot_pid);
+	free(slot_start);
+
+	return failures;
+}
+
+/**
+ * @func check_baseline -- Compare results against (or record them in) a baseline file.
+ * @arg path - path of the baseline file, one tab separated "name p50 p99 throughput" line per case
+ * @arg name - name of the case
+ * @arg p50 - median wall time of a run, in microseconds
+ * @arg p99 - 99th percentile wall time of a run, in microseconds
+ * @arg throughput - runs per second
+ * @arg record - append the results instead of comparing them
+ * @arg tolerance - slowdown (in percent) that counts as a regression
+ * @return: 0 if the case is within the baseline (or has none), BENCH_REGRESSED if it regressed
+ */
+static int check_baseline(const char *path, const char *name, double p50, double p99, double throughput, int record, int tolerance)
+{
+	int result = 0;
+	char *tab = NULL;
+	char line[512];
+	double limit = 1.0 + ((double)tolerance / 100.0);
+	double base_p50, base_p99, base_throughput;
+	FILE *fp = NULL;
+
+	if (record == 1) {
+		if ((fp = fopen(path, "a")) == NULL) {
+			fprintf(stderr, "%s: error: can't open baseline '%s' (errno=%s)\n", progname, path, strerror(errno));
+			exit(1);
+		}
+		fprintf(fp, "%s\t%.1f\t%.1f\t%.1f\n", name, p50, p99, throughput);
+		fclose(fp);
+		fputs("  (recorded)", stdout);
+		return 0;
+	}
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		fputs("  (no baseline)", stdout);
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if ((tab = strchr(line, '\t')) == NULL)
+			continue;
+		*tab++ = '\0';
+
+		if (strcmp(line, name) != 0 || sscanf(tab, "%lf %lf %lf", &base_p50, &base_p99, &base_throughput) != 3)
+			continue;
+
+		if (p50 > base_p50 * limit || p99 > base_p99 * limit || throughput * limit < base_throughput) {
+			fprintf(stdout, "  REGRESSED (baseline p50 %.1f us, p99 %.1f us, %.0f runs/s)", base_p50, base_p99, base_throughput);
+			result = BENCH_REGRESSED;
+		}
+
+		fclose(fp);
+		return result;
+	}
+
+	fclose(fp);
+	fputs("  (no baseline)", stdout);
+
+	return 0;
+}
+
+/**
+ * @func count_syscalls -- Run a command under ptrace and count its system calls.
+ * @arg argv - command and arguments
+ * @return: number of system calls made (including those of anything it executes), or -1 on failure
+ */
+static long count_syscalls(char *argv[])
+{
+#ifdef __linux__
+	int sig;
+	int status;
+	int in_syscall = 0;
+	long count = 0;
+	pid_t pid;
+
+	if ((pid = start_command(argv, 1)) == -1)
+		return -1;
+
+	/* The child stops with SIGTRAP once its first execve succeeds. */
+	if (waitpid(pid, &status, 0) == -1 || !WIFSTOPPED(status))
+		return -1;
+
+	if (ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)(PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL)) == -1) {
+		kill(pid, SIGKILL);
+		(void)wait_command(pid, &status);
+		return -1;
+	}
+
+	sig = 0;
+	for (;;) {
+		if (ptrace(PTRACE_SYSCALL, pid, NULL, (void *)(long)sig) == -1)
+			return -1;
+		if (waitpid(pid, &status, 0) == -1)
+			return -1;
+		if (WIFEXITED(status) || WIFSIGNALED(status))
+			break;
+
+		sig = 0;
+		if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+			/* Stops alternate between entering and leaving a call. */
+			if (in_syscall == 0)
+				count++;
+			in_syscall = !in_syscall;
+		} else if (WSTOPSIG(status) == SIGTRAP) {
+			/* A later execve; the call itself had no exit stop. */
+			in_syscall = 0;
+		} else
+			sig = WSTOPSIG(status);
+	}
+
+	return count;
+#else
+	(void)argv;
+	return -1;
+#endif
+}
+
+/**
+ * @func compare_double -- qsort comparator for doubles
+ */
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[])
+{
+	int ch;
+	int i;
+	int runs = BENCH_RUNS;
+	int traced_runs = BENCH_TRACED_RUNS;
+	int jobs = 1;
+	int record = 0;
+	int tolerance = BENCH_TOLERANCE;
+	int failures = 0;
+	int result = 0;
+	long calls;
+	long total_calls = 0;
+	double start;
+	double elapsed;
+	double throughput;
+	double *times = NULL;
+	char *name = NULL;
+	char *remove_path = NULL;
+	char *baseline_path = NULL;
+	char syscalls[32] = "-";
+
+	progname = argv[0];
+
+	while ((ch = getopt(argc, argv, "+n:s:j:r:b:wt:")) != -1) {
+		switch (ch) {
+			case 'n':
+				runs = atoi(optarg);
+				break;
+			case 's':
+				traced_runs = atoi(optarg);
+				break;
+			case 'j':
+				jobs = atoi(optarg);
+				break;
+			case 'r':
+				remove_path = optarg;
+				break;
+			case 'b':
+				baseline_path = optarg;
+				break;
+			case 'w':
+				record = 1;
+				break;
+			case 't':
+				tolerance = atoi(optarg);
+				break;
+			default:
+				usage();
+		}
+	}
+
+	if (runs < 1 || traced_runs < 0 || jobs < 1 || tolerance < 0 || (argc - optind) < 2)
+		usage();
+
+	name = argv[optind++];
+	argv += optind;
+
+	times = (double *)malloc(runs * sizeof(double));
+
+	start = now_usec();
+	failures = run_commands(argv, runs, jobs, remove_path, times);
+	elapsed = now_usec() - start;
+	throughput = (double)runs * 1000000.0 / elapsed;
+
+	for (i = 0; i < traced_runs; i++) {
+		if (remove_path != NULL)
+			(void)unlink(remove_path);
+
+		if ((calls = count_syscalls(argv)) == -1)
+			break;
+		total_calls += calls;
+	}
+
+	if (traced_runs > 0 && i == traced_runs)
+		snprintf(syscalls, sizeof(syscalls), "%.1f", (double)total_calls / traced_runs);
+
+	qsort(times, runs, sizeof(double), compare_double);
+
+	fprintf(stdout, "%-38s %6d runs  p50 %8.1f us  p99 %8.1f us  %8.0f runs/s  %8s syscalls/run",
+		name, runs, times[runs / 2], times[(runs * 99) / 100], throughput, syscalls);
+
+	if (failures > 0)
+		fprintf(stdout, "  (%d failed)", failures);
+	else if (baseline_path != NULL)
+		result = check_baseline(baseline_path, name, times[runs / 2], times[(runs * 99) / 100], throughput, record, tolerance);
+
+	fputc('\n', stdout);
+
+	free(times);
+
+	return (failures > 0) ? 1 : result;
+}
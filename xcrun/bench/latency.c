@@ -0,0 +1,161 @@
+/* latency.c - filesystem latency shim for the xcrun benchmarks
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Preloaded (LD_PRELOAD) into the benchmarked commands to make every
+ * filesystem metadata call and open take at least BENCH_LATENCY_US
+ * microseconds longer, which is roughly what a network or FUSE mount of
+ * the Developer folder costs per round trip. Calls on file descriptors that
+ * are already open (read, fstat, ...) aren't slowed down.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdarg.h>
+#include <dlfcn.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/* Name of the environment variable holding the latency added to a call */
+#define BENCH_LATENCY_ENV "BENCH_LATENCY_US"
+
+static long latency_usec = -1;
+
+/* Declare real_<name> and point it at the next definition of a function */
+#define REAL(name) \
+	static __typeof__(name) *real_##name = NULL; \
+	if (real_##name == NULL) \
+		real_##name = (__typeof__(name) *)dlsym(RTLD_NEXT, #name)
+
+/**
+ * @func delay -- Sleep for the configured latency before a call.
+ */
+static void delay(void)
+{
+	const char *value = NULL;
+	struct timespec ts;
+
+	if (latency_usec == -1)
+		latency_usec = ((value = getenv(BENCH_LATENCY_ENV)) != NULL) ? atol(value) : 0;
+
+	if (latency_usec <= 0)
+		return;
+
+	ts.tv_sec = latency_usec / 1000000;
+	ts.tv_nsec = (latency_usec % 1000000) * 1000;
+	while (nanosleep(&ts, &ts) == -1)
+		;
+}
+
+int open(const char *path, int flags, ...)
+{
+	va_list ap;
+	mode_t mode = 0;
+	REAL(open);
+
+	if ((flags & O_CREAT) != 0) {
+		va_start(ap, flags);
+		mode = va_arg(ap, int);
+		va_end(ap);
+	}
+
+	delay();
+	return real_open(path, flags, mode);
+}
+
+int openat(int dirfd, const char *path, int flags, ...)
+{
+	va_list ap;
+	mode_t mode = 0;
+	REAL(openat);
+
+	if ((flags & O_CREAT) != 0) {
+		va_start(ap, flags);
+		mode = va_arg(ap, int);
+		va_end(ap);
+	}
+
+	delay();
+	return real_openat(dirfd, path, flags, mode);
+}
+
+int stat(const char *path, struct stat *st)
+{
+	REAL(stat);
+	delay();
+	return real_stat(path, st);
+}
+
+int lstat(const char *path, struct stat *st)
+{
+	REAL(lstat);
+	delay();
+	return real_lstat(path, st);
+}
+
+int fstatat(int dirfd, const char *path, struct stat *st, int flags)
+{
+	REAL(fstatat);
+	delay();
+	return real_fstatat(dirfd, path, st, flags);
+}
+
+int access(const char *path, int mode)
+{
+	REAL(access);
+	delay();
+	return real_access(path, mode);
+}
+
+int faccessat(int dirfd, const char *path, int mode, int flags)
+{
+	REAL(faccessat);
+	delay();
+	return real_faccessat(dirfd, path, mode, flags);
+}
+
+ssize_t readlink(const char *path, char *buf, size_t len)
+{
+	REAL(readlink);
+	delay();
+	return real_readlink(path, buf, len);
+}
+
+DIR *opendir(const char *path)
+{
+	REAL(opendir);
+	delay();
+	return real_opendir(path);
+}
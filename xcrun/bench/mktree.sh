@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# mktree.sh - build a large synthetic Developer folder for the scaling benchmark
+#
+# Usage: mktree.sh <dir> <sdks> <toolchains> <tools>
+#
+# Creates <sdks> SDKs (Scale0.sdk ...) and <toolchains> Toolchains
+# (Scale0.toolchain ...) in <dir>, SDK n using Toolchain n % <toolchains>.
+# Every Toolchain's usr/bin holds <tools> tools (tool0 ... tool<tools - 1>),
+# all of them symbolic links to /bin/true. SDK versions count up, so the
+# newest SDK is the last one.
+
+set -e
+
+if [ $# -ne 4 ] || [ "$2" -lt 1 ] || [ "$3" -lt 1 ] || [ "$4" -lt 1 ]; then
+	echo "Usage: $0 <dir> <sdks> <toolchains> <tools>" >&2
+	exit 1
+fi
+
+dir=$1
+sdks=$2
+toolchains=$3
+tools=$4
+
+mkdir -p "$dir/usr/bin" "$dir/SDKs" "$dir/Toolchains"
+
+# The tools are made once and copied to every Toolchain, which is much
+# faster than running ln for each of them again.
+mkdir -p "$dir/Toolchains/Scale0.toolchain/usr/bin"
+(cd "$dir/Toolchains/Scale0.toolchain/usr/bin" && i=0 && while [ $i -lt "$tools" ]; do ln -sf /bin/true tool$i; i=$((i + 1)); done)
+
+i=0
+while [ $i -lt "$toolchains" ]; do
+	if [ $i -gt 0 ]; then
+		mkdir -p "$dir/Toolchains/Scale$i.toolchain/usr"
+		cp -PR "$dir/Toolchains/Scale0.toolchain/usr/bin" "$dir/Toolchains/Scale$i.toolchain/usr/bin"
+	fi
+	printf '[TOOLCHAIN]\nname = Scale%d\nversion = 1.%d\n' $i $i > "$dir/Toolchains/Scale$i.toolchain/info.ini"
+	i=$((i + 1))
+done
+
+i=0
+while [ $i -lt "$sdks" ]; do
+	mkdir -p "$dir/SDKs/Scale$i.sdk/usr/bin"
+	printf '[SDK]\nname = Scale%d\nversion = 1.%d\ntoolchain = Scale%d\ndefault_arch = arm\narchs = armv7, arm64\nmacosx_deployment_target = 10.7\n' \
+		$i $i $((i % toolchains)) > "$dir/SDKs/Scale$i.sdk/info.ini"
+	i=$((i + 1))
+done
@@ -0,0 +1,1011 @@
+/* cache.c - persistent lookup cache for xcrun
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The cache is a single text file with one entry per line. Each line starts with
+ * the tab separated lookup key, followed by the resolved tool path, the SDK and
+ * toolchain information handed to the called tool, and the modification times of
+ * every file and directory the result was derived from. An entry is only used if
+ * all of those are unchanged. The file is always replaced as a whole (write to a
+ * temporary file, then rename) so readers never see a partially written cache.
+ *
+ * Next to it lives the directory index: one line per searched directory holding
+ * its modification time and the names of the executables it contains, so a
+ * lookup that misses the cache can probe an in-memory hash instead of calling
+ * access() on every candidate path. A directory is read again whenever its
+ * modification time changes. Changing the mode of an existing file doesn't
+ * touch the directory, so a tool made executable in place is only noticed once
+ * something is added to or removed from its directory (or after xcrun -k).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "cache.h"
+#include "fsops.h"
+#include "arena.h"
+#include "store.h"
+
+#ifdef __APPLE__
+#define ST_MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#else
+#define ST_MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif
+
+/* Number of fixed fields following the key */
+#define ENTRY_FIELDS 8
+
+/* Buffer holding the most recently read cache file */
+static char *cache_buf = NULL;
+
+/* Executables found in one directory */
+typedef struct {
+	const char *path;
+	long long sec;
+	long nsec;
+	char *line;		/* names as read from the index file, until hashed */
+	const char **slots;	/* open addressing hash of names */
+	size_t nslots;
+	int used;		/* looked up during this run */
+	int racy;		/* changed too recently to be kept */
+} dir_index;
+
+/* Directories read from (or added to) the directory index */
+static dir_index dir_table[CACHE_MAX_DIRS];
+static int ndirs = -1;		/* -1 until the index file has been read */
+static int dir_table_dirty = 0;
+
+/* Simple growable output buffer */
+typedef struct {
+	char *data;
+	size_t len;
+	size_t size;
+} strbuf;
+
+/* A directory cache_dir_warm reads */
+typedef struct {
+	dir_index *index;
+	struct stat st;		/* taken before reading it */
+	strbuf names;		/* see dir_read_names */
+	int error;
+} dir_job;
+
+/**
+ * @func strbuf_append -- append len bytes of str to buf
+ * @arg buf - buffer to append to
+ * @arg str - data to append
+ * @arg len - length of data
+ * @return: 0 on success, -1 on failure
+ */
+static int strbuf_append(strbuf *buf, const char *str, size_t len)
+{
+	char *data;
+	size_t size;
+
+	if (buf->len + len + 1 > buf->size) {
+		size = (buf->size != 0) ? buf->size : 4096;
+		while (buf->len + len + 1 > size)
+			size *= 2;
+		if ((data = (char *)realloc(buf->data, size)) == NULL)
+			return -1;
+		buf->data = data;
+		buf->size = size;
+	}
+
+	memcpy(buf->data + buf->len, str, len);
+	buf->len += len;
+	buf->data[buf->len] = '\0';
+
+	return 0;
+}
+
+/**
+ * @func strbuf_field -- append a tab terminated field to buf
+ * @arg buf - buffer to append to
+ * @arg str - field value (NULL is stored as an empty field)
+ * @return: 0 on success, -1 on failure
+ */
+static int strbuf_field(strbuf *buf, const char *str)
+{
+	if (str == NULL)
+		str = "";
+
+	/* Tabs and newlines are our separators. */
+	if (strpbrk(str, "\t\n") != NULL)
+		return -1;
+
+	if (strbuf_append(buf, str, strlen(str)) != 0)
+		return -1;
+
+	return strbuf_append(buf, "\t", 1);
+}
+
+/**
+ * @func cache_file_path -- get the absolute path of the cache file
+ * @return: path to the cache file or NULL if HOME isn't set
+ */
+static const char *cache_file_path(void)
+{
+	static char path[PATH_MAX];
+
+	return store_path(path, sizeof(path), XCRUN_CACHE_FILE);
+}
+
+/**
+ * @func dir_index_file_path -- get the absolute path of the directory index file
+ * @return: path to the index file or NULL if HOME isn't set
+ */
+static const char *dir_index_file_path(void)
+{
+	static char path[PATH_MAX];
+
+	return store_path(path, sizeof(path), XCRUN_DIRINDEX_FILE);
+}
+
+/**
+ * @func read_cache_file -- read the whole cache file into memory
+ * @return: NUL terminated contents of the cache file or NULL if unavailable
+ */
+static char *read_cache_file(void)
+{
+	const char *path = NULL;
+
+	if ((path = cache_file_path()) == NULL)
+		return NULL;
+
+	return fs_read_fd(store_open(path), NULL);
+}
+
+/**
+ * @func format_key -- serialize a lookup key
+ * @arg buf - buffer to place the key in
+ * @arg key - key to serialize
+ * @return: 0 on success, -1 if the key can't be represented
+ */
+static int format_key(strbuf *buf, const cache_key *key)
+{
+	char mode[16];
+	char generation[32];
+
+	snprintf(mode, sizeof(mode), "%d", key->mode);
+	snprintf(generation, sizeof(generation), "%lu", key->generation);
+
+	if (strbuf_field(buf, key->developer_dir) != 0 ||
+	    strbuf_field(buf, generation) != 0 ||
+	    strbuf_field(buf, mode) != 0 ||
+	    strbuf_field(buf, key->sdk) != 0 ||
+	    strbuf_field(buf, key->toolchain) != 0 ||
+	    strbuf_field(buf, key->alternate_sdk) != 0 ||
+	    strbuf_field(buf, key->alternate_toolchain) != 0 ||
+	    strbuf_field(buf, key->tool) != 0)
+		return -1;
+
+	return 0;
+}
+
+/**
+ * @func stamp_is_current -- check if a recorded modification time still holds
+ * @arg stamp - stamp to check
+ * @return: 1 if unchanged, 0 otherwise
+ */
+static int stamp_is_current(const cache_stamp *stamp)
+{
+	struct stat st;
+
+	if (fs_stat(stamp->path, &st) != 0)
+		return (stamp->sec == -1);
+
+	return ((long long)st.st_mtime == stamp->sec && (long)ST_MTIME_NSEC(st) == stamp->nsec);
+}
+
+/**
+ * @func empty_to_null -- map an empty field back to NULL
+ */
+static const char *empty_to_null(const char *str)
+{
+	return (*str == '\0') ? NULL : str;
+}
+
+/**
+ * @func parse_entry -- parse the part of a cache line that follows the key
+ * @arg line - NUL terminated line contents following the key (modified in place)
+ * @arg entry - entry to fill
+ * @return: 0 on success, -1 on a malformed line
+ */
+static int parse_entry(char *line, cache_entry *entry)
+{
+	int i;
+	int nfields = 0;
+	char *fields[ENTRY_FIELDS + (CACHE_MAX_STAMPS * 2)];
+	char *p = line;
+
+	while (nfields < (int)(sizeof(fields) / sizeof(fields[0]))) {
+		fields[nfields++] = p;
+		if ((p = strchr(p, '\t')) == NULL)
+			break;
+		*p++ = '\0';
+	}
+
+	if (nfields < ENTRY_FIELDS)
+		return -1;
+
+	memset(entry, 0, sizeof(*entry));
+	entry->path = fields[0];
+	entry->has_env = atoi(fields[1]);
+	entry->sdk_path = empty_to_null(fields[2]);
+	entry->toolchain_path = empty_to_null(fields[3]);
+	entry->target_triple = empty_to_null(fields[4]);
+	entry->deployment_kind = atoi(fields[5]);
+	entry->deployment_target = empty_to_null(fields[6]);
+	entry->nstamps = atoi(fields[7]);
+
+	if (entry->nstamps < 0 || entry->nstamps > CACHE_MAX_STAMPS || nfields < ENTRY_FIELDS + (entry->nstamps * 2))
+		return -1;
+
+	for (i = 0; i < entry->nstamps; i++) {
+		entry->stamps[i].path = fields[ENTRY_FIELDS + (i * 2)];
+		if (sscanf(fields[ENTRY_FIELDS + (i * 2) + 1], "%lld.%ld", &entry->stamps[i].sec, &entry->stamps[i].nsec) != 2)
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @func format_entry -- serialize a cache entry following its key
+ * @arg buf - buffer to append to
+ * @arg entry - entry to serialize
+ * @return: 0 on success, -1 if the entry can't be represented
+ */
+static int format_entry(strbuf *buf, const cache_entry *entry)
+{
+	int i;
+	char num[64];
+
+	if (strbuf_field(buf, entry->path) != 0)
+		return -1;
+
+	snprintf(num, sizeof(num), "%d", entry->has_env);
+	if (strbuf_field(buf, num) != 0 ||
+	    strbuf_field(buf, entry->sdk_path) != 0 ||
+	    strbuf_field(buf, entry->toolchain_path) != 0 ||
+	    strbuf_field(buf, entry->target_triple) != 0)
+		return -1;
+
+	snprintf(num, sizeof(num), "%d", entry->deployment_kind);
+	if (strbuf_field(buf, num) != 0 || strbuf_field(buf, entry->deployment_target) != 0)
+		return -1;
+
+	snprintf(num, sizeof(num), "%d", entry->nstamps);
+	if (strbuf_field(buf, num) != 0)
+		return -1;
+
+	for (i = 0; i < entry->nstamps; i++) {
+		snprintf(num, sizeof(num), "%lld.%ld", entry->stamps[i].sec, entry->stamps[i].nsec);
+		if (strbuf_field(buf, entry->stamps[i].path) != 0 || strbuf_field(buf, num) != 0)
+			return -1;
+	}
+
+	/* Replace the trailing tab with the end of the line. */
+	buf->data[buf->len - 1] = '\n';
+
+	return 0;
+}
+
+/**
+ * @func next_line -- split off the next line of a buffer
+ * @arg p - pointer to the current position, advanced past the line
+ * @arg len - set to the length of the line, excluding the newline
+ * @return: start of the line, or NULL at the end of the buffer
+ */
+static char *next_line(char **p, size_t *len)
+{
+	char *line = *p;
+	char *end = NULL;
+
+	if (line == NULL || *line == '\0')
+		return NULL;
+
+	if ((end = strchr(line, '\n')) != NULL) {
+		*len = (end - line);
+		*p = end + 1;
+	} else {
+		*len = strlen(line);
+		*p = line + *len;
+	}
+
+	return line;
+}
+
+/**
+ * @func check_header -- validate a file header and skip past it
+ * @arg p - pointer to the start of the file contents, advanced past the header
+ * @arg magic - expected file type
+ * @arg version - expected format version
+ * @return: 0 if this is a file we understand, -1 otherwise
+ */
+static int check_header(char **p, const char *magic, int version)
+{
+	char header[64];
+	char *line = NULL;
+	size_t len;
+
+	snprintf(header, sizeof(header), "%s %d", magic, version);
+
+	if ((line = next_line(p, &len)) == NULL)
+		return -1;
+
+	if (len != strlen(header) || strncmp(line, header, len) != 0)
+		return -1;
+
+	return 0;
+}
+
+/**
+ * @func hash_name -- hash a file name for the directory index
+ */
+static unsigned long hash_name(const char *name)
+{
+	unsigned long hash = 2166136261UL;
+
+	while (*name != '\0') {
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619UL;
+	}
+
+	return hash;
+}
+
+/**
+ * @func dir_index_hash -- build the hash of a directory's executables
+ * @arg index - directory to fill in
+ * @arg names - executable names (kept, not copied)
+ * @arg count - number of names
+ */
+static void dir_index_hash(dir_index *index, const char **names, size_t count)
+{
+	size_t i;
+	size_t slot;
+
+	index->nslots = 8;
+	while (index->nslots < count * 2)
+		index->nslots *= 2;
+
+	index->slots = (const char **)arena_alloc(index->nslots * sizeof(const char *));
+	memset(index->slots, 0, index->nslots * sizeof(const char *));
+
+	for (i = 0; i < count; i++) {
+		slot = hash_name(names[i]) & (index->nslots - 1);
+		while (index->slots[slot] != NULL)
+			slot = (slot + 1) & (index->nslots - 1);
+		index->slots[slot] = names[i];
+	}
+
+	index->line = NULL;
+}
+
+/**
+ * @func dir_index_split -- hash the names of a directory's line
+ * @arg index - directory whose line to split (modified in place)
+ * @return: 0 on success, -1 on failure
+ */
+static int dir_index_split(dir_index *index)
+{
+	size_t count = 0;
+	const char **names = NULL;
+	char *p = index->line;
+
+	if (*p != '\0') {
+		count = 1;
+		while ((p = strchr(p, '\t')) != NULL) {
+			count++;
+			p++;
+		}
+	}
+
+	if ((names = (const char **)malloc((count + 1) * sizeof(const char *))) == NULL)
+		return -1;
+
+	for (p = index->line, count = 0; p != NULL && *p != '\0'; count++) {
+		names[count] = p;
+		if ((p = strchr(p, '\t')) != NULL)
+			*p++ = '\0';
+	}
+
+	dir_index_hash(index, names, count);
+	free(names);
+
+	return 0;
+}
+
+/**
+ * @func dir_read_names -- list every executable in a directory
+ * @arg path - directory to read
+ * @arg out - buffer the tab separated names are appended to
+ * @return: 0 on success, -1 on failure
+ */
+static int dir_read_names(const char *path, strbuf *out)
+{
+	DIR *dir = NULL;
+	struct dirent *ent = NULL;
+
+	if ((dir = fs_opendir(path)) == NULL)
+		return -1;
+
+	/* readdir() isn't counted as a call of its own, it returns many entries per getdents. */
+	while ((ent = readdir(dir)) != NULL) {
+		if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+			continue;
+
+		/* Such names can't be stored; lookups for them probe the filesystem instead. */
+		if (strpbrk(ent->d_name, "\t\n") != NULL)
+			continue;
+
+		if (fs_faccessat(dirfd(dir), ent->d_name, (F_OK | X_OK)) != 0)
+			continue;
+
+		if ((out->len > 0 && strbuf_append(out, "\t", 1) != 0) || strbuf_append(out, ent->d_name, strlen(ent->d_name)) != 0) {
+			fs_closedir(dir);
+			return -1;
+		}
+	}
+
+	fs_closedir(dir);
+
+	return 0;
+}
+
+/**
+ * @func dir_index_fill -- keep the names read from a directory as its index
+ * @arg index - directory to fill in
+ * @arg st - status of the directory, taken before reading it
+ * @arg names - what dir_read_names read
+ */
+static void dir_index_fill(dir_index *index, const struct stat *st, const strbuf *names)
+{
+	index->line = arena_strndup((names->data != NULL) ? names->data : "", names->len);
+	index->slots = NULL;
+
+	index->sec = (long long)st->st_mtime;
+	index->nsec = (long)ST_MTIME_NSEC(*st);
+
+	/* A change later in the same timestamp tick would go unnoticed, so only keep
+	   directories that have been left alone for a while. */
+	index->racy = ((long long)st->st_mtime >= (long long)time(NULL) - 1);
+	if (index->racy == 0)
+		dir_table_dirty = 1;
+}
+
+/**
+ * @func dir_index_read -- read every executable name in a directory
+ * @arg index - directory to fill in
+ * @arg st - status of the directory, taken before reading it
+ * @return: 0 on success, -1 on failure
+ */
+static int dir_index_read(dir_index *index, const struct stat *st)
+{
+	strbuf names = { NULL, 0, 0 };
+
+	if (dir_read_names(index->path, &names) != 0) {
+		free(names.data);
+		return -1;
+	}
+
+	dir_index_fill(index, st, &names);
+	free(names.data);
+
+	return dir_index_split(index);
+}
+
+/**
+ * @func load_dir_table -- read the directory index file, once
+ */
+static void load_dir_table(void)
+{
+	static char *buf = NULL;
+	const char *path = NULL;
+	char *p = NULL;
+	char *line = NULL;
+	char *stamp = NULL;
+	char *names = NULL;
+	dir_index *index = NULL;
+	size_t len;
+
+	if (ndirs != -1)
+		return;
+
+	ndirs = 0;
+
+	if ((path = dir_index_file_path()) == NULL || (buf = fs_read_fd(store_open(path), NULL)) == NULL)
+		return;
+
+	p = buf;
+	if (check_header(&p, "xcrun-dirindex", XCRUN_DIRINDEX_VERSION) != 0)
+		return;
+
+	while (ndirs < CACHE_MAX_DIRS && (line = next_line(&p, &len)) != NULL) {
+		line[len] = '\0';
+
+		/* path, modification time, then the executables' names */
+		if ((stamp = strchr(line, '\t')) == NULL)
+			continue;
+		*stamp++ = '\0';
+
+		if ((names = strchr(stamp, '\t')) != NULL)
+			*names++ = '\0';
+		else
+			names = stamp + strlen(stamp);
+
+		index = &dir_table[ndirs];
+		memset(index, 0, sizeof(*index));
+		if (sscanf(stamp, "%lld.%ld", &index->sec, &index->nsec) != 2)
+			continue;
+
+		index->path = line;
+		index->line = names;
+		ndirs++;
+	}
+}
+
+/**
+ * @func find_dir_index -- find (or make room for) a directory in the index
+ * @arg path - directory to find
+ * @return: the directory's index, or NULL if there is no room left
+ */
+static dir_index *find_dir_index(const char *path)
+{
+	int i;
+	dir_index *index = NULL;
+
+	for (i = 0; i < ndirs; i++) {
+		if (strcmp(dir_table[i].path, path) == 0)
+			return &dir_table[i];
+	}
+
+	/* Evict a directory this run hasn't used once the table is full. */
+	if (ndirs < CACHE_MAX_DIRS)
+		index = &dir_table[ndirs++];
+	else {
+		for (i = 0; i < ndirs && index == NULL; i++) {
+			if (dir_table[i].used == 0)
+				index = &dir_table[i];
+		}
+		if (index == NULL)
+			return NULL;
+	}
+
+	memset(index, 0, sizeof(*index));
+	index->path = arena_strdup(path);
+	index->sec = -1;
+
+	return index;
+}
+
+void cache_stamp_add(cache_entry *entry, const char *path)
+{
+	int i;
+	struct stat st;
+	cache_stamp *stamp = NULL;
+
+	if (entry->nstamps >= CACHE_MAX_STAMPS)
+		return;
+
+	/* Don't record the same dependency twice. */
+	for (i = 0; i < entry->nstamps; i++) {
+		if (strcmp(entry->stamps[i].path, path) == 0)
+			return;
+	}
+
+	stamp = &entry->stamps[entry->nstamps++];
+	stamp->path = arena_strdup(path);
+
+	if (fs_stat(path, &st) == 0) {
+		stamp->sec = (long long)st.st_mtime;
+		stamp->nsec = (long)ST_MTIME_NSEC(st);
+	} else {
+		stamp->sec = -1;
+		stamp->nsec = 0;
+	}
+}
+
+int cache_lookup(const cache_key *key, cache_entry *entry)
+{
+	size_t len;
+	size_t size = 0;
+	char header[64];
+	const char *map = NULL;
+	const char *p = NULL;
+	const char *eol = NULL;
+	const char *end = NULL;
+	const char *path = NULL;
+	strbuf prefix = { NULL, 0, 0 };
+	int retval = -1;
+
+	if ((path = cache_file_path()) == NULL || format_key(&prefix, key) != 0)
+		goto done;
+
+	/* No lock needed: the file is only ever replaced as a whole, so a mapping of it never changes. */
+	if ((map = (const char *)fs_map_fd(store_open(path), &size)) == NULL)
+		goto done;
+
+	end = map + size;
+	len = snprintf(header, sizeof(header), "xcrun-cache %d\n", XCRUN_CACHE_VERSION);
+	if (size < len || memcmp(map, header, len) != 0)
+		goto unmap;
+
+	for (p = map + len; p < end; p = eol + 1) {
+		if ((eol = (const char *)memchr(p, '\n', end - p)) == NULL)
+			eol = end;
+		if ((size_t)(eol - p) <= prefix.len || memcmp(p, prefix.data, prefix.len) != 0)
+			continue;
+
+		/* Only the matching entry is copied, the strings in entry point into it. */
+		len = (eol - p) - prefix.len;
+		free(cache_buf);
+		if ((cache_buf = (char *)malloc(len + 1)) == NULL)
+			break;
+		memcpy(cache_buf, p + prefix.len, len);
+		cache_buf[len] = '\0';
+
+		if (parse_entry(cache_buf, entry) == 0 && cache_entry_is_current(entry) == 1)
+			retval = 0;
+		break;
+	}
+
+unmap:
+	fs_unmap_file((void *)map, size);
+done:
+	free(prefix.data);
+
+	return retval;
+}
+
+int cache_store(const cache_key *key, const cache_entry *entry)
+{
+	int lock = -1;
+	int count = 0;
+	size_t len;
+	char *p = NULL;
+	char *contents = NULL;
+	char *line = NULL;
+	const char *path = NULL;
+	char header[64];
+	strbuf prefix = { NULL, 0, 0 };
+	strbuf ours = { NULL, 0, 0 };
+	strbuf out = { NULL, 0, 0 };
+	int retval = -1;
+
+	if ((path = cache_file_path()) == NULL)
+		return -1;
+
+	if (format_key(&prefix, key) != 0 || strbuf_append(&ours, prefix.data, prefix.len) != 0 || format_entry(&ours, entry) != 0)
+		goto done;
+
+	/* Merge with whatever the writer before us published, not with what we read earlier. */
+	lock = store_lock(path);
+
+	snprintf(header, sizeof(header), "xcrun-cache %d\n", XCRUN_CACHE_VERSION);
+	if (strbuf_append(&out, header, strlen(header)) != 0)
+		goto done;
+
+	/* Carry over every other entry, dropping the oldest ones once we are full. */
+	if ((contents = read_cache_file()) != NULL) {
+		p = contents;
+		if (check_header(&p, "xcrun-cache", XCRUN_CACHE_VERSION) == 0) {
+			char *start = p;
+
+			while ((line = next_line(&p, &len)) != NULL) {
+				if (len <= prefix.len || strncmp(line, prefix.data, prefix.len) != 0)
+					count++;
+			}
+
+			p = start;
+			while ((line = next_line(&p, &len)) != NULL) {
+				if (len > prefix.len && strncmp(line, prefix.data, prefix.len) == 0) {
+					/* Parallel jobs all missing the same tool only need one of them to write it. */
+					if (len == ours.len - 1 && memcmp(line, ours.data, len) == 0) {
+						retval = 0;
+						goto done;
+					}
+					continue;
+				}
+				if (count-- >= CACHE_MAX_ENTRIES)
+					continue;
+				if (strbuf_append(&out, line, len) != 0 || strbuf_append(&out, "\n", 1) != 0)
+					goto done;
+			}
+		}
+	}
+
+	if (strbuf_append(&out, ours.data, ours.len) != 0)
+		goto done;
+
+	retval = store_publish(path, out.data, out.len);
+
+done:
+	store_unlock(lock);
+	free(contents);
+	free(prefix.data);
+	free(ours.data);
+	free(out.data);
+
+	return retval;
+}
+
+int cache_kill(void)
+{
+	const char *path = NULL;
+
+	if ((path = cache_file_path()) == NULL)
+		return -1;
+
+	if (store_remove(path) != 0)
+		return -1;
+
+	if ((path = dir_index_file_path()) != NULL && store_remove(path) != 0)
+		return -1;
+
+	return 0;
+}
+
+int cache_entry_is_current(const cache_entry *entry)
+{
+	int i;
+
+	for (i = 0; i < entry->nstamps; i++) {
+		if (stamp_is_current(&entry->stamps[i]) == 0)
+			return 0;
+	}
+
+	return 1;
+}
+
+char *cache_format_entry(const cache_entry *entry)
+{
+	strbuf out = { NULL, 0, 0 };
+
+	if (format_entry(&out, entry) != 0) {
+		free(out.data);
+		return NULL;
+	}
+
+	/* Drop the end of line, callers frame the entry themselves. */
+	out.data[out.len - 1] = '\0';
+
+	return out.data;
+}
+
+int cache_parse_entry(char *str, cache_entry *entry)
+{
+	return parse_entry(str, entry);
+}
+
+/**
+ * @func get_dir_index -- get the up to date index of a directory, reading it if needed
+ * @arg dir - directory to index
+ * @arg st - current status of the directory
+ * @return: the directory's index, or NULL on failure
+ */
+static dir_index *get_dir_index(const char *dir, const struct stat *st)
+{
+	dir_index *index = NULL;
+
+	load_dir_table();
+	if ((index = find_dir_index(dir)) == NULL)
+		return NULL;
+
+	if (index->racy == 1 || index->sec != (long long)st->st_mtime || index->nsec != (long)ST_MTIME_NSEC(*st)) {
+		if (dir_index_read(index, st) != 0) {
+			index->sec = -1;
+			return NULL;
+		}
+	} else if (index->slots == NULL && dir_index_split(index) != 0)
+		return NULL;
+
+	index->used = 1;
+
+	return index;
+}
+
+int cache_dir_lookup(const char *dir, const char *name)
+{
+	struct stat st;
+	size_t slot;
+	dir_index *index = NULL;
+
+	if (strpbrk(dir, "\t\n") != NULL || strpbrk(name, "\t\n") != NULL || strchr(name, '/') != NULL)
+		return -1;
+
+	/* Nothing can be found in a directory that isn't there. */
+	if (fs_stat(dir, &st) != 0 || S_ISDIR(st.st_mode) == 0)
+		return 0;
+
+	if ((index = get_dir_index(dir, &st)) == NULL)
+		return -1;
+
+	slot = hash_name(name) & (index->nslots - 1);
+	while (index->slots[slot] != NULL) {
+		if (strcmp(index->slots[slot], name) == 0)
+			return 1;
+		slot = (slot + 1) & (index->nslots - 1);
+	}
+
+	return 0;
+}
+
+/* helper function for cache_dir_warm to read one directory (on any thread) */
+static void read_dir_job(void *arg, int i)
+{
+	dir_job *job = &((dir_job *)arg)[i];
+
+	job->error = dir_read_names(job->index->path, &job->names);
+}
+
+int cache_dir_warm(const char *dirs[], int count)
+{
+	int i;
+	int njobs = 0;
+	int nracy = 0;
+	struct stat st;
+	dir_index *index = NULL;
+	dir_job *jobs = (dir_job *)arena_alloc(count * sizeof(dir_job));
+
+	load_dir_table();
+
+	for (i = 0; i < count; i++) {
+		if (strpbrk(dirs[i], "\t\n") != NULL || fs_stat(dirs[i], &st) != 0 || S_ISDIR(st.st_mode) == 0)
+			continue;
+		if ((index = find_dir_index(dirs[i])) == NULL)
+			continue;
+
+		index->used = 1;
+		if (index->racy == 0 && index->sec == (long long)st.st_mtime && index->nsec == (long)ST_MTIME_NSEC(st))
+			continue;
+
+		memset(&jobs[njobs], 0, sizeof(dir_job));
+		jobs[njobs].index = index;
+		jobs[njobs++].st = st;
+	}
+
+	/* Reading is all round trips to the filesystem, so many directories are read at once. */
+	fs_parallel(njobs, read_dir_job, jobs);
+
+	for (i = 0; i < njobs; i++) {
+		if (jobs[i].error == 0) {
+			dir_index_fill(jobs[i].index, &jobs[i].st, &jobs[i].names);
+			nracy += jobs[i].index->racy;
+		} else
+			jobs[i].index->sec = -1;
+		free(jobs[i].names.data);
+	}
+
+	return nracy;
+}
+
+int cache_dir_save(void)
+{
+	int i;
+	int lock = -1;
+	int nsaved = 0;
+	size_t len;
+	size_t plen;
+	size_t slot;
+	char *p = NULL;
+	char *line = NULL;
+	char *contents = NULL;
+	char num[64];
+	const char *path = NULL;
+	dir_index *index = NULL;
+	strbuf out = { NULL, 0, 0 };
+	int retval = -1;
+
+	if (dir_table_dirty == 0)
+		return 0;
+
+	if ((path = dir_index_file_path()) == NULL)
+		return -1;
+
+	snprintf(num, sizeof(num), "xcrun-dirindex %d\n", XCRUN_DIRINDEX_VERSION);
+	if (strbuf_append(&out, num, strlen(num)) != 0)
+		goto done;
+
+	for (i = 0; i < ndirs; i++) {
+		index = &dir_table[i];
+		if (index->racy == 1 || index->sec == -1)
+			continue;
+
+		snprintf(num, sizeof(num), "%lld.%ld", index->sec, index->nsec);
+		if (strbuf_field(&out, index->path) != 0 || strbuf_field(&out, num) != 0)
+			goto done;
+
+		if (index->line != NULL) {
+			if (strbuf_append(&out, index->line, strlen(index->line)) != 0)
+				goto done;
+		} else {
+			for (slot = 0; slot < index->nslots; slot++) {
+				if (index->slots[slot] != NULL && strbuf_field(&out, index->slots[slot]) != 0)
+					goto done;
+			}
+		}
+
+		/* End the line, replacing a trailing tab if there is one. */
+		if (out.data[out.len - 1] == '\t')
+			out.data[out.len - 1] = '\n';
+		else if (strbuf_append(&out, "\n", 1) != 0)
+			goto done;
+		nsaved++;
+	}
+
+	/* Keep the directories other xcrun calls indexed since we read the file. */
+	lock = store_lock(path);
+
+	if ((contents = fs_read_fd(store_open(path), NULL)) != NULL) {
+		p = contents;
+		if (check_header(&p, "xcrun-dirindex", XCRUN_DIRINDEX_VERSION) == 0) {
+			while (nsaved < CACHE_MAX_DIRS && (line = next_line(&p, &len)) != NULL) {
+				for (i = 0; i < ndirs; i++) {
+					plen = strlen(dir_table[i].path);
+					if (plen < len && line[plen] == '\t' && strncmp(line, dir_table[i].path, plen) == 0)
+						break;
+				}
+				if (i < ndirs)
+					continue;
+				if (strbuf_append(&out, line, len) != 0 || strbuf_append(&out, "\n", 1) != 0)
+					goto done;
+				nsaved++;
+			}
+		}
+	}
+
+	if ((retval = store_publish(path, out.data, out.len)) == 0)
+		dir_table_dirty = 0;
+
+done:
+	store_unlock(lock);
+	free(contents);
+	free(out.data);
+
+	return retval;
+}
+
+void cache_dir_forget(void)
+{
+	ndirs = -1;
+	dir_table_dirty = 0;
+}
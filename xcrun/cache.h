@@ -0,0 +1,137 @@
+/* cache.h - persistent lookup cache for xcrun
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+/* Name of the lookup cache file, relative to $HOME */
+#define XCRUN_CACHE_FILE ".xcrun.cache"
+
+/* Version of the on-disk cache format */
+#define XCRUN_CACHE_VERSION 2
+
+/* Name of the directory index file, relative to $HOME */
+#define XCRUN_DIRINDEX_FILE ".xcrun.dirindex"
+
+/* Version of the on-disk directory index format */
+#define XCRUN_DIRINDEX_VERSION 1
+
+/* Maximum number of directories kept in the directory index */
+#define CACHE_MAX_DIRS 64
+
+/* Maximum number of files and directories an entry may depend on */
+#define CACHE_MAX_STAMPS 12
+
+/* Maximum number of entries kept in the cache file */
+#define CACHE_MAX_ENTRIES 1024
+
+/* Modification time of a file or directory that an entry depends on */
+typedef struct {
+	const char *path;
+	long long sec;	/* -1 if the path did not exist */
+	long nsec;
+} cache_stamp;
+
+/* What a lookup was asked for */
+typedef struct {
+	const char *developer_dir;
+	unsigned long generation;	/* developer dir generation, see xcode-select */
+	int mode;	/* search mode flags, see xcrun.c */
+	const char *sdk;
+	const char *toolchain;
+	const char *alternate_sdk;
+	const char *alternate_toolchain;
+	const char *tool;
+} cache_key;
+
+/* What a lookup resolved to */
+typedef struct {
+	const char *path;		/* tool's absolute path, empty if the tool wasn't found */
+
+	/* The following are only valid if has_env is set */
+	int has_env;
+	const char *sdk_path;
+	const char *toolchain_path;
+	const char *target_triple;
+	const char *deployment_target;
+	int deployment_kind;		/* 0 = none, 1 = macosx, 2 = ios */
+
+	int nstamps;
+	cache_stamp stamps[CACHE_MAX_STAMPS];
+} cache_entry;
+
+/* Record the current modification time of path as a dependency of entry. */
+void cache_stamp_add(cache_entry *entry, const char *path);
+
+/* Look up key in the cache. Returns 0 and fills entry when a valid entry is
+   found, -1 if there is no entry or it is stale. Strings in entry stay valid
+   until the next call into the cache. */
+int cache_lookup(const cache_key *key, cache_entry *entry);
+
+/* Add or replace the entry for key. Returns 0 on success, -1 on failure. */
+int cache_store(const cache_key *key, const cache_entry *entry);
+
+/* Check whether dir contains an executable called name, using (and updating) the
+   directory index. Returns 1 if it does, 0 if it doesn't and -1 if the index
+   can't tell, in which case the caller should probe the filesystem itself. */
+int cache_dir_lookup(const char *dir, const char *name);
+
+/* Read each of the count directories in dirs (reading several at once) into
+   the directory index, unless its entry is already current. Returns the number
+   of directories that changed too recently to be kept (try again a little
+   later); directories that can't be read are skipped. */
+int cache_dir_warm(const char *dirs[], int count);
+
+/* Write directories read by cache_dir_lookup back to the index file. Returns 0
+   on success (or if there was nothing to write), -1 on failure. */
+int cache_dir_save(void);
+
+/* Forget the directory index read so far, which lives in the arena, so that
+   the next lookup reads the index file again. Call cache_dir_save first to
+   keep what was read. */
+void cache_dir_forget(void);
+
+/* Remove every entry from the cache (and the directory index), lock files included. Returns 0 on success, -1 on failure. */
+int cache_kill(void);
+
+/* Check that every file and directory entry depends on is unchanged. Returns 1
+   if the entry is still valid, 0 otherwise. */
+int cache_entry_is_current(const cache_entry *entry);
+
+/* Serialize entry (without a key) into a tab separated, malloc'ed string with no
+   trailing newline. Returns NULL if the entry can't be represented. */
+char *cache_format_entry(const cache_entry *entry);
+
+/* Parse a string made by cache_format_entry (modified in place) into entry.
+   Returns 0 on success, -1 on malformed input. */
+int cache_parse_entry(char *str, cache_entry *entry);
+
+#endif /* __CACHE_H__ */
@@ -0,0 +1,1271 @@
+/* daemon.c - resolver daemon for xcrun
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The daemon keeps resolved queries in memory and answers them over a per-user
+ * Unix socket. A client sends one tab separated request line and reads back one
+ * reply line, after which the connection is closed. Queries the daemon hasn't
+ * seen yet are resolved in a forked child, using the same code paths as a normal
+ * xcrun call, so a failing resolution can't take the daemon down with it. The
+ * daemon never waits on a single client or child: every connection and every
+ * pending resolution is kept in the poll set, and clients asking for the same
+ * query while it is being resolved all get the one reply. The
+ * client falls back to resolving by itself whenever the daemon is unavailable or
+ * has no answer, which is also how errors end up being reported to the user.
+ *
+ * On Linux, every file and directory a reply depends on is watched with inotify
+ * and any change to them drops everything the daemon knows. Elsewhere, and for
+ * dependencies that can't be watched, replies are validated against their
+ * recorded modification times before being used, like the lookup cache does.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <libgen.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "daemon.h"
+
+/* Longest request line we accept */
+#define DAEMON_MAX_REQUEST (PATH_MAX * 8)
+
+/* Number of fields in a resolve request, including version and operation */
+#define QUERY_FIELDS 13
+
+/* Number of fields in a reply ahead of the entry, including the status */
+#define REPLY_FIELDS 8
+
+#ifdef __linux__
+/* Changes to a watched file or directory that invalidate what we know */
+#define WATCH_EVENTS (IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MODIFY | IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO)
+#endif
+
+/* Growable line buffer */
+typedef struct {
+	char *data;
+	size_t len;
+	size_t size;
+} linebuf;
+
+/* A query the daemon has resolved */
+typedef struct {
+	char *request;		/* request line, without the newline */
+	char *reply;		/* reply line, sent as is */
+	char *deps;		/* storage for entry */
+	cache_entry entry;	/* what the reply depends on */
+	int validate;		/* check entry's stamps on every use */
+} daemon_entry;
+
+#ifdef __linux__
+/* A watched directory */
+typedef struct {
+	int wd;
+	char *name;		/* only changes to this name matter, NULL for any */
+} daemon_watch;
+
+static int watch_fd = -1;
+static int nwatches = 0;
+static daemon_watch *watches = NULL;
+#endif
+
+/* States of a client connection */
+enum {
+	CONN_READING,		/* waiting for the rest of the request */
+	CONN_RESOLVING,		/* waiting for a child to resolve the request */
+	CONN_WRITING,		/* sending the reply */
+	CONN_DONE		/* to be closed */
+};
+
+/* A client being served */
+typedef struct {
+	int fd;
+	int state;
+	linebuf in;		/* request line read so far */
+	char *out;		/* reply line being sent */
+	size_t out_len;
+	size_t out_off;
+	long long deadline;	/* when to give up on the client */
+} daemon_conn;
+
+/* A query being resolved in a child process */
+typedef struct {
+	pid_t pid;		/* 0 once the child has been collected */
+	int fd;			/* read end of the child's pipe */
+	char *request;		/* request line, without the newline */
+	linebuf out;		/* reply read so far */
+	unsigned long generation;	/* what we knew when the child was started */
+	long long deadline;	/* when to give up on the child */
+} daemon_child;
+
+static int nentries = 0;
+static daemon_entry entries[DAEMON_MAX_ENTRIES];
+
+/* Bumped whenever everything resolved so far is dropped */
+static unsigned long generation = 0;
+
+static int nconns = 0;
+static daemon_conn conns[DAEMON_MAX_CLIENTS];
+
+static int nchildren = 0;
+static daemon_child children[DAEMON_MAX_RESOLVING];
+
+/* Buffer holding the most recent reply read by a client */
+static char *reply_buf = NULL;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+/**
+ * @func line_append -- append a string to a line buffer
+ * @arg buf - buffer to append to
+ * @arg str - string to append
+ * @return: 0 on success, -1 on failure
+ */
+static int line_append(linebuf *buf, const char *str)
+{
+	char *data;
+	size_t len = strlen(str);
+	size_t size;
+
+	if (buf->len + len + 1 > buf->size) {
+		size = (buf->size != 0) ? buf->size : 1024;
+		while (buf->len + len + 1 > size)
+			size *= 2;
+		if ((data = (char *)realloc(buf->data, size)) == NULL)
+			return -1;
+		buf->data = data;
+		buf->size = size;
+	}
+
+	memcpy(buf->data + buf->len, str, len + 1);
+	buf->len += len;
+
+	return 0;
+}
+
+/**
+ * @func line_field -- append a tab terminated field to a line buffer
+ * @arg buf - buffer to append to
+ * @arg str - field value (NULL is sent as an empty field)
+ * @return: 0 on success, -1 on failure
+ */
+static int line_field(linebuf *buf, const char *str)
+{
+	if (str == NULL)
+		str = "";
+
+	/* Tabs and newlines are our separators. */
+	if (strpbrk(str, "\t\n") != NULL)
+		return -1;
+
+	if (line_append(buf, str) != 0)
+		return -1;
+
+	return line_append(buf, "\t");
+}
+
+/**
+ * @func split_fields -- split a line into its tab separated fields
+ * @arg line - line to split (modified in place)
+ * @arg fields - array to place the fields in
+ * @arg nfields - number of fields to split off; the last one holds the rest of the line
+ * @return: number of fields found
+ */
+static int split_fields(char *line, char **fields, int nfields)
+{
+	int n = 0;
+	char *p = line;
+
+	while (n < nfields) {
+		fields[n++] = p;
+		if (n == nfields || (p = strchr(p, '\t')) == NULL)
+			break;
+		*p++ = '\0';
+	}
+
+	return n;
+}
+
+/**
+ * @func field_value -- map an empty field back to NULL
+ */
+static const char *field_value(const char *field)
+{
+	return (*field == '\0') ? NULL : field;
+}
+
+/**
+ * @func socket_path -- get the path of the daemon's socket
+ * @return: path to the socket or NULL if HOME isn't set or the path is too long
+ */
+static const char *socket_path(void)
+{
+	static char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+	char *home = NULL;
+
+	if (*path != '\0')
+		return path;
+
+	if ((home = getenv("HOME")) == NULL)
+		return NULL;
+
+	if (snprintf(path, sizeof(path), "%s/%s", home, XCRUN_DAEMON_SOCKET) >= (int)sizeof(path)) {
+		*path = '\0';
+		return NULL;
+	}
+
+	return path;
+}
+
+/**
+ * @func set_timeouts -- make reads and writes on a socket give up eventually
+ * @arg fd - socket
+ */
+static void set_timeouts(int fd)
+{
+	struct timeval tv;
+
+	tv.tv_sec = DAEMON_TIMEOUT / 1000;
+	tv.tv_usec = (DAEMON_TIMEOUT % 1000) * 1000;
+
+	(void)setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	(void)setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+/**
+ * @func write_all -- write a whole buffer to a file descriptor
+ * @arg fd - file descriptor to write to
+ * @arg data - data to write
+ * @arg len - length of data
+ * @return: 0 on success, -1 on failure
+ */
+static int write_all(int fd, const char *data, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, data, len)) <= 0) {
+			if (n == -1 && errno == EINTR)
+				continue;
+			return -1;
+		}
+		data += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/**
+ * @func read_line -- read up to (and not including) the first newline
+ * @arg fd - file descriptor to read from
+ * @arg max - longest line to accept
+ * @return: NUL terminated, malloc'ed line or NULL on failure
+ */
+static char *read_line(int fd, size_t max)
+{
+	char *line = NULL;
+	char *end = NULL;
+	size_t len = 0;
+	ssize_t n;
+
+	if ((line = (char *)malloc(max + 1)) == NULL)
+		return NULL;
+
+	while (len < max) {
+		if ((n = read(fd, line + len, max - len)) <= 0) {
+			if (n == -1 && errno == EINTR)
+				continue;
+			break;
+		}
+		len += n;
+		line[len] = '\0';
+		if ((end = strchr(line, '\n')) != NULL) {
+			*end = '\0';
+			return line;
+		}
+	}
+
+	free(line);
+
+	return NULL;
+}
+
+/**
+ * @func connect_daemon -- connect to the daemon's socket
+ * @return: connected socket or -1 if there is no daemon
+ */
+static int connect_daemon(void)
+{
+	int fd;
+	const char *path = NULL;
+	struct sockaddr_un addr;
+
+	if ((path = socket_path()) == NULL)
+		return -1;
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	set_timeouts(fd);
+
+	return fd;
+}
+
+/**
+ * @func transact -- send a request line to the daemon and read back its reply
+ * @arg request - newline terminated request
+ * @return: reply line (valid until the next call) or NULL on failure
+ */
+static char *transact(const char *request)
+{
+	int fd;
+
+	if ((fd = connect_daemon()) == -1)
+		return NULL;
+
+	free(reply_buf);
+	reply_buf = NULL;
+
+	if (write_all(fd, request, strlen(request)) == 0)
+		reply_buf = read_line(fd, (PATH_MAX * (CACHE_MAX_STAMPS + REPLY_FIELDS)));
+
+	close(fd);
+
+	return reply_buf;
+}
+
+/**
+ * @func format_query -- serialize a resolve request
+ * @arg buf - buffer to place the request in
+ * @arg query - query to serialize
+ * @return: 0 on success, -1 if the query can't be represented
+ */
+static int format_query(linebuf *buf, const daemon_query *query)
+{
+	char num[16];
+
+	snprintf(num, sizeof(num), "%d", XCRUN_DAEMON_VERSION);
+	if (line_field(buf, num) != 0 || line_field(buf, "resolve") != 0)
+		return -1;
+
+	snprintf(num, sizeof(num), "%d", query->mode);
+	if (line_field(buf, query->home) != 0 ||
+	    line_field(buf, query->developer_dir) != 0 ||
+	    line_field(buf, query->sdkroot) != 0 ||
+	    line_field(buf, query->toolchains) != 0 ||
+	    line_field(buf, num) != 0 ||
+	    line_field(buf, query->sdk) != 0 ||
+	    line_field(buf, query->toolchain) != 0 ||
+	    line_field(buf, query->alternate_sdk) != 0 ||
+	    line_field(buf, query->alternate_toolchain) != 0 ||
+	    line_field(buf, query->driver) != 0 ||
+	    line_field(buf, query->tool) != 0)
+		return -1;
+
+	/* Replace the trailing tab with the end of the line. */
+	buf->data[buf->len - 1] = '\n';
+
+	return 0;
+}
+
+/**
+ * @func parse_query -- parse a resolve request
+ * @arg line - request line (modified in place)
+ * @arg query - query to fill
+ * @return: 0 on success, -1 on a malformed request
+ */
+static int parse_query(char *line, daemon_query *query)
+{
+	char *fields[QUERY_FIELDS];
+
+	if (split_fields(line, fields, QUERY_FIELDS) != QUERY_FIELDS)
+		return -1;
+
+	memset(query, 0, sizeof(*query));
+	query->home = field_value(fields[2]);
+	query->developer_dir = field_value(fields[3]);
+	query->sdkroot = field_value(fields[4]);
+	query->toolchains = field_value(fields[5]);
+	query->mode = atoi(fields[6]);
+	query->sdk = field_value(fields[7]);
+	query->toolchain = field_value(fields[8]);
+	query->alternate_sdk = field_value(fields[9]);
+	query->alternate_toolchain = field_value(fields[10]);
+	query->driver = field_value(fields[11]);
+	query->tool = field_value(fields[12]);
+
+	return 0;
+}
+
+/**
+ * @func format_reply -- serialize a successful reply
+ * @arg reply - reply to serialize
+ * @return: newline terminated, malloc'ed reply line or NULL if it can't be represented
+ */
+static char *format_reply(const daemon_reply *reply)
+{
+	char *entry = NULL;
+	linebuf buf = { NULL, 0, 0 };
+
+	if ((entry = cache_format_entry(&reply->entry)) == NULL)
+		return NULL;
+
+	if (line_field(&buf, "ok") != 0 ||
+	    line_field(&buf, reply->developer_dir) != 0 ||
+	    line_field(&buf, reply->sdk) != 0 ||
+	    line_field(&buf, reply->toolchain) != 0 ||
+	    line_field(&buf, reply->sdk_name) != 0 ||
+	    line_field(&buf, reply->sdk_version) != 0 ||
+	    line_field(&buf, reply->toolchain_name) != 0 ||
+	    line_field(&buf, reply->toolchain_version) != 0 ||
+	    line_append(&buf, entry) != 0 ||
+	    line_append(&buf, "\n") != 0) {
+		free(buf.data);
+		buf.data = NULL;
+	}
+
+	free(entry);
+
+	return buf.data;
+}
+
+/**
+ * @func parse_reply -- parse a reply line
+ * @arg line - reply line, without the newline (modified in place)
+ * @arg reply - reply to fill
+ * @return: 0 on success, -1 if this isn't a successful reply
+ */
+static int parse_reply(char *line, daemon_reply *reply)
+{
+	char *fields[REPLY_FIELDS + 1];
+
+	if (split_fields(line, fields, REPLY_FIELDS + 1) != (REPLY_FIELDS + 1) || strcmp(fields[0], "ok") != 0)
+		return -1;
+
+	memset(reply, 0, sizeof(*reply));
+	reply->developer_dir = field_value(fields[1]);
+	reply->sdk = field_value(fields[2]);
+	reply->toolchain = field_value(fields[3]);
+	reply->sdk_name = field_value(fields[4]);
+	reply->sdk_version = field_value(fields[5]);
+	reply->toolchain_name = field_value(fields[6]);
+	reply->toolchain_version = field_value(fields[7]);
+
+	if (cache_parse_entry(fields[REPLY_FIELDS], &reply->entry) != 0)
+		return -1;
+
+	/* The entry's path is empty when only sdk information was asked for. */
+	reply->entry.path = field_value(reply->entry.path);
+
+	return 0;
+}
+
+int daemon_resolve(const daemon_query *query, daemon_reply *reply)
+{
+	char *line = NULL;
+	linebuf request = { NULL, 0, 0 };
+
+	if (format_query(&request, query) != 0) {
+		free(request.data);
+		return -1;
+	}
+
+	line = transact(request.data);
+	free(request.data);
+
+	if (line == NULL || parse_reply(line, reply) != 0)
+		return -1;
+
+	/* The daemon only answers for the developer dir it was asked about. */
+	if (reply->developer_dir == NULL || reply->entry.sdk_path == NULL || reply->entry.toolchain_path == NULL)
+		return -1;
+
+	return 0;
+}
+
+int daemon_flush(void)
+{
+	char request[32];
+
+	snprintf(request, sizeof(request), "%d\tflush\n", XCRUN_DAEMON_VERSION);
+
+	if (transact(request) == NULL)
+		return -1;
+
+	return 0;
+}
+
+#ifdef __linux__
+/**
+ * @func add_watch -- watch a directory for changes
+ * @arg path - directory to watch
+ * @arg name - only report changes to this entry of the directory, NULL for any
+ * @return: 0 on success, -1 on failure
+ */
+static int add_watch(const char *path, const char *name)
+{
+	int i;
+	int wd;
+	daemon_watch *w = NULL;
+
+	if ((wd = inotify_add_watch(watch_fd, path, WATCH_EVENTS | IN_ONLYDIR | IN_MASK_ADD)) == -1)
+		return -1;
+
+	for (i = 0; i < nwatches; i++) {
+		if (watches[i].wd != wd)
+			continue;
+		if (watches[i].name == NULL || (name != NULL && strcmp(watches[i].name, name) == 0))
+			return 0;
+	}
+
+	if ((w = (daemon_watch *)realloc(watches, (nwatches + 1) * sizeof(daemon_watch))) == NULL)
+		return -1;
+
+	watches = w;
+	watches[nwatches].wd = wd;
+	watches[nwatches].name = (name != NULL) ? strdup(name) : NULL;
+	nwatches++;
+
+	return 0;
+}
+
+/**
+ * @func watch_dependency -- watch a file or directory a reply depends on
+ * @arg path - absolute path to watch
+ * @return: 0 on success, -1 if it can't be watched
+ */
+static int watch_dependency(const char *path)
+{
+	int retval;
+	char *dir = NULL;
+	char *name = NULL;
+	char *dir_buf = NULL;
+	char *name_buf = NULL;
+
+	if (watch_fd == -1)
+		return -1;
+
+	/* Directories (search paths) depend on everything in them. */
+	if (add_watch(path, NULL) == 0)
+		return 0;
+
+	/* Files, and paths that don't exist yet, are watched through their parent. */
+	dir_buf = strdup(path);
+	name_buf = strdup(path);
+	dir = dirname(dir_buf);
+	name = basename(name_buf);
+
+	retval = add_watch(dir, name);
+
+	free(dir_buf);
+	free(name_buf);
+
+	return retval;
+}
+
+/**
+ * @func reset_watches -- stop watching everything
+ */
+static void reset_watches(void)
+{
+	int i;
+
+	for (i = 0; i < nwatches; i++)
+		free(watches[i].name);
+	free(watches);
+	watches = NULL;
+	nwatches = 0;
+
+	/* Closing the instance drops all of its watches at once. */
+	if (watch_fd != -1)
+		close(watch_fd);
+	watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+#endif
+
+/**
+ * @func forget_all -- drop every resolved query
+ */
+static void forget_all(void)
+{
+	int i;
+
+	for (i = 0; i < nentries; i++) {
+		free(entries[i].request);
+		free(entries[i].reply);
+		free(entries[i].deps);
+	}
+	nentries = 0;
+	generation++;
+
+#ifdef __linux__
+	reset_watches();
+#endif
+}
+
+/**
+ * @func remember -- keep a resolved query around
+ * @arg request - request line, without the newline
+ * @arg reply - reply line
+ */
+static void remember(const char *request, const char *reply)
+{
+	int i;
+	daemon_entry *e = NULL;
+	daemon_reply parsed;
+
+	if (nentries >= DAEMON_MAX_ENTRIES)
+		forget_all();
+
+	e = &entries[nentries];
+	memset(e, 0, sizeof(*e));
+
+	e->deps = strdup(reply);
+	e->deps[strcspn(e->deps, "\n")] = '\0';
+	if (parse_reply(e->deps, &parsed) != 0) {
+		free(e->deps);
+		return;
+	}
+
+	e->request = strdup(request);
+	e->reply = strdup(reply);
+	e->entry = parsed.entry;
+
+	for (i = 0; i < e->entry.nstamps; i++) {
+#ifdef __linux__
+		if (watch_dependency(e->entry.stamps[i].path) == 0)
+			continue;
+#endif
+		e->validate = 1;
+	}
+
+	nentries++;
+}
+
+/**
+ * @func recall -- find the reply to a query we have already resolved
+ * @arg request - request line, without the newline
+ * @return: the reply line or NULL if it has to be resolved (again)
+ */
+static const char *recall(const char *request)
+{
+	int i;
+
+	for (i = 0; i < nentries; i++) {
+		if (strcmp(entries[i].request, request) != 0)
+			continue;
+
+		if (entries[i].validate == 1 && cache_entry_is_current(&entries[i].entry) == 0) {
+			/* Stale, replace it with the last entry. */
+			free(entries[i].request);
+			free(entries[i].reply);
+			free(entries[i].deps);
+			entries[i] = entries[--nentries];
+			return NULL;
+		}
+
+		return entries[i].reply;
+	}
+
+	return NULL;
+}
+
+#ifdef __linux__
+/**
+ * @func handle_changes -- drop everything if a watched dependency changed
+ * @arg verbose - print what we are doing
+ */
+static void handle_changes(int verbose)
+{
+	int i;
+	int changed = 0;
+	ssize_t n;
+	char *p = NULL;
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event = NULL;
+
+	/* The instance is non-blocking, so this stops right away once nothing is left. */
+	while ((n = read(watch_fd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + n && changed == 0; p += sizeof(struct inotify_event) + event->len) {
+			event = (const struct inotify_event *)p;
+
+			if (event->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+				changed = 1;
+				break;
+			}
+
+			for (i = 0; i < nwatches; i++) {
+				if (watches[i].wd != event->wd)
+					continue;
+				if (watches[i].name == NULL || (event->len > 0 && strcmp(watches[i].name, event->name) == 0)) {
+					changed = 1;
+					break;
+				}
+			}
+		}
+	}
+
+	if (changed == 1) {
+		if (verbose == 1)
+			fprintf(stdout, "xcrun: info: daemon: developer folder changed, forgetting %d resolved queries.\n", nentries);
+		forget_all();
+	}
+}
+#endif
+
+/**
+ * @func now_msec -- get a monotonic timestamp
+ * @return: milliseconds since an arbitrary point in time
+ */
+static long long now_msec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((long long)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/**
+ * @func set_nonblocking -- make reads and writes on a descriptor return instead of waiting
+ * @arg fd - descriptor
+ * @return: 0 on success, -1 on failure
+ */
+static int set_nonblocking(int fd)
+{
+	int flags;
+
+	if ((flags = fcntl(fd, F_GETFL)) == -1)
+		return -1;
+
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/**
+ * @func read_some -- append whatever can be read right now to a line buffer
+ * @arg fd - non-blocking descriptor to read from
+ * @arg buf - buffer to append to
+ * @arg max - longest line to accept
+ * @return: 1 once a newline (or the end of the file) was read, 0 if more is to come, -1 on failure
+ */
+static int read_some(int fd, linebuf *buf, size_t max)
+{
+	char chunk[4096];
+	ssize_t n;
+
+	for (;;) {
+		if ((n = read(fd, chunk, sizeof(chunk) - 1)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		}
+		if (n == 0)
+			return 1;
+
+		chunk[n] = '\0';
+		if (buf->len + n > max || line_append(buf, chunk) != 0)
+			return -1;
+		if (memchr(chunk, '\n', n) != NULL)
+			return 1;
+	}
+}
+
+/**
+ * @func start_child -- start resolving a query in a child process
+ * @arg request - request line, without the newline
+ * @arg resolve - resolver to call
+ * @arg verbose - keep the child's diagnostics
+ * @return: 0 if the child was started, -1 on failure
+ */
+static int start_child(const char *request, daemon_resolver resolve, int verbose)
+{
+	int i;
+	int fd;
+	int pfd[2];
+	pid_t pid;
+	char *line = NULL;
+	char *reply = NULL;
+	daemon_query query;
+	daemon_reply result;
+	daemon_child *child = NULL;
+
+	if (nchildren == DAEMON_MAX_RESOLVING || pipe(pfd) != 0)
+		return -1;
+
+	/* Don't let the child flush our buffered output a second time. */
+	fflush(NULL);
+
+	if ((pid = fork()) == -1) {
+		close(pfd[0]);
+		close(pfd[1]);
+		return -1;
+	}
+
+	if (pid == 0) {
+		close(pfd[0]);
+		signal(SIGPIPE, SIG_DFL);
+
+		/* The clients are the daemon's to answer. */
+		for (i = 0; i < nconns; i++)
+			close(conns[i].fd);
+		for (i = 0; i < nchildren; i++)
+			close(children[i].fd);
+
+		/* Errors are reported by the client when it resolves the query itself. */
+		if (verbose == 0 && (fd = open("/dev/null", O_WRONLY)) != -1) {
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+			close(fd);
+		}
+
+		line = strdup(request);
+		memset(&result, 0, sizeof(result));
+		if (parse_query(line, &query) != 0 || resolve(&query, &result) != 0)
+			_exit(1);
+
+		if ((reply = format_reply(&result)) == NULL || write_all(pfd[1], reply, strlen(reply)) != 0)
+			_exit(1);
+
+		_exit(0);
+	}
+
+	close(pfd[1]);
+	(void)set_nonblocking(pfd[0]);
+
+	child = &children[nchildren++];
+	memset(child, 0, sizeof(*child));
+	child->pid = pid;
+	child->fd = pfd[0];
+	child->request = strdup(request);
+	child->generation = generation;
+	child->deadline = now_msec() + DAEMON_TIMEOUT;
+
+	return 0;
+}
+
+/**
+ * @func conn_reply -- start sending a reply to a client
+ * @arg conn - the client
+ * @arg reply - newline terminated reply line
+ */
+static void conn_reply(daemon_conn *conn, const char *reply)
+{
+	free(conn->out);
+	conn->out = strdup(reply);
+	conn->out_len = (conn->out != NULL) ? strlen(conn->out) : 0;
+	conn->out_off = 0;
+	conn->state = CONN_WRITING;
+}
+
+/**
+ * @func finish_child -- collect what a child resolved and answer everyone waiting for it
+ * @arg child - the child, whose pipe has been read to its end (or who ran out of time)
+ * @arg timed_out - the child is to be killed rather than waited for
+ * @arg verbose - print what we are doing
+ */
+static void finish_child(daemon_child *child, int timed_out, int verbose)
+{
+	int i;
+	int status = 0;
+	char *reply = NULL;
+	const char *tool = NULL;
+
+	if (timed_out == 1)
+		kill(child->pid, SIGKILL);
+
+	while (waitpid(child->pid, &status, 0) == -1 && errno == EINTR)
+		;
+	close(child->fd);
+
+	if (timed_out == 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+	    child->out.data != NULL && (reply = strchr(child->out.data, '\n')) != NULL) {
+		reply[1] = '\0';
+		reply = child->out.data;
+
+		tool = strrchr(child->request, '\t') + 1;
+		if (verbose == 1)
+			fprintf(stdout, "xcrun: info: daemon: resolved a new query for \'%s\'.\n", (*tool != '\0') ? tool : "sdk information");
+
+		/* Something changed while the child was at it, so the answer may already be stale. */
+		if (child->generation == generation)
+			remember(child->request, reply);
+	} else
+		reply = NULL;
+
+	for (i = 0; i < nconns; i++) {
+		if (conns[i].state == CONN_RESOLVING && strcmp(conns[i].in.data, child->request) == 0)
+			conn_reply(&conns[i], (reply != NULL) ? reply : "miss\n");
+	}
+
+	free(child->request);
+	free(child->out.data);
+	child->pid = 0;
+}
+
+/**
+ * @func handle_request -- answer a complete request, or start resolving it
+ * @arg conn - the client, whose request line (without the newline) is in conn->in
+ * @arg resolve - resolver for queries we haven't seen yet
+ * @arg verbose - print what we are doing
+ */
+static void handle_request(daemon_conn *conn, daemon_resolver resolve, int verbose)
+{
+	int i;
+	char *line = conn->in.data;
+	const char *known = NULL;
+	char version[16];
+	size_t len;
+
+	snprintf(version, sizeof(version), "%d\t", XCRUN_DAEMON_VERSION);
+	len = strlen(version);
+
+#ifdef __linux__
+	/* Changes are queued as they happen, so anything made before the request was sent is seen here. */
+	if (watch_fd != -1)
+		handle_changes(verbose);
+#endif
+
+	if (strncmp(line, version, len) != 0) {
+		conn_reply(conn, "miss\n");
+	} else if (strcmp(line + len, "flush") == 0) {
+		if (verbose == 1)
+			fprintf(stdout, "xcrun: info: daemon: forgetting %d resolved queries.\n", nentries);
+		forget_all();
+		conn_reply(conn, "ok\n");
+	} else if ((known = recall(line)) != NULL) {
+		conn_reply(conn, known);
+	} else {
+		/* A make -j asks for the same tool many times at once; resolve it only once. */
+		conn->state = CONN_RESOLVING;
+		for (i = 0; i < nchildren; i++) {
+			if (children[i].pid != 0 && strcmp(children[i].request, line) == 0)
+				return;
+		}
+		if (start_child(line, resolve, verbose) != 0)
+			conn_reply(conn, "miss\n");
+	}
+}
+
+/**
+ * @func conn_write -- send as much of a reply as the client takes right now
+ * @arg conn - the client
+ */
+static void conn_write(daemon_conn *conn)
+{
+	ssize_t n;
+
+	while (conn->out_off < conn->out_len) {
+		if ((n = write(conn->fd, conn->out + conn->out_off, conn->out_len - conn->out_off)) == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				conn->state = CONN_DONE;
+			return;
+		}
+		conn->out_off += n;
+	}
+
+	conn->state = CONN_DONE;
+}
+
+/**
+ * @func conn_read -- read what a client sent, and handle its request once it is complete
+ * @arg conn - the client
+ * @arg resolve - resolver for queries we haven't seen yet
+ * @arg verbose - print what we are doing
+ */
+static void conn_read(daemon_conn *conn, daemon_resolver resolve, int verbose)
+{
+	char *end = NULL;
+	int result = read_some(conn->fd, &conn->in, DAEMON_MAX_REQUEST);
+
+	if (result == 0)
+		return;
+
+	if (result == -1 || conn->in.data == NULL || (end = strchr(conn->in.data, '\n')) == NULL) {
+		conn->state = CONN_DONE;
+		return;
+	}
+
+	*end = '\0';
+	handle_request(conn, resolve, verbose);
+}
+
+/**
+ * @func stop_handler -- ask the daemon to shut down
+ */
+static void stop_handler(int sig)
+{
+	(void)sig;
+	stop_requested = 1;
+}
+
+/**
+ * @func sweep -- close finished clients and drop collected children
+ */
+static void sweep(void)
+{
+	int i;
+
+	for (i = 0; i < nconns; ) {
+		if (conns[i].state != CONN_DONE) {
+			i++;
+			continue;
+		}
+		close(conns[i].fd);
+		free(conns[i].in.data);
+		free(conns[i].out);
+		conns[i] = conns[--nconns];
+	}
+
+	for (i = 0; i < nchildren; ) {
+		if (children[i].pid != 0) {
+			i++;
+			continue;
+		}
+		children[i] = children[--nchildren];
+	}
+}
+
+/**
+ * @func expire -- give up on clients and children that took too long
+ * @arg now - current time, from now_msec()
+ * @arg verbose - print what we are doing
+ * @return: milliseconds until the next deadline, -1 if there is none
+ */
+static int expire(long long now, int verbose)
+{
+	int i;
+	long long next = -1;
+
+	for (i = 0; i < nchildren; i++) {
+		if (children[i].deadline <= now)
+			finish_child(&children[i], 1, verbose);
+		else if (next == -1 || children[i].deadline < next)
+			next = children[i].deadline;
+	}
+
+	for (i = 0; i < nconns; i++) {
+		if (conns[i].deadline <= now)
+			conns[i].state = CONN_DONE;
+		else if (next == -1 || conns[i].deadline < next)
+			next = conns[i].deadline;
+	}
+
+	sweep();
+
+	return (next == -1) ? -1 : (int)(next - now);
+}
+
+int daemon_serve(daemon_resolver resolve, int verbose)
+{
+	int i;
+	int fd;
+	int client;
+	int nfds;
+	int timeout;
+	int first_conn;
+	int first_child;
+	mode_t mask;
+	const char *path = NULL;
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	struct pollfd fds[2 + DAEMON_MAX_CLIENTS + DAEMON_MAX_RESOLVING];
+
+	if ((path = socket_path()) == NULL) {
+		fprintf(stderr, "xcrun: error: unable to determine the daemon's socket path.\n");
+		return -1;
+	}
+
+	/* Only one daemon per user; a socket nobody listens on is left over from a crash. */
+	if ((fd = connect_daemon()) != -1) {
+		close(fd);
+		fprintf(stderr, "xcrun: error: a daemon is already listening on \'%s\'.\n", path);
+		return -1;
+	}
+	(void)unlink(path);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		fprintf(stderr, "xcrun: error: failed to create daemon socket. (errno=%s)\n", strerror(errno));
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	/* Nobody but us may talk to our daemon. */
+	mask = umask(077);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+		umask(mask);
+		fprintf(stderr, "xcrun: error: failed to listen on \'%s\'. (errno=%s)\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	umask(mask);
+	(void)set_nonblocking(fd);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stop_handler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGHUP, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	forget_all();
+
+	if (verbose == 1)
+		fprintf(stdout, "xcrun: info: daemon: listening on \'%s\'.\n", path);
+
+	/*
+	 * Nothing in here waits on a single client or child: requests are read as
+	 * they trickle in, misses are handed to a child whose reply is collected
+	 * through its pipe, and replies are sent as fast as each client takes them.
+	 */
+	while (stop_requested == 0) {
+		fflush(stdout);
+
+		timeout = expire(now_msec(), verbose);
+
+		/* Stop accepting while we are full; the kernel queues whoever connects meanwhile. */
+		nfds = 0;
+		fds[nfds].fd = (nconns < DAEMON_MAX_CLIENTS) ? fd : -1;
+		fds[nfds++].events = POLLIN;
+#ifdef __linux__
+		fds[nfds].fd = watch_fd;
+		fds[nfds++].events = POLLIN;
+#endif
+
+		first_conn = nfds;
+		for (i = 0; i < nconns; i++) {
+			fds[nfds].fd = (conns[i].state == CONN_RESOLVING) ? -1 : conns[i].fd;
+			fds[nfds++].events = (conns[i].state == CONN_WRITING) ? POLLOUT : POLLIN;
+		}
+
+		first_child = nfds;
+		for (i = 0; i < nchildren; i++) {
+			fds[nfds].fd = children[i].fd;
+			fds[nfds++].events = POLLIN;
+		}
+
+		if (poll(fds, nfds, timeout) == -1) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "xcrun: error: daemon failed to wait for requests. (errno=%s)\n", strerror(errno));
+			break;
+		}
+
+#ifdef __linux__
+		if (fds[1].fd != -1 && (fds[1].revents & POLLIN))
+			handle_changes(verbose);
+#endif
+
+		for (i = 0; i < nchildren; i++) {
+			if (fds[first_child + i].revents == 0)
+				continue;
+			if (read_some(children[i].fd, &children[i].out, PATH_MAX * (CACHE_MAX_STAMPS + REPLY_FIELDS)) != 0)
+				finish_child(&children[i], 0, verbose);
+		}
+
+		for (i = 0; i < first_child - first_conn; i++) {
+			if (fds[first_conn + i].revents == 0)
+				continue;
+			if (conns[i].state == CONN_READING) {
+				conn_read(&conns[i], resolve, verbose);
+			} else if (conns[i].state == CONN_WRITING)
+				conn_write(&conns[i]);
+		}
+
+		/* Replies that are ready are usually taken in one go, so don't wait for POLLOUT. */
+		for (i = 0; i < nconns; i++) {
+			if (conns[i].state == CONN_WRITING && conns[i].out_off == 0)
+				conn_write(&conns[i]);
+		}
+
+		if (fds[0].revents & POLLIN) {
+			while (nconns < DAEMON_MAX_CLIENTS && (client = accept(fd, NULL, NULL)) != -1) {
+				if (set_nonblocking(client) != 0) {
+					close(client);
+					continue;
+				}
+				memset(&conns[nconns], 0, sizeof(conns[nconns]));
+				conns[nconns].fd = client;
+				conns[nconns].state = CONN_READING;
+				conns[nconns].deadline = now_msec() + DAEMON_TIMEOUT;
+				nconns++;
+			}
+		}
+
+		sweep();
+	}
+
+	/* Whatever is still in flight is resolved by the clients themselves. */
+	for (i = 0; i < nchildren; i++)
+		finish_child(&children[i], 1, 0);
+	for (i = 0; i < nconns; i++)
+		conns[i].state = CONN_DONE;
+	sweep();
+
+	close(fd);
+	(void)unlink(path);
+	forget_all();
+
+	if (verbose == 1)
+		fprintf(stdout, "xcrun: info: daemon: stopped.\n");
+
+	return (stop_requested == 1) ? 0 : -1;
+}
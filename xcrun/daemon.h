@@ -0,0 +1,99 @@
+/* daemon.h - resolver daemon for xcrun
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __DAEMON_H__
+#define __DAEMON_H__
+
+#include "cache.h"
+
+/* Name of the daemon's socket, relative to $HOME */
+#define XCRUN_DAEMON_SOCKET ".xcrun.sock"
+
+/* Version of the request/reply protocol */
+#define XCRUN_DAEMON_VERSION 1
+
+/* Maximum number of resolved requests the daemon keeps in memory */
+#define DAEMON_MAX_ENTRIES CACHE_MAX_ENTRIES
+
+/* How long a client waits for the daemon before falling back, in milliseconds */
+#define DAEMON_TIMEOUT 2000
+
+/* Maximum number of clients the daemon serves at once */
+#define DAEMON_MAX_CLIENTS 256
+
+/* Maximum number of queries the daemon resolves at once */
+#define DAEMON_MAX_RESOLVING 16
+
+/* Everything a resolution depends on, as seen by the calling process */
+typedef struct {
+	const char *home;		/* HOME */
+	const char *developer_dir;	/* DEVELOPER_DIR, if set */
+	const char *sdkroot;		/* SDKROOT, if set */
+	const char *toolchains;		/* TOOLCHAINS, if set */
+	int mode;			/* search mode flags, see xcrun.c */
+	const char *sdk;		/* sdk name given with --sdk */
+	const char *toolchain;		/* toolchain name given with --toolchain */
+	const char *alternate_sdk;
+	const char *alternate_toolchain;
+	const char *driver;		/* compiler driver name, if any */
+	const char *tool;		/* tool to look up, NULL for sdk information only */
+} daemon_query;
+
+/* What the daemon resolved a query to */
+typedef struct {
+	const char *developer_dir;
+	const char *sdk;		/* selected sdk name */
+	const char *toolchain;		/* selected toolchain name */
+	const char *sdk_name;
+	const char *sdk_version;
+	const char *toolchain_name;
+	const char *toolchain_version;
+	cache_entry entry;		/* tool path (if any), environment and dependencies */
+} daemon_reply;
+
+/* Resolves a query on behalf of the daemon. Called in a child process, so it may
+   exit on errors. Returns 0 and fills reply on success, -1 on failure. */
+typedef int (*daemon_resolver)(const daemon_query *query, daemon_reply *reply);
+
+/* Ask a running daemon to resolve query. Returns 0 and fills reply on success, -1
+   if there is no daemon or it couldn't resolve the query. Strings in reply stay
+   valid until the next call. */
+int daemon_resolve(const daemon_query *query, daemon_reply *reply);
+
+/* Tell a running daemon to forget everything it has resolved. Returns 0 on
+   success, -1 if there is no daemon. */
+int daemon_flush(void);
+
+/* Serve requests on the daemon socket until interrupted. Returns 0 on a clean
+   shutdown, -1 if the daemon couldn't be started. */
+int daemon_serve(daemon_resolver resolve, int verbose);
+
+#endif /* __DAEMON_H__ */
@@ -0,0 +1,476 @@
+/* fsops.c - counted filesystem operations for xcrun
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <pthread.h>
+
+#include "fsops.h"
+
+/* Directories only need to be looked up through, not read, where the system allows it */
+#ifdef O_PATH
+#define FS_DIR_FLAGS (O_PATH | O_DIRECTORY | O_CLOEXEC)
+#else
+#define FS_DIR_FLAGS (O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+#endif
+
+/* A directory kept open by fs_dir_open */
+typedef struct {
+	char *path;		/* without trailing slashes */
+	size_t len;
+	int fd;
+} fs_dir;
+
+/* Work handed out by fs_parallel */
+typedef struct {
+	void (*work)(void *arg, int i);
+	void *arg;
+	int n;
+	int next;		/* next i to hand out, taken atomically */
+} fs_jobs;
+
+/* A thread started by fs_parallel */
+typedef struct {
+	fs_jobs *jobs;
+	fs_counters count;	/* its calls, added to fs_count once it is done */
+	pthread_t thread;
+} fs_worker;
+
+fs_counters fs_count;
+
+/* Where the calling thread's calls are counted, fs_count unless it is an fs_parallel worker */
+static __thread fs_counters *thread_count = NULL;
+#define COUNT ((thread_count != NULL) ? thread_count : &fs_count)
+
+static int ndirs = 0;
+static fs_dir dirs[FS_MAX_DIRS];
+
+/**
+ * @func count_lookups -- count the path components a call is about to look up by name
+ * @arg path - path handed to the call
+ */
+static void count_lookups(const char *path)
+{
+	const char *p = path;
+
+	while (*p != '\0') {
+		while (*p == '/')
+			p++;
+		if (*p == '\0')
+			break;
+		if (p[0] != '.' || (p[1] != '/' && p[1] != '\0'))
+			COUNT->lookups++;
+		while (*p != '\0' && *p != '/')
+			p++;
+	}
+}
+
+/**
+ * @func resolve_at -- find the innermost open directory that a path is under
+ * @arg path - path about to be used
+ * @arg rel - set to path relative to the returned directory
+ * @return: the directory's file descriptor, or AT_FDCWD (with rel set to path) if path isn't under one
+ */
+static int resolve_at(const char *path, const char **rel)
+{
+	int i;
+	int best = -1;
+
+	for (i = 0; i < ndirs; i++) {
+		if (strncmp(path, dirs[i].path, dirs[i].len) != 0 || (path[dirs[i].len] != '/' && path[dirs[i].len] != '\0'))
+			continue;
+		if (best == -1 || dirs[i].len > dirs[best].len)
+			best = i;
+	}
+
+	if (best == -1) {
+		*rel = path;
+		count_lookups(path);
+		return AT_FDCWD;
+	}
+
+	for (*rel = path + dirs[best].len; **rel == '/'; (*rel)++)
+		;
+	if (**rel == '\0')
+		*rel = ".";
+	count_lookups(*rel);
+
+	return dirs[best].fd;
+}
+
+int fs_stat(const char *path, struct stat *st)
+{
+	const char *rel = NULL;
+	int dirfd = resolve_at(path, &rel);
+
+	COUNT->stat++;
+	return fstatat(dirfd, rel, st, 0);
+}
+
+int fs_lstat(const char *path, struct stat *st)
+{
+	const char *rel = NULL;
+	int dirfd = resolve_at(path, &rel);
+
+	COUNT->stat++;
+	return fstatat(dirfd, rel, st, AT_SYMLINK_NOFOLLOW);
+}
+
+int fs_fstat(int fd, struct stat *st)
+{
+	COUNT->stat++;
+	return fstat(fd, st);
+}
+
+int fs_access(const char *path, int mode)
+{
+	const char *rel = NULL;
+	int dirfd = resolve_at(path, &rel);
+
+	COUNT->access++;
+	return faccessat(dirfd, rel, mode, 0);
+}
+
+int fs_open(const char *path, int flags, ...)
+{
+	int dirfd;
+	const char *rel = NULL;
+	va_list args;
+	mode_t mode = 0;
+
+	if ((flags & O_CREAT) != 0) {
+		va_start(args, flags);
+		mode = (mode_t)va_arg(args, int);
+		va_end(args);
+	}
+
+	dirfd = resolve_at(path, &rel);
+
+	COUNT->open++;
+	return openat(dirfd, rel, flags, mode);
+}
+
+int fs_close(int fd)
+{
+	COUNT->other++;
+	return close(fd);
+}
+
+ssize_t fs_read(int fd, void *buf, size_t len)
+{
+	COUNT->read++;
+	return read(fd, buf, len);
+}
+
+ssize_t fs_write(int fd, const void *buf, size_t len)
+{
+	COUNT->write++;
+	return write(fd, buf, len);
+}
+
+int fs_rename(const char *from, const char *to)
+{
+	COUNT->other++;
+	return rename(from, to);
+}
+
+int fs_unlink(const char *path)
+{
+	COUNT->other++;
+	return unlink(path);
+}
+
+int fs_symlink(const char *target, const char *path)
+{
+	COUNT->other++;
+	return symlink(target, path);
+}
+
+int fs_mkdir(const char *path, mode_t mode)
+{
+	COUNT->other++;
+	return mkdir(path, mode);
+}
+
+int fs_mkstemp(char *template)
+{
+	COUNT->open++;
+	return mkstemp(template);
+}
+
+int fs_faccessat(int dirfd, const char *path, int mode)
+{
+	count_lookups(path);
+	COUNT->access++;
+	return faccessat(dirfd, path, mode, 0);
+}
+
+DIR *fs_opendir(const char *path)
+{
+	int fd;
+	int saved_errno;
+	DIR *dir = NULL;
+	const char *rel = NULL;
+	int dirfd = resolve_at(path, &rel);
+
+	COUNT->open++;
+	if ((fd = openat(dirfd, rel, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+		return NULL;
+
+	if ((dir = fdopendir(fd)) == NULL) {
+		saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+	}
+
+	return dir;
+}
+
+int fs_closedir(DIR *dir)
+{
+	COUNT->other++;
+	return closedir(dir);
+}
+
+int fs_dir_open(const char *dir)
+{
+	int i;
+	int fd;
+	int dirfd;
+	size_t len;
+	char *path = NULL;
+	const char *rel = NULL;
+	struct stat st;
+
+	for (len = strlen(dir); len > 1 && dir[len - 1] == '/'; len--)
+		;
+
+	for (i = 0; i < ndirs; i++) {
+		if (dirs[i].len == len && strncmp(dirs[i].path, dir, len) == 0)
+			return 0;
+	}
+
+	/* A directory under one that is already open (an sdk in the developer dir, say) is opened relative to it. */
+	dirfd = resolve_at(dir, &rel);
+
+	if (ndirs == FS_MAX_DIRS || (path = strndup(dir, len)) == NULL) {
+		COUNT->stat++;
+		if (fstatat(dirfd, rel, &st, 0) != 0)
+			return -1;
+		if (S_ISDIR(st.st_mode) == 0) {
+			errno = ENOTDIR;
+			return -1;
+		}
+		return 0;
+	}
+
+	COUNT->open++;
+	if ((fd = openat(dirfd, rel, FS_DIR_FLAGS)) == -1) {
+		free(path);
+		return -1;
+	}
+
+	dirs[ndirs].path = path;
+	dirs[ndirs].len = len;
+	dirs[ndirs++].fd = fd;
+
+	return 0;
+}
+
+void fs_dir_close_all(void)
+{
+	while (ndirs > 0) {
+		ndirs--;
+		COUNT->other++;
+		close(dirs[ndirs].fd);
+		free(dirs[ndirs].path);
+	}
+}
+
+char *fs_read_file(const char *path, size_t *len)
+{
+	int fd;
+
+	if ((fd = fs_open(path, O_RDONLY)) == -1)
+		return NULL;
+
+	return fs_read_fd(fd, len);
+}
+
+char *fs_read_fd(int fd, size_t *len)
+{
+	int saved_errno;
+	char *buf = NULL;
+	struct stat st;
+	ssize_t n;
+	size_t off = 0;
+
+	if (fd == -1)
+		return NULL;
+
+	if (fs_fstat(fd, &st) != 0 || (buf = (char *)malloc(st.st_size + 1)) == NULL) {
+		saved_errno = errno;
+		fs_close(fd);
+		errno = saved_errno;
+		return NULL;
+	}
+
+	while (off < (size_t)st.st_size) {
+		if ((n = fs_read(fd, buf + off, st.st_size - off)) <= 0)
+			break;
+		off += n;
+	}
+
+	fs_close(fd);
+	buf[off] = '\0';
+
+	if (len != NULL)
+		*len = off;
+
+	return buf;
+}
+
+void *fs_map_file(const char *path, size_t *len)
+{
+	int fd;
+
+	if ((fd = fs_open(path, O_RDONLY)) == -1)
+		return NULL;
+
+	return fs_map_fd(fd, len);
+}
+
+void *fs_map_fd(int fd, size_t *len)
+{
+	int saved_errno;
+	void *map = NULL;
+	struct stat st;
+
+	if (fd == -1)
+		return NULL;
+
+	errno = 0;
+	if (fs_fstat(fd, &st) != 0 || st.st_size == 0) {
+		saved_errno = (errno != 0) ? errno : EINVAL;
+		fs_close(fd);
+		errno = saved_errno;
+		return NULL;
+	}
+
+	COUNT->other++;
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	saved_errno = errno;
+	fs_close(fd);
+	errno = saved_errno;
+
+	if (map == MAP_FAILED)
+		return NULL;
+
+	*len = st.st_size;
+
+	return map;
+}
+
+void fs_unmap_file(void *map, size_t len)
+{
+	COUNT->other++;
+	munmap(map, len);
+}
+
+/* helper function to do work until fs_parallel has none left */
+static void run_jobs(fs_jobs *jobs)
+{
+	int i;
+
+	while ((i = __sync_fetch_and_add(&jobs->next, 1)) < jobs->n)
+		jobs->work(jobs->arg, i);
+}
+
+/* helper function to run an fs_parallel worker thread */
+static void *run_worker(void *arg)
+{
+	fs_worker *worker = (fs_worker *)arg;
+
+	thread_count = &worker->count;
+	run_jobs(worker->jobs);
+
+	return NULL;
+}
+
+void fs_parallel(int n, void (*work)(void *arg, int i), void *arg)
+{
+	int i;
+	int nworkers;
+	fs_jobs jobs;
+	fs_worker workers[FS_MAX_THREADS - 1];
+
+	jobs.work = work;
+	jobs.arg = arg;
+	jobs.n = n;
+	jobs.next = 0;
+
+	/* The calling thread does its share too, and all of it if no thread can be started. */
+	for (nworkers = 0; nworkers < FS_MAX_THREADS - 1 && nworkers < n - 1; nworkers++) {
+		memset(&workers[nworkers].count, 0, sizeof(fs_counters));
+		workers[nworkers].jobs = &jobs;
+		if (pthread_create(&workers[nworkers].thread, NULL, run_worker, &workers[nworkers]) != 0)
+			break;
+	}
+
+	run_jobs(&jobs);
+
+	for (i = 0; i < nworkers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		COUNT->stat += workers[i].count.stat;
+		COUNT->access += workers[i].count.access;
+		COUNT->open += workers[i].count.open;
+		COUNT->read += workers[i].count.read;
+		COUNT->write += workers[i].count.write;
+		COUNT->other += workers[i].count.other;
+		COUNT->lookups += workers[i].count.lookups;
+	}
+}
+
+unsigned int fs_total(void)
+{
+	return (fs_count.stat + fs_count.access + fs_count.open + fs_count.read + fs_count.write + fs_count.other);
+}
@@ -0,0 +1,118 @@
+/* fsops.h - counted filesystem operations for xcrun
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __FSOPS_H__
+#define __FSOPS_H__
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+/* Most directories kept open with fs_dir_open */
+#define FS_MAX_DIRS 8
+
+/* Most threads fs_parallel spreads work over, including the calling thread */
+#define FS_MAX_THREADS 8
+
+/* Number of filesystem calls made so far, by kind */
+typedef struct {
+	unsigned int stat;
+	unsigned int access;
+	unsigned int open;
+	unsigned int read;
+	unsigned int write;
+	unsigned int other;
+	unsigned int lookups;	/* path components looked up by name (a round trip each on NFS), not a call of its own */
+} fs_counters;
+
+extern fs_counters fs_count;
+
+/* Thin wrappers around the system calls of the same name that keep fs_count
+   up to date. They behave exactly like the calls they wrap. */
+int fs_stat(const char *path, struct stat *st);
+int fs_lstat(const char *path, struct stat *st);
+int fs_fstat(int fd, struct stat *st);
+int fs_access(const char *path, int mode);
+int fs_open(const char *path, int flags, ...);
+int fs_close(int fd);
+ssize_t fs_read(int fd, void *buf, size_t len);
+ssize_t fs_write(int fd, const void *buf, size_t len);
+int fs_rename(const char *from, const char *to);
+int fs_unlink(const char *path);
+int fs_symlink(const char *target, const char *path);
+int fs_mkdir(const char *path, mode_t mode);
+int fs_mkstemp(char *template);
+int fs_faccessat(int dirfd, const char *path, int mode);
+DIR *fs_opendir(const char *path);
+int fs_closedir(DIR *dir);
+
+/* Open dir and keep it open, so that the calls above resolve paths under it
+   relative to it (with openat, fstatat and faccessat) instead of walking dir
+   itself again. Returns 0 on success (or if dir is already open) and -1 with
+   errno set if dir can't be opened, ENOTDIR if it isn't a directory. Once
+   FS_MAX_DIRS directories are open, dir is only checked. */
+int fs_dir_open(const char *dir);
+
+/* Close every directory opened by fs_dir_open. */
+void fs_dir_close_all(void);
+
+/* Read a whole file into a NUL terminated, malloc'ed buffer. Returns the buffer
+   (and its length in len, if not NULL) or NULL on failure with errno set. */
+char *fs_read_file(const char *path, size_t *len);
+
+/* Like fs_read_file, for a file that is already open. Closes fd, and fails if
+   fd is -1. */
+char *fs_read_fd(int fd, size_t *len);
+
+/* Map a whole file read only. Returns the mapping (and its length in len) or
+   NULL on failure (including empty files) with errno set. */
+void *fs_map_file(const char *path, size_t *len);
+
+/* Like fs_map_file, for a file that is already open. Closes fd, and fails if
+   fd is -1. */
+void *fs_map_fd(int fd, size_t *len);
+
+/* Unmap a file mapped by fs_map_file. */
+void fs_unmap_file(void *map, size_t len);
+
+/* Call work(arg, i) for every i below n, spread over up to FS_MAX_THREADS
+   threads, so that the round trips of filesystem bound work (reading many
+   small files or directories, say) overlap instead of adding up. work may use
+   the calls above, whose calls are added to fs_count once fs_parallel returns,
+   but not fs_dir_open, fs_dir_close_all, the arena or anything else that is
+   shared. Returns once work has been called for every i. */
+void fs_parallel(int n, void (*work)(void *arg, int i), void *arg);
+
+/* Total number of filesystem calls made so far. */
+unsigned int fs_total(void);
+
+#endif /* __FSOPS_H__ */
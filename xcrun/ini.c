@@ -200,3 +200,235 @@ int ini_parse(const char* filename,
     fclose(file);
     return error;
 }
+
+/* Strip whitespace from both ends of slice. Return nonzero if anything was
+   stripped from the start. */
+static int slice_strip(ini_slice* slice)
+{
+    const char* start = slice->ptr;
+
+    while (slice->len > 0 && isspace((unsigned char)slice->ptr[0])) {
+        slice->ptr++;
+        slice->len--;
+    }
+    while (slice->len > 0 && isspace((unsigned char)slice->ptr[slice->len - 1]))
+        slice->len--;
+    return slice->ptr > start;
+}
+
+/* Slice version of find_char_or_comment(): return offset of first char c or
+   ';' comment in slice, or its length if neither found. A null char also
+   ends the search, as it would end the string. */
+static size_t slice_find_char_or_comment(const ini_slice* slice, char c)
+{
+    int was_whitespace = 0;
+    size_t i = 0;
+
+    while (i < slice->len && slice->ptr[i] && slice->ptr[i] != c &&
+           !(was_whitespace && slice->ptr[i] == ';')) {
+        was_whitespace = isspace((unsigned char)slice->ptr[i]);
+        i++;
+    }
+    return i;
+}
+
+/* See documentation in header file. */
+int ini_slice_equals(const ini_slice* slice, const char* str)
+{
+    size_t len = strlen(str);
+
+    return slice->len == len && memcmp(slice->ptr, str, len) == 0;
+}
+
+/* See documentation in header file. */
+int ini_parse_buffer(const char* buf, size_t len,
+                     int (*handler)(void*, const ini_slice*, const ini_slice*,
+                                    const ini_slice*),
+                     void* user)
+{
+    const char* p = buf;
+    const char* buf_end = buf + len;
+    const char* eol = NULL;
+    ini_slice line;
+    ini_slice rest;
+    ini_slice section = { "", 0 };
+    ini_slice prev_name = { "", 0 };
+    ini_slice name;
+    ini_slice value;
+    size_t end;
+    int indented;
+    int lineno = 0;
+    int error = 0;
+
+    /* Scan through buffer line by line */
+    while (p < buf_end) {
+        lineno++;
+
+        eol = (const char*)memchr(p, '\n', buf_end - p);
+        line.ptr = p;
+        line.len = ((eol != NULL) ? eol : buf_end) - p;
+        p = (eol != NULL) ? eol + 1 : buf_end;
+
+#if INI_ALLOW_BOM
+        if (lineno == 1 && line.len >= 3 &&
+                           (unsigned char)line.ptr[0] == 0xEF &&
+                           (unsigned char)line.ptr[1] == 0xBB &&
+                           (unsigned char)line.ptr[2] == 0xBF) {
+            line.ptr += 3;
+            line.len -= 3;
+        }
+#endif
+        indented = slice_strip(&line);
+
+        if (line.len == 0) {
+            /* Blank line */
+        }
+        else if (line.ptr[0] == ';' || line.ptr[0] == '#') {
+            /* Per Python ConfigParser, allow '#' comments at start of line */
+        }
+#if INI_ALLOW_MULTILINE
+        else if (prev_name.len > 0 && indented) {
+            /* Non-black line with leading whitespace, treat as continuation
+               of previous name's value (as per Python ConfigParser). */
+            if (!handler(user, &section, &prev_name, &line) && !error)
+                error = lineno;
+        }
+#endif
+        else if (line.ptr[0] == '[') {
+            /* A "[section]" line */
+            rest.ptr = line.ptr + 1;
+            rest.len = line.len - 1;
+            end = slice_find_char_or_comment(&rest, ']');
+            if (end < rest.len && rest.ptr[end] == ']') {
+                section.ptr = rest.ptr;
+                section.len = end;
+                prev_name.len = 0;
+            }
+            else if (!error) {
+                /* No ']' found on section line */
+                error = lineno;
+            }
+        }
+        else {
+            /* Not a comment, must be a name[=:]value pair */
+            end = slice_find_char_or_comment(&line, '=');
+            if (end == line.len || line.ptr[end] != '=')
+                end = slice_find_char_or_comment(&line, ':');
+            if (end < line.len && (line.ptr[end] == '=' || line.ptr[end] == ':')) {
+                name.ptr = line.ptr;
+                name.len = end;
+                slice_strip(&name);
+                value.ptr = line.ptr + end + 1;
+                value.len = line.len - end - 1;
+                slice_strip(&value);
+                value.len = slice_find_char_or_comment(&value, '\0');
+                slice_strip(&value);
+
+                /* Valid name[=:]value pair found, call handler */
+                prev_name = name;
+                if (!handler(user, &section, &name, &value) && !error)
+                    error = lineno;
+            }
+            else if (!error) {
+                /* No '=' or ':' found on name[=:]value line */
+                error = lineno;
+            }
+        }
+    }
+
+    return error;
+}
+
+/* State shared with schema_handler() */
+typedef struct {
+    ini_schema* schema;
+    char* object;
+} schema_state;
+
+/* Hash a section and name for a schema's slots. */
+static size_t schema_hash(const char* section, size_t section_len,
+                          const char* name, size_t name_len)
+{
+    unsigned long hash = 2166136261UL;
+    size_t i;
+
+    for (i = 0; i < section_len; i++)
+        hash = (hash ^ (unsigned char)section[i]) * 16777619UL;
+    hash = (hash ^ '[') * 16777619UL;
+    for (i = 0; i < name_len; i++)
+        hash = (hash ^ (unsigned char)name[i]) * 16777619UL;
+    return hash % INI_SCHEMA_SLOTS;
+}
+
+/* Fill a schema's hash of its bindings. Return zero if there are too many. */
+static int schema_init(ini_schema* schema)
+{
+    const ini_binding* binding;
+    size_t slot;
+    size_t i;
+
+    if (schema->ready)
+        return 1;
+    if (schema->count > INI_SCHEMA_MAX)
+        return 0;
+
+    memset(schema->slots, 0, sizeof(schema->slots));
+    for (i = 0; i < schema->count; i++) {
+        binding = &schema->bindings[i];
+        slot = schema_hash(binding->section, strlen(binding->section),
+                           binding->name, strlen(binding->name));
+        while (schema->slots[slot])
+            slot = (slot + 1) % INI_SCHEMA_SLOTS;
+        schema->slots[slot] = (unsigned char)(i + 1);
+    }
+    schema->ready = 1;
+    return 1;
+}
+
+/* Handler for ini_parse_schema(): store a value in its bound field. */
+static int schema_handler(void* user, const ini_slice* section,
+                          const ini_slice* name, const ini_slice* value)
+{
+    schema_state* state = (schema_state*)user;
+    ini_schema* schema = state->schema;
+    const ini_binding* binding;
+    size_t slot;
+    size_t i;
+    int number = 0;
+
+    slot = schema_hash(section->ptr, section->len, name->ptr, name->len);
+    while (schema->slots[slot]) {
+        binding = &schema->bindings[schema->slots[slot] - 1];
+        if (ini_slice_equals(section, binding->section) &&
+            ini_slice_equals(name, binding->name)) {
+            if (binding->type == INI_BIND_STRING) {
+                *(char**)(state->object + binding->offset) =
+                    schema->copy(value->ptr, value->len);
+            }
+            else {
+                for (i = 0; i < value->len && isdigit((unsigned char)value->ptr[i]); i++)
+                    number = (number * 10) + (value->ptr[i] - '0');
+                *(int*)(state->object + binding->offset) = number;
+            }
+            if (binding->kind_offset != INI_NO_KIND)
+                *(int*)(state->object + binding->kind_offset) = binding->kind;
+            return 1;
+        }
+        slot = (slot + 1) % INI_SCHEMA_SLOTS;
+    }
+    return 0;
+}
+
+/* See documentation in header file. */
+int ini_parse_schema(const char* buf, size_t len, ini_schema* schema,
+                     void* object)
+{
+    schema_state state;
+
+    if (!schema_init(schema))
+        return -2;
+
+    state.schema = schema;
+    state.object = (char*)object;
+    return ini_parse_buffer(buf, len, schema_handler, &state);
+}
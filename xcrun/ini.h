@@ -42,10 +42,20 @@ extern "C" {
 #endif
 
 #include <stdio.h>
+#include <stddef.h>
 
 /* Useful macro taken from example/ini_example.c */
 #define MATCH_INI_STON(s, n) strcmp(section, s) == 0 && strcmp(name, n) == 0
 
+/* Same as MATCH_INI_STON, for handlers passed to ini_parse_buffer() */
+#define MATCH_INI_SLICE(s, n) ini_slice_equals(section, s) && ini_slice_equals(name, n)
+
+/* Length delimited (not null terminated) piece of a buffer */
+typedef struct {
+    const char* ptr;
+    size_t len;
+} ini_slice;
+
 /* Parse given INI-style file. May have [section]s, name=value pairs
    (whitespace stripped), and comments starting with ';' (semicolon). Section
    is "" if name=value pair parsed before any section heading. name:value
@@ -71,6 +81,63 @@ int ini_parse_file(FILE* file,
                                   const char* name, const char* value),
                    void* user);
 
+/* Same as ini_parse(), but parses len bytes of buf, e.g. a file that was read
+   or mapped as a whole. Section, name and value are handed to the handler as
+   slices of buf, so they stay valid for as long as buf does, and there is no
+   limit on the length of a line or section name. */
+int ini_parse_buffer(const char* buf, size_t len,
+                     int (*handler)(void* user, const ini_slice* section,
+                                    const ini_slice* name,
+                                    const ini_slice* value),
+                     void* user);
+
+/* Return nonzero if slice holds exactly the null terminated string str. */
+int ini_slice_equals(const ini_slice* slice, const char* str);
+
+/* Types of struct fields an ini_binding can fill */
+#define INI_BIND_STRING 0   /* char*, set to a copy made by the schema's copy function */
+#define INI_BIND_INT 1      /* int, set to the value's decimal number */
+
+/* kind_offset of a binding that doesn't set a kind field */
+#define INI_NO_KIND ((size_t)-1)
+
+/* Binds a [section] name=value pair to a struct field. If kind_offset isn't
+   INI_NO_KIND, the int field at that offset is set to kind as well. */
+typedef struct {
+    const char* section;
+    const char* name;
+    int type;
+    size_t offset;
+    size_t kind_offset;
+    int kind;
+} ini_binding;
+
+/* Maximum number of bindings in a schema */
+#define INI_SCHEMA_MAX 32
+
+/* Number of slots in a schema's hash of its bindings */
+#define INI_SCHEMA_SLOTS (INI_SCHEMA_MAX * 2)
+
+/* A set of bindings, looked up through a hash built on first use */
+typedef struct {
+    const ini_binding* bindings;
+    size_t count;
+    char* (*copy)(const char* str, size_t len);
+    int ready;
+    unsigned char slots[INI_SCHEMA_SLOTS];  /* binding index + 1, 0 if empty */
+} ini_schema;
+
+/* Initializer for an ini_schema over a static array of bindings */
+#define INI_SCHEMA(bindings, copy) \
+    { bindings, sizeof(bindings) / sizeof((bindings)[0]), copy, 0, { 0 } }
+
+/* Same as ini_parse_buffer(), but stores every value whose section and name
+   are bound in schema straight into the struct at object. Returns 0 on success,
+   the line number of the first parse error or unknown name, or -2 if schema
+   has more than INI_SCHEMA_MAX bindings. */
+int ini_parse_schema(const char* buf, size_t len, ini_schema* schema,
+                     void* object);
+
 /* Nonzero to allow multi-line value parsing, in the style of Python's
    ConfigParser. If allowed, ini_parse() will call the handler with the same
    name for each subsequent line parsed. */
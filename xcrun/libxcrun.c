@@ -0,0 +1,268 @@
+/* libxcrun.c - in-process sdk, toolchain and tool lookups
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <pthread.h>
+
+#include "cache.h"
+#include "libxcrun.h"
+#include "resolve.h"
+
+/* An sdk and toolchain selection, as given to xcrun_ctx_open */
+struct xcrun_ctx {
+	char *developer_dir;
+	char *sdk;
+	char *toolchain;
+	char error[XCRUN_ERROR_MAX];
+};
+
+/* Resolution state is global (and lives in the arena), so one call runs at a time. */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* helper function to copy an optional string */
+static int copy_string(char **dst, const char *src)
+{
+	*dst = NULL;
+
+	if (src != NULL && (*dst = strdup(src)) == NULL)
+		return -1;
+
+	return 0;
+}
+
+/* helper function to start a call: take the lock and catch errors in ctx */
+static void enter(xcrun_ctx *ctx, jmp_buf *jmp)
+{
+	pthread_mutex_lock(&lock);
+	resolve_catch(jmp, ctx->error, sizeof(ctx->error));
+}
+
+/* helper function to select what ctx asks for (after enter, from inside setjmp) */
+static void select_context(const xcrun_ctx *ctx, int finding)
+{
+	finding_mode = finding;
+
+	if (ctx->developer_dir != NULL)
+		resolve_select_developer_dir(ctx->developer_dir);
+	if (ctx->sdk != NULL)
+		resolve_select_sdk(ctx->sdk);
+	if (ctx->toolchain != NULL)
+		resolve_select_toolchain(ctx->toolchain);
+
+	select_sdk_and_toolchain();
+}
+
+/* helper function to end a call: forget everything it resolved and drop the lock */
+static void leave(void)
+{
+	resolve_catch(NULL, NULL, 0);
+	resolve_reset();
+	pthread_mutex_unlock(&lock);
+}
+
+/* helper function to copy a result out to a caller's buffer */
+static int copy_result(xcrun_ctx *ctx, const char *value, char *buf, size_t size)
+{
+	size_t len = strlen(value);
+
+	if (len >= size) {
+		snprintf(ctx->error, sizeof(ctx->error), "\'%s\' doesn't fit in %zu bytes.", value, size);
+		return -1;
+	}
+
+	memcpy(buf, value, len + 1);
+
+	return 0;
+}
+
+/**
+ * @func xcrun_ctx_open -- Make a context for an sdk and toolchain selection.
+ * @arg developer_dir - developer dir, NULL to find it as xcrun does
+ * @arg sdk - short name or absolute path of the sdk, NULL to choose it as xcrun does
+ * @arg toolchain - short name or absolute path of the toolchain, NULL to choose it as xcrun does
+ * @return: the context on success, NULL if out of memory
+ */
+xcrun_ctx *xcrun_ctx_open(const char *developer_dir, const char *sdk, const char *toolchain)
+{
+	xcrun_ctx *ctx = NULL;
+
+	if ((ctx = (xcrun_ctx *)calloc(1, sizeof(*ctx))) == NULL)
+		return NULL;
+
+	if (copy_string(&ctx->developer_dir, developer_dir) != 0 ||
+	    copy_string(&ctx->sdk, sdk) != 0 ||
+	    copy_string(&ctx->toolchain, toolchain) != 0) {
+		xcrun_ctx_close(ctx);
+		return NULL;
+	}
+
+	return ctx;
+}
+
+/**
+ * @func xcrun_ctx_close -- Free a context.
+ * @arg ctx - context made by xcrun_ctx_open (or NULL)
+ */
+void xcrun_ctx_close(xcrun_ctx *ctx)
+{
+	if (ctx == NULL)
+		return;
+
+	free(ctx->developer_dir);
+	free(ctx->sdk);
+	free(ctx->toolchain);
+	free(ctx);
+}
+
+/**
+ * @func xcrun_find_tool -- Find a tool for a context's selection, as xcrun -find does.
+ * @arg ctx - the context
+ * @arg name - tool's name
+ * @arg path - buffer for the tool's absolute path
+ * @arg size - size of path
+ * @return: 0 on success, -1 on failure
+ */
+int xcrun_find_tool(xcrun_ctx *ctx, const char *name, char *path, size_t size)
+{
+	jmp_buf jmp;
+	cache_entry entry;
+	const char *found = NULL;
+	volatile int retval = -1;
+
+	enter(ctx, &jmp);
+
+	if (setjmp(jmp) == 0) {
+		select_context(ctx, 1);
+		if ((found = resolve_command(name, &entry)) != NULL)
+			retval = copy_result(ctx, found, path, size);
+	}
+
+	leave();
+
+	return retval;
+}
+
+/**
+ * @func xcrun_sdk_property -- Look up a property of a context's sdk, as the --show-sdk-* options do.
+ * @arg ctx - the context
+ * @arg property - one of the XCRUN_SDK_* properties
+ * @arg buf - buffer for the property's value
+ * @arg size - size of buf
+ * @return: 0 on success, -1 on failure
+ */
+int xcrun_sdk_property(xcrun_ctx *ctx, int property, char *buf, size_t size)
+{
+	jmp_buf jmp;
+	const char *value = NULL;
+	volatile int retval = -1;
+
+	enter(ctx, &jmp);
+
+	if (setjmp(jmp) == 0) {
+		select_context(ctx, 1);
+		switch (property) {
+			case XCRUN_SDK_PATH:
+				value = get_sdk_path(current_sdk);
+				break;
+			case XCRUN_SDK_VERSION:
+				value = get_sdk_info(get_sdk_path(current_sdk)).version;
+				break;
+			case XCRUN_SDK_TARGET_TRIPLE:
+				value = get_target_triple(current_sdk);
+				break;
+			case XCRUN_SDK_TOOLCHAIN_PATH:
+				value = get_toolchain_path(current_toolchain);
+				break;
+			case XCRUN_SDK_TOOLCHAIN_VERSION:
+				value = get_toolchain_info(get_toolchain_path(current_toolchain)).version;
+				break;
+			case XCRUN_SDK_DEPLOYMENT_TARGET:
+				value = get_sdk_info(get_sdk_path(current_sdk)).deployment_target;
+				break;
+			default:
+				resolve_fail("unknown sdk property %d.", property);
+		}
+		if (value == NULL)
+			resolve_fail("%s.sdk doesn't specify the property.", current_sdk);
+		retval = copy_result(ctx, value, buf, size);
+	}
+
+	leave();
+
+	return retval;
+}
+
+/**
+ * @func xcrun_build_env -- Build the environment xcrun passes to a program it runs for a context's selection.
+ * @arg ctx - the context
+ * @return: malloc'ed array of "NAME=value" strings (ending with NULL) on success, NULL on failure
+ */
+char **xcrun_build_env(xcrun_ctx *ctx)
+{
+	int nvars;
+	void *block = NULL;
+	char ** volatile envp = NULL;
+	jmp_buf jmp;
+	cache_entry entry;
+	env_var vars[ENV_VARS];
+
+	enter(ctx, &jmp);
+
+	if (setjmp(jmp) == 0) {
+		select_context(ctx, 0);
+		memset(&entry, 0, sizeof(entry));
+		resolve_environment(&entry);
+		nvars = build_environment(&entry, vars, 1);
+
+		if ((block = malloc(environment_size(vars, nvars))) == NULL)
+			resolve_fail("out of memory.");
+
+		/* The array, then the strings it points to. */
+		envp = pack_environment(vars, nvars, block);
+	}
+
+	leave();
+
+	return envp;
+}
+
+/**
+ * @func xcrun_error -- Get the message for a context's last failure.
+ * @arg ctx - the context
+ * @return: the message, empty if there was no failure
+ */
+const char *xcrun_error(const xcrun_ctx *ctx)
+{
+	return ctx->error;
+}
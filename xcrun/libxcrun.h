@@ -0,0 +1,98 @@
+/* libxcrun.h - in-process sdk, toolchain and tool lookups
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __LIBXCRUN_H__
+#define __LIBXCRUN_H__
+
+#include <stddef.h>
+
+/*
+ * libxcrun answers the questions that xcrun -find, --show-sdk-* and the
+ * environment of a called program answer, without running xcrun. Lookups share
+ * xcrun's lookup cache, directory index and registry.
+ *
+ * Every function may be called from any thread. Resolution state is global, so
+ * calls are serialized by a single process-wide lock, across all contexts: two
+ * threads with their own contexts still take turns. Each call starts from
+ * nothing but its context and the environment (SDKROOT, TOOLCHAINS,
+ * TARGET_TRIPLE, ...), so a change to either is seen by the next call.
+ *
+ * Because of that lock, and because calls allocate, no function may be called
+ * from a signal handler, nor from the child of a fork() made by a threaded
+ * process before it execs. Failures, running out of memory included, are
+ * returned and described by xcrun_error(); no call ever exits the process.
+ */
+
+/* What libxcrun.so exports, everything else in it is hidden */
+#define XCRUN_API __attribute__ ((visibility("default")))
+
+/* Properties of the selected sdk, see xcrun_sdk_property() */
+#define XCRUN_SDK_PATH 1
+#define XCRUN_SDK_VERSION 2
+#define XCRUN_SDK_TARGET_TRIPLE 3
+#define XCRUN_SDK_TOOLCHAIN_PATH 4
+#define XCRUN_SDK_TOOLCHAIN_VERSION 5
+#define XCRUN_SDK_DEPLOYMENT_TARGET 6
+
+/* Longest error message kept for xcrun_error() */
+#define XCRUN_ERROR_MAX 512
+
+/* An sdk and toolchain selection */
+typedef struct xcrun_ctx xcrun_ctx;
+
+/* Make a context for developer_dir (chosen as xcrun does if NULL), selecting sdk
+   and toolchain by short name or absolute path as --sdk and --toolchain do
+   (chosen as xcrun does if NULL). Nothing is resolved until the context is
+   used. Returns the context, NULL if out of memory. */
+XCRUN_API xcrun_ctx *xcrun_ctx_open(const char *developer_dir, const char *sdk, const char *toolchain);
+
+/* Free a context made by xcrun_ctx_open. */
+XCRUN_API void xcrun_ctx_close(xcrun_ctx *ctx);
+
+/* Find the tool called name, as xcrun -find does, placing its absolute path in
+   path (size bytes long). Returns 0 on success, -1 on failure. */
+XCRUN_API int xcrun_find_tool(xcrun_ctx *ctx, const char *name, char *path, size_t size);
+
+/* Place one of the XCRUN_SDK_* properties of the selected sdk in buf (size bytes
+   long). Returns 0 on success, -1 on failure (including when the sdk doesn't
+   specify the property). */
+XCRUN_API int xcrun_sdk_property(xcrun_ctx *ctx, int property, char *buf, size_t size);
+
+/* Build the environment xcrun passes to a program it runs, as a NULL terminated
+   array of "NAME=value" strings. The array and its strings are a single
+   allocation, to be freed with free(). Returns NULL on failure. */
+XCRUN_API char **xcrun_build_env(xcrun_ctx *ctx);
+
+/* Message for the context's last failure, empty if there was none. Valid until
+   the next call with the context. */
+XCRUN_API const char *xcrun_error(const xcrun_ctx *ctx);
+
+#endif /* __LIBXCRUN_H__ */
@@ -0,0 +1,548 @@
+/* registry.c - compiled sdk and toolchain registry for xcrun
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The registry is a single binary file holding what xcrun would otherwise parse
+ * out of xcrun.ini and every sdk's and toolchain's info.ini on each start: a fixed
+ * header, an array of sdk records, an array of toolchain records and a table of
+ * NUL terminated strings the records refer to by offset. It is mapped read only
+ * and read in place. Every record carries the modification time of the file it
+ * was compiled from, and a record is only used while that file is unchanged;
+ * otherwise xcrun falls back to parsing the ini file. Like the lookup cache the
+ * file is replaced as a whole, so readers never see a partially written one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "registry.h"
+#include "fsops.h"
+#include "store.h"
+
+#ifdef __APPLE__
+#define ST_MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#else
+#define ST_MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif
+
+/* First bytes of every registry file */
+#define REGISTRY_MAGIC "xcrunreg"
+
+/* Registry file header */
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t size;			/* size of the whole file */
+	uint32_t developer_dir;		/* string offsets, 0 for none */
+	uint32_t defaults_path;
+	uint64_t generation;		/* developer dir generation */
+	int64_t defaults_sec;		/* -1 if defaults_path did not exist */
+	int64_t defaults_nsec;
+	uint32_t default_sdk;
+	uint32_t default_toolchain;
+	uint32_t nsdks;			/* sdk records follow the header */
+	uint32_t ntoolchains;		/* toolchain records follow the sdk records */
+	int64_t sdks_sec;		/* modification time of the SDKs directory, -1 if it did not exist */
+	int64_t sdks_nsec;
+	int64_t toolchains_sec;		/* modification time of the Toolchains directory, -1 if it did not exist */
+	int64_t toolchains_nsec;
+} reg_header;
+
+/* Registry sdk record */
+typedef struct {
+	uint32_t path;
+	uint32_t name;
+	uint32_t version;
+	uint32_t toolchain;
+	uint32_t default_arch;
+	uint32_t deployment_target;
+	uint32_t target_triple;
+	uint32_t archs;
+	uint32_t target_triples;
+	int32_t deployment_kind;
+	int64_t sec;			/* modification time of info.ini */
+	int64_t nsec;
+} reg_sdk;
+
+/* Registry toolchain record */
+typedef struct {
+	uint32_t path;
+	uint32_t name;
+	uint32_t version;
+	uint32_t reserved;
+	int64_t sec;			/* modification time of info.ini */
+	int64_t nsec;
+} reg_toolchain;
+
+/* Growable buffer for the string table */
+typedef struct {
+	char *data;
+	size_t len;
+	size_t size;
+} reg_strings;
+
+/* The mapped registry, if any */
+static const char *map = NULL;
+static size_t map_len = 0;
+static const reg_header *header = NULL;
+
+/**
+ * @func add_string -- append a string to the string table
+ * @arg strings - string table
+ * @arg base - file offset of the string table
+ * @arg str - string to add (NULL is stored as offset 0)
+ * @arg off - set to the string's file offset
+ * @return: 0 on success, -1 on failure
+ */
+static int add_string(reg_strings *strings, size_t base, const char *str, uint32_t *off)
+{
+	char *data = NULL;
+	size_t len;
+	size_t size;
+
+	if (str == NULL) {
+		*off = 0;
+		return 0;
+	}
+
+	len = strlen(str) + 1;
+	if (strings->len + len > strings->size) {
+		size = (strings->size != 0) ? strings->size : 4096;
+		while (strings->len + len > size)
+			size *= 2;
+		if ((data = (char *)realloc(strings->data, size)) == NULL)
+			return -1;
+		strings->data = data;
+		strings->size = size;
+	}
+
+	memcpy(strings->data + strings->len, str, len);
+	*off = (uint32_t)(base + strings->len);
+	strings->len += len;
+
+	return 0;
+}
+
+/**
+ * @func get_stamp -- record the modification time of a file
+ * @arg path - file to stamp (NULL is treated as missing)
+ * @arg sec - set to the seconds, or -1 if the file doesn't exist
+ * @arg nsec - set to the nanoseconds
+ */
+static void get_stamp(const char *path, int64_t *sec, int64_t *nsec)
+{
+	struct stat st;
+
+	if (path != NULL && fs_stat(path, &st) == 0) {
+		*sec = (int64_t)st.st_mtime;
+		*nsec = (int64_t)ST_MTIME_NSEC(st);
+	} else {
+		*sec = -1;
+		*nsec = 0;
+	}
+}
+
+/**
+ * @func stamp_is_current -- check if a file's modification time still holds
+ * @return: 1 if unchanged, 0 otherwise
+ */
+static int stamp_is_current(const char *path, int64_t sec, int64_t nsec)
+{
+	int64_t now_sec, now_nsec;
+
+	get_stamp(path, &now_sec, &now_nsec);
+
+	return (now_sec == sec && now_nsec == nsec);
+}
+
+/**
+ * @func info_path -- get the path of the info.ini in an sdk or toolchain
+ * @arg buf - buffer to place the path in
+ * @arg size - size of buf
+ * @arg dir - sdk or toolchain path
+ * @return: buf, or NULL if the path doesn't fit
+ */
+static const char *info_path(char *buf, size_t size, const char *dir)
+{
+	if (snprintf(buf, size, "%s/info.ini", dir) >= (int)size)
+		return NULL;
+
+	return buf;
+}
+
+/**
+ * @func bundle_dir -- get the path of the directory the sdks or toolchains of a developer dir are in
+ * @arg buf - buffer to place the path in
+ * @arg size - size of buf
+ * @arg developer_dir - developer dir (or NULL)
+ * @arg name - "SDKs" or "Toolchains"
+ * @return: buf, or NULL if there is no developer dir or the path doesn't fit
+ */
+static const char *bundle_dir(char *buf, size_t size, const char *developer_dir, const char *name)
+{
+	if (developer_dir == NULL || snprintf(buf, size, "%s/%s", developer_dir, name) >= (int)size)
+		return NULL;
+
+	return buf;
+}
+
+/**
+ * @func reg_string -- get a string from the mapped registry
+ * @arg off - string offset
+ * @return: the string, or NULL for offset 0
+ */
+static const char *reg_string(uint32_t off)
+{
+	if (off == 0 || off >= map_len)
+		return NULL;
+
+	return map + off;
+}
+
+/**
+ * @func registry_file_path -- get the absolute path of the registry file
+ * @return: path to the registry file or NULL if HOME isn't set
+ */
+static const char *registry_file_path(void)
+{
+	static char path[PATH_MAX];
+
+	return store_path(path, sizeof(path), XCRUN_REGISTRY_FILE);
+}
+
+int registry_write(const registry_contents *contents)
+{
+	int i;
+	int error = 0;
+	char buf[PATH_MAX];
+	const char *path = NULL;
+	char *data = NULL;
+	size_t base;
+	size_t len;
+	reg_header hdr;
+	reg_sdk *sdks = NULL;
+	reg_toolchain *toolchains = NULL;
+	reg_strings strings = { NULL, 0, 0 };
+	int retval = -1;
+
+	if ((path = registry_file_path()) == NULL)
+		return -1;
+
+	if (contents->nsdks > REGISTRY_MAX_ENTRIES || contents->ntoolchains > REGISTRY_MAX_ENTRIES)
+		return -1;
+
+	base = sizeof(hdr) + (contents->nsdks * sizeof(reg_sdk)) + (contents->ntoolchains * sizeof(reg_toolchain));
+
+	sdks = (reg_sdk *)calloc(contents->nsdks + 1, sizeof(reg_sdk));
+	toolchains = (reg_toolchain *)calloc(contents->ntoolchains + 1, sizeof(reg_toolchain));
+	if (sdks == NULL || toolchains == NULL)
+		goto done;
+
+	/* Offset 0 means "no string", which a real string can never start at. */
+	memset(&hdr, 0, sizeof(hdr));
+
+	memcpy(hdr.magic, REGISTRY_MAGIC, sizeof(hdr.magic));
+	hdr.version = XCRUN_REGISTRY_VERSION;
+	hdr.generation = contents->generation;
+	error |= add_string(&strings, base, contents->developer_dir, &hdr.developer_dir);
+	error |= add_string(&strings, base, contents->defaults_path, &hdr.defaults_path);
+	error |= add_string(&strings, base, contents->default_sdk, &hdr.default_sdk);
+	error |= add_string(&strings, base, contents->default_toolchain, &hdr.default_toolchain);
+	get_stamp(contents->defaults_path, &hdr.defaults_sec, &hdr.defaults_nsec);
+	get_stamp(bundle_dir(buf, sizeof(buf), contents->developer_dir, "SDKs"), &hdr.sdks_sec, &hdr.sdks_nsec);
+	get_stamp(bundle_dir(buf, sizeof(buf), contents->developer_dir, "Toolchains"), &hdr.toolchains_sec, &hdr.toolchains_nsec);
+	hdr.nsdks = contents->nsdks;
+	hdr.ntoolchains = contents->ntoolchains;
+
+	for (i = 0; i < contents->nsdks; i++) {
+		const registry_sdk *sdk = &contents->sdks[i];
+
+		error |= add_string(&strings, base, sdk->path, &sdks[i].path);
+		error |= add_string(&strings, base, sdk->name, &sdks[i].name);
+		error |= add_string(&strings, base, sdk->version, &sdks[i].version);
+		error |= add_string(&strings, base, sdk->toolchain, &sdks[i].toolchain);
+		error |= add_string(&strings, base, sdk->default_arch, &sdks[i].default_arch);
+		error |= add_string(&strings, base, sdk->deployment_target, &sdks[i].deployment_target);
+		error |= add_string(&strings, base, sdk->target_triple, &sdks[i].target_triple);
+		error |= add_string(&strings, base, sdk->archs, &sdks[i].archs);
+		error |= add_string(&strings, base, sdk->target_triples, &sdks[i].target_triples);
+		sdks[i].deployment_kind = sdk->deployment_kind;
+		if (sdk->stamped == 1) {
+			sdks[i].sec = sdk->info_sec;
+			sdks[i].nsec = sdk->info_nsec;
+		} else
+			get_stamp(info_path(buf, sizeof(buf), sdk->path), &sdks[i].sec, &sdks[i].nsec);
+	}
+
+	for (i = 0; i < contents->ntoolchains; i++) {
+		const registry_toolchain *toolchain = &contents->toolchains[i];
+
+		error |= add_string(&strings, base, toolchain->path, &toolchains[i].path);
+		error |= add_string(&strings, base, toolchain->name, &toolchains[i].name);
+		error |= add_string(&strings, base, toolchain->version, &toolchains[i].version);
+		if (toolchain->stamped == 1) {
+			toolchains[i].sec = toolchain->info_sec;
+			toolchains[i].nsec = toolchain->info_nsec;
+		} else
+			get_stamp(info_path(buf, sizeof(buf), toolchain->path), &toolchains[i].sec, &toolchains[i].nsec);
+	}
+
+	if (error != 0 || base + strings.len > UINT32_MAX)
+		goto done;
+
+	len = base + strings.len;
+	hdr.size = (uint32_t)len;
+
+	if ((data = (char *)malloc(len)) == NULL)
+		goto done;
+
+	memcpy(data, &hdr, sizeof(hdr));
+	memcpy(data + sizeof(hdr), sdks, contents->nsdks * sizeof(reg_sdk));
+	memcpy(data + sizeof(hdr) + (contents->nsdks * sizeof(reg_sdk)), toolchains, contents->ntoolchains * sizeof(reg_toolchain));
+	memcpy(data + base, strings.data, strings.len);
+
+	retval = store_publish(path, data, len);
+
+done:
+	free(data);
+	free(sdks);
+	free(toolchains);
+	free(strings.data);
+
+	return retval;
+}
+
+int registry_open(const char *developer_dir, unsigned long generation)
+{
+	const char *path = NULL;
+	const char *dir = NULL;
+	size_t records;
+
+	if (header != NULL)
+		return 0;
+
+	if (developer_dir == NULL || (path = registry_file_path()) == NULL)
+		return -1;
+
+	if ((map = (const char *)fs_map_fd(store_open(path), &map_len)) == NULL)
+		return -1;
+
+	header = (const reg_header *)map;
+
+	/* Make sure every record and every string lies within the file. */
+	if (map_len < sizeof(*header) ||
+	    memcmp(header->magic, REGISTRY_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->version != XCRUN_REGISTRY_VERSION ||
+	    header->size != map_len ||
+	    map[map_len - 1] != '\0')
+		goto unusable;
+
+	records = sizeof(*header) + ((size_t)header->nsdks * sizeof(reg_sdk)) + ((size_t)header->ntoolchains * sizeof(reg_toolchain));
+	if (header->nsdks > REGISTRY_MAX_ENTRIES || header->ntoolchains > REGISTRY_MAX_ENTRIES || records > map_len)
+		goto unusable;
+
+	/* A registry is only good for the developer dir (and generation) it was compiled from. */
+	if (header->generation != generation || (dir = reg_string(header->developer_dir)) == NULL || strcmp(dir, developer_dir) != 0)
+		goto unusable;
+
+	return 0;
+
+unusable:
+	registry_close();
+
+	return -1;
+}
+
+void registry_close(void)
+{
+	if (map != NULL)
+		fs_unmap_file((void *)map, map_len);
+
+	map = NULL;
+	map_len = 0;
+	header = NULL;
+}
+
+int registry_defaults(const char *path, const char **sdk, const char **toolchain)
+{
+	const char *from = NULL;
+
+	if (header == NULL || (from = reg_string(header->defaults_path)) == NULL || strcmp(from, path) != 0)
+		return -1;
+
+	if (header->defaults_sec == -1 || stamp_is_current(path, header->defaults_sec, header->defaults_nsec) == 0)
+		return -1;
+
+	*sdk = reg_string(header->default_sdk);
+	*toolchain = reg_string(header->default_toolchain);
+
+	return 0;
+}
+
+/**
+ * @func get_sdk -- copy an sdk record out of the mapped registry
+ * @arg record - the record
+ * @arg sdk - sdk to fill in
+ */
+static void get_sdk(const reg_sdk *record, registry_sdk *sdk)
+{
+	sdk->path = reg_string(record->path);
+	sdk->name = reg_string(record->name);
+	sdk->version = reg_string(record->version);
+	sdk->toolchain = reg_string(record->toolchain);
+	sdk->default_arch = reg_string(record->default_arch);
+	sdk->deployment_target = reg_string(record->deployment_target);
+	sdk->deployment_kind = record->deployment_kind;
+	sdk->target_triple = reg_string(record->target_triple);
+	sdk->archs = reg_string(record->archs);
+	sdk->target_triples = reg_string(record->target_triples);
+	sdk->stamped = 1;
+	sdk->info_sec = record->sec;
+	sdk->info_nsec = record->nsec;
+}
+
+/**
+ * @func get_toolchain -- copy a toolchain record out of the mapped registry
+ * @arg record - the record
+ * @arg toolchain - toolchain to fill in
+ */
+static void get_toolchain(const reg_toolchain *record, registry_toolchain *toolchain)
+{
+	toolchain->path = reg_string(record->path);
+	toolchain->name = reg_string(record->name);
+	toolchain->version = reg_string(record->version);
+	toolchain->stamped = 1;
+	toolchain->info_sec = record->sec;
+	toolchain->info_nsec = record->nsec;
+}
+
+int registry_find_sdk(const char *path, registry_sdk *sdk)
+{
+	uint32_t i;
+	char buf[PATH_MAX];
+	const char *record_path = NULL;
+	const reg_sdk *records = NULL;
+
+	if (header == NULL)
+		return -1;
+
+	records = (const reg_sdk *)(map + sizeof(*header));
+
+	for (i = 0; i < header->nsdks; i++) {
+		if ((record_path = reg_string(records[i].path)) == NULL || strcmp(record_path, path) != 0)
+			continue;
+
+		if (stamp_is_current(info_path(buf, sizeof(buf), path), records[i].sec, records[i].nsec) == 0)
+			return -1;
+
+		get_sdk(&records[i], sdk);
+
+		return 0;
+	}
+
+	return -1;
+}
+
+int registry_find_toolchain(const char *path, registry_toolchain *toolchain)
+{
+	uint32_t i;
+	char buf[PATH_MAX];
+	const char *record_path = NULL;
+	const reg_toolchain *records = NULL;
+
+	if (header == NULL)
+		return -1;
+
+	records = (const reg_toolchain *)(map + sizeof(*header) + (header->nsdks * sizeof(reg_sdk)));
+
+	for (i = 0; i < header->ntoolchains; i++) {
+		if ((record_path = reg_string(records[i].path)) == NULL || strcmp(record_path, path) != 0)
+			continue;
+
+		if (stamp_is_current(info_path(buf, sizeof(buf), path), records[i].sec, records[i].nsec) == 0)
+			return -1;
+
+		get_toolchain(&records[i], toolchain);
+
+		return 0;
+	}
+
+	return -1;
+}
+
+int registry_list(registry_contents *contents, registry_sdk *sdks, registry_toolchain *toolchains)
+{
+	uint32_t i;
+	char buf[PATH_MAX];
+	const reg_sdk *sdk_records = NULL;
+	const reg_toolchain *toolchain_records = NULL;
+
+	if (header == NULL)
+		return -1;
+
+	memset(contents, 0, sizeof(*contents));
+	contents->developer_dir = reg_string(header->developer_dir);
+	contents->generation = header->generation;
+	contents->defaults_path = reg_string(header->defaults_path);
+	contents->default_sdk = reg_string(header->default_sdk);
+	contents->default_toolchain = reg_string(header->default_toolchain);
+
+	/* An sdk or toolchain that was added or removed changes the directory it is in. */
+	if (stamp_is_current(bundle_dir(buf, sizeof(buf), contents->developer_dir, "SDKs"), header->sdks_sec, header->sdks_nsec) == 0 ||
+	    stamp_is_current(bundle_dir(buf, sizeof(buf), contents->developer_dir, "Toolchains"), header->toolchains_sec, header->toolchains_nsec) == 0)
+		return -1;
+
+	sdk_records = (const reg_sdk *)(map + sizeof(*header));
+	for (i = 0; i < header->nsdks; i++) {
+		get_sdk(&sdk_records[i], &sdks[i]);
+		if (sdks[i].path == NULL || stamp_is_current(info_path(buf, sizeof(buf), sdks[i].path), sdk_records[i].sec, sdk_records[i].nsec) == 0)
+			return -1;
+	}
+
+	toolchain_records = (const reg_toolchain *)(map + sizeof(*header) + (header->nsdks * sizeof(reg_sdk)));
+	for (i = 0; i < header->ntoolchains; i++) {
+		get_toolchain(&toolchain_records[i], &toolchains[i]);
+		if (toolchains[i].path == NULL || stamp_is_current(info_path(buf, sizeof(buf), toolchains[i].path), toolchain_records[i].sec, toolchain_records[i].nsec) == 0)
+			return -1;
+	}
+
+	contents->nsdks = header->nsdks;
+	contents->sdks = sdks;
+	contents->ntoolchains = header->ntoolchains;
+	contents->toolchains = toolchains;
+
+	return 0;
+}
@@ -0,0 +1,111 @@
+/* registry.h - compiled sdk and toolchain registry for xcrun
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __REGISTRY_H__
+#define __REGISTRY_H__
+
+/* Name of the registry file, relative to $HOME */
+#define XCRUN_REGISTRY_FILE ".xcrun.registry"
+
+/* Version of the on-disk registry format */
+#define XCRUN_REGISTRY_VERSION 4
+
+/* Maximum number of sdks (and of toolchains) a registry holds */
+#define REGISTRY_MAX_ENTRIES 256
+
+/* An sdk as compiled from its info.ini */
+typedef struct {
+	const char *path;		/* absolute path of the sdk */
+	const char *name;
+	const char *version;
+	const char *toolchain;
+	const char *default_arch;
+	const char *deployment_target;
+	int deployment_kind;		/* see xcrun.c */
+	const char *target_triple;	/* NULL if there is no default_arch or deployment target */
+	const char *archs;		/* every architecture the sdk supports, NULL if it doesn't say */
+	const char *target_triples;	/* space separated, one per archs entry, NULL if there is no archs or deployment target */
+	int stamped;			/* info_sec and info_nsec are set, else registry_write looks them up */
+	long long info_sec;		/* modification time of the info.ini this was read from */
+	long info_nsec;
+} registry_sdk;
+
+/* A toolchain as compiled from its info.ini */
+typedef struct {
+	const char *path;		/* absolute path of the toolchain */
+	const char *name;
+	const char *version;
+	int stamped;			/* see registry_sdk */
+	long long info_sec;
+	long info_nsec;
+} registry_toolchain;
+
+/* Everything compiled into a registry */
+typedef struct {
+	const char *developer_dir;
+	unsigned long generation;	/* developer dir generation, see xcode-select */
+	const char *defaults_path;	/* xcrun.ini the defaults came from */
+	const char *default_sdk;
+	const char *default_toolchain;
+	int nsdks;
+	const registry_sdk *sdks;
+	int ntoolchains;
+	const registry_toolchain *toolchains;
+} registry_contents;
+
+/* Compile contents into the registry file, recording the modification time of
+   defaults_path and of every sdk's and toolchain's info.ini (unless it is
+   already stamped with it). Returns 0 on success, -1 on failure. */
+int registry_write(const registry_contents *contents);
+
+/* Map the registry file if it was compiled for this generation of developer_dir.
+   Returns 0 on success, -1 if there is no usable registry. */
+int registry_open(const char *developer_dir, unsigned long generation);
+
+/* Unmap the registry, if it is open. Strings fetched from it become invalid. */
+void registry_close(void);
+
+/* Fetch the defaults compiled from path. Returns 0 on success, -1 if the
+   registry isn't open, came from a different file or path has changed since. */
+int registry_defaults(const char *path, const char **sdk, const char **toolchain);
+
+/* Fetch the sdk (or toolchain) at path. Strings point into the mapped registry.
+   Returns 0 on success, -1 if it isn't registered or its info.ini has changed. */
+int registry_find_sdk(const char *path, registry_sdk *sdk);
+int registry_find_toolchain(const char *path, registry_toolchain *toolchain);
+
+/* Fetch everything compiled into the registry, placing the sdks and toolchains in
+   sdks and toolchains (REGISTRY_MAX_ENTRIES long each). Returns 0 on success, -1
+   if the registry isn't open, an sdk or toolchain was added or removed since it
+   was compiled or one of their info.ini files has changed. */
+int registry_list(registry_contents *contents, registry_sdk *sdks, registry_toolchain *toolchains);
+
+#endif /* __REGISTRY_H__ */
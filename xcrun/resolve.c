@@ -0,0 +1,2026 @@
+/* resolve.c - sdk, toolchain and tool resolution for xcrun and libxcrun
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <libgen.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+extern char **environ;
+
+#include "ini.h"
+#include "arena.h"
+#include "cache.h"
+#include "defaults.h"
+#include "fsops.h"
+#include "registry.h"
+#include "resolve.h"
+#include "store.h"
+#include "trace.h"
+
+#ifdef __APPLE__
+#define ST_MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#else
+#define ST_MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif
+
+/* Variables passed through unless XCRUN_PASS_ENV says otherwise (a trailing '*' matches any suffix) */
+#define ENV_PASS_DEFAULT "CCACHE_* SCCACHE_* DISTCC_* SOURCE_DATE_EPOCH"
+
+/* Most names in XCRUN_PASS_ENV that are used */
+#define PASS_PATTERNS_MAX 32
+
+/* Most directories of a PATH checked for duplicates */
+#define PATH_DIRS_MAX 128
+
+/* Directory already in a PATH being built, see canonical_path */
+typedef struct {
+	size_t offset;
+	size_t len;
+} path_span;
+
+/* Name (or prefix, if it ended in '*') from XCRUN_PASS_ENV */
+typedef struct {
+	const char *name;
+	size_t len;	/* without the '*' */
+	int prefix;
+} pass_pattern;
+
+/* An info.ini scan_developer_dir reads */
+typedef struct {
+	const char *path;
+	char *buf;		/* its contents, NULL if it couldn't be read */
+	size_t len;
+	int stamped;		/* st holds its status, taken before reading it */
+	struct stat st;
+} info_job;
+
+/* Number of distinct SDKs or toolchains one invocation may resolve */
+#define CONTEXT_SLOTS 4
+
+/* Memoized sdk lookups */
+typedef struct {
+	char *name;
+	char *path;
+	int have_config;
+	sdk_config config;
+} sdk_record;
+
+/* Memoized toolchain lookups */
+typedef struct {
+	char *name;
+	char *path;
+	int have_config;
+	toolchain_config config;
+} toolchain_record;
+
+/*
+ * Resolution context, filled in lazily. Every info.ini (and xcrun.ini) is parsed and
+ * every sdk and toolchain directory is validated at most once per invocation.
+ */
+typedef struct {
+	int have_defaults;
+	default_config defaults;
+	int nsdks;
+	sdk_record sdks[CONTEXT_SLOTS];
+	int ntoolchains;
+	toolchain_record toolchains[CONTEXT_SLOTS];
+	int have_contents;
+	registry_contents contents;	/* every sdk and toolchain, see get_developer_dir_contents */
+	int matched_sdk;		/* an sdk was selected by part of its name, see match_sdk */
+} resolution_context;
+
+/* Output mode flags */
+int verbose_mode = 0;
+int finding_mode = 0;
+int nocache_mode = 0;
+
+/* Behavior mode flags */
+int explicit_sdk_mode = 0;
+int explicit_toolchain_mode = 0;
+
+/* Runtime info */
+char *developer_dir = NULL;
+unsigned long developer_generation = 0;	/* see xcode-select, 0 if unknown */
+char *current_sdk = NULL;
+char *current_toolchain = NULL;
+
+/* Everything we have resolved so far */
+static resolution_context context;
+
+/* Whether the registry is open: -1 until it has been tried (see open_registry) */
+static int registry_state = -1;
+
+/* Alternate behavior flags */
+char *alternate_sdk_path = NULL;
+char *alternate_toolchain_path = NULL;
+
+/* Compiler drivers that xcrun can stand in for */
+static const compiler_driver compiler_drivers[5] = {
+	{ "clang", "clang", 0 },
+	{ "clang++", "clang++", 0 },
+	{ "cc", "clang", 0 },
+	{ "c++", "clang++", 0 },
+	{ "cpp", "clang", 1 }
+};
+
+/* The compiler driver we were called as, if any */
+const compiler_driver *current_driver = NULL;
+
+
+/* Where resolve_fail returns to, and where errors go, while they are caught (see resolve_catch) */
+static jmp_buf *fail_jmp = NULL;
+static char *error_buf = NULL;
+static size_t error_size = 0;
+
+/* helper function to strip a bundle extension (".sdk" or ".toolchain") */
+char *stripext(const char *src, const char *ext)
+{
+	size_t len = strlen(src);
+	size_t ext_len = strlen(ext);
+
+	/* Only the bundle extension goes, a version like the "10.15" in "MacOSX10.15.sdk" stays. */
+	if (len > ext_len && strcmp(src + len - ext_len, ext) == 0)
+		len -= ext_len;
+
+	return arena_strndup(src, len);
+}
+
+/* helper function to test for the authenticity of an sdk */
+static int test_sdk_authenticity(const char *path)
+{
+	int retval = 0;
+	char fname[PATH_MAX];
+
+	snprintf(fname, sizeof(fname), "%s/info.ini", path);
+	if (fs_access(fname, F_OK) != (-1))
+		retval = 1;
+
+	return retval;
+}
+
+/**
+ * @func verbose_printf -- Print output to fp in verbose mode.
+ * @arg fp - pointer to file (file, stderr, or stdio)
+ * @arg str - string to print
+ * @arg ... - additional arguments used
+ */
+void verbose_printf(FILE *fp, const char *str, ...)
+{
+	va_list args;
+
+	if (verbose_mode == 1) {
+		va_start(args, str);
+		vfprintf(fp, str, args);
+		va_end(args);
+	}
+}
+
+/* helper function to print (or, for resolve_catch, keep) an error or warning */
+static void report(const char *kind, const char *fmt, va_list args)
+{
+	if (fail_jmp == NULL) {
+		fprintf(stderr, "xcrun: %s: ", kind);
+		vfprintf(stderr, fmt, args);
+		fputc('\n', stderr);
+	} else if (strcmp(kind, "error") == 0)
+		vsnprintf(error_buf, error_size, fmt, args);
+}
+
+/**
+ * @func resolve_error -- Report an error that the caller recovers from (or fails on later).
+ * @arg fmt - printf style message, without the "xcrun: error: " prefix and trailing newline
+ * @arg ... - additional arguments used
+ */
+void resolve_error(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	report("error", fmt, args);
+	va_end(args);
+}
+
+/**
+ * @func resolve_warn -- Report a warning (warnings are dropped while errors are caught).
+ * @arg fmt - printf style message, without the "xcrun: warning: " prefix and trailing newline
+ * @arg ... - additional arguments used
+ */
+void resolve_warn(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	report("warning", fmt, args);
+	va_end(args);
+}
+
+/**
+ * @func resolve_fail -- Report an error and give up: exit, or return to resolve_catch's caller.
+ * @arg fmt - printf style message as for resolve_error, NULL if the error has already been reported
+ * @arg ... - additional arguments used
+ */
+void resolve_fail(const char *fmt, ...)
+{
+	va_list args;
+
+	if (fmt != NULL) {
+		va_start(args, fmt);
+		report("error", fmt, args);
+		va_end(args);
+	}
+
+	if (fail_jmp == NULL)
+		exit(1);
+
+	longjmp(*fail_jmp, 1);
+}
+
+/**
+ * @func resolve_catch -- Catch errors instead of printing them, and failures instead of exiting.
+ * @arg jmp - where resolve_fail jumps to (set with setjmp), NULL to print and exit again
+ * @arg buf - buffer for the last error's message
+ * @arg size - size of buf
+ */
+void resolve_catch(jmp_buf *jmp, char *buf, size_t size)
+{
+	fail_jmp = jmp;
+	error_buf = buf;
+	error_size = size;
+
+	if (buf != NULL && size > 0)
+		*buf = '\0';
+}
+
+/* helper function to open a directory (see fs_dir_open), timing it */
+static int open_directory(const char *dir)
+{
+	int retval;
+	trace_span span = trace_begin();
+
+	retval = fs_dir_open(dir);
+	trace_end(span, "validate_directory_path", dir);
+
+	return retval;
+}
+
+/**
+ * @func validate_directory_path -- validate if requested directory path exists, and keep it open for looking up paths under it
+ * @arg dir - directory to validate
+ * @return: 0 on success, -1 on failure
+ */
+int validate_directory_path(const char *dir)
+{
+	if (open_directory(dir) == 0)
+		return 0;
+
+	if (errno == ENOTDIR)
+		resolve_error("\'%s\' is not a valid path", dir);
+	else
+		resolve_error("unable to validate path \'%s\' (errno=%s)", dir, strerror(errno));
+
+	return -1;
+}
+
+/* Toolchain info.ini contents */
+static const ini_binding toolchain_bindings[] = {
+	{ "TOOLCHAIN", "name", INI_BIND_STRING, offsetof(toolchain_config, name), INI_NO_KIND, 0 },
+	{ "TOOLCHAIN", "version", INI_BIND_STRING, offsetof(toolchain_config, version), INI_NO_KIND, 0 },
+};
+
+/* SDK info.ini contents */
+static const ini_binding sdk_bindings[] = {
+	{ "SDK", "name", INI_BIND_STRING, offsetof(sdk_config, name), INI_NO_KIND, 0 },
+	{ "SDK", "version", INI_BIND_STRING, offsetof(sdk_config, version), INI_NO_KIND, 0 },
+	{ "SDK", "toolchain", INI_BIND_STRING, offsetof(sdk_config, toolchain), INI_NO_KIND, 0 },
+	{ "SDK", "default_arch", INI_BIND_STRING, offsetof(sdk_config, default_arch), INI_NO_KIND, 0 },
+	{ "SDK", "archs", INI_BIND_STRING, offsetof(sdk_config, archs), INI_NO_KIND, 0 },
+	{ "SDK", "ios_deployment_target", INI_BIND_STRING, offsetof(sdk_config, deployment_target),
+	  offsetof(sdk_config, deployment_kind), DEPLOYMENT_TARGET_IOS },
+	{ "SDK", "macosx_deployment_target", INI_BIND_STRING, offsetof(sdk_config, deployment_target),
+	  offsetof(sdk_config, deployment_kind), DEPLOYMENT_TARGET_MACOSX },
+};
+
+/* xcrun.ini contents */
+static const ini_binding default_bindings[] = {
+	{ "SDK", "name", INI_BIND_STRING, offsetof(default_config, sdk), INI_NO_KIND, 0 },
+	{ "TOOLCHAIN", "name", INI_BIND_STRING, offsetof(default_config, toolchain), INI_NO_KIND, 0 },
+};
+
+ini_schema toolchain_schema = INI_SCHEMA(toolchain_bindings, arena_strndup);
+ini_schema sdk_schema = INI_SCHEMA(sdk_bindings, arena_strndup);
+ini_schema default_schema = INI_SCHEMA(default_bindings, arena_strndup);
+
+/**
+ * @func parse_ini -- parse an ini file, reading it with a single read
+ * @arg path - path to the ini file
+ * @arg schema - bindings of the file's sections and names to fields of config (see ini.h)
+ * @arg config - struct to fill in
+ * @return: see ini_parse_schema() in ini.h
+ */
+int parse_ini(const char *path, ini_schema *schema, void *config)
+{
+	int error;
+	char *buf = NULL;
+	size_t len;
+	trace_span span = trace_begin();
+
+	if ((buf = fs_read_file(path, &len)) == NULL)
+		error = -1;
+	else
+		error = parse_ini_buffer(path, buf, len, schema, config);
+
+	free(buf);
+	trace_end(span, "ini_parse", path);
+
+	return error;
+}
+
+/**
+ * @func parse_ini_buffer -- parse an ini file that has already been read
+ * @arg path - path the file was read from, for diagnostics
+ * @arg buf - the file's contents
+ * @arg len - length of buf
+ * @arg schema - bindings of the file's sections and names to fields of config (see ini.h)
+ * @arg config - struct to fill in
+ * @return: see ini_parse_schema() in ini.h
+ */
+int parse_ini_buffer(const char *path, const char *buf, size_t len, ini_schema *schema, void *config)
+{
+	int error = ini_parse_schema(buf, len, schema, config);
+
+	if (error > 0)
+		verbose_printf(stdout, "xcrun: info: ignoring unknown or malformed entry on line %d of \'%s\'.\n", error, path);
+
+	return error;
+}
+
+/**
+ * @func open_registry -- Map the compiled sdk and toolchain registry for the developer dir, once.
+ * @return: 1 if the registry can be used, 0 otherwise
+ */
+static int open_registry(void)
+{
+	trace_span span;
+
+	if (registry_state == -1) {
+		span = trace_begin();
+		registry_state = (nocache_mode == 0 && developer_dir != NULL && registry_open(developer_dir, developer_generation) == 0);
+		trace_end(span, "registry_open", (registry_state == 1) ? "hit" : "miss");
+	}
+
+	return registry_state;
+}
+
+/**
+ * @func find_sdk_record -- find (or add) the context record for an sdk
+ * @arg name - short name of the sdk (or NULL)
+ * @arg path - absolute path of the sdk (or NULL)
+ * @return: record for the sdk
+ */
+static sdk_record *find_sdk_record(const char *name, const char *path)
+{
+	int i;
+	sdk_record *record = NULL;
+
+	for (i = 0; i < context.nsdks; i++) {
+		record = &context.sdks[i];
+		if (name != NULL && record->name != NULL && strcmp(record->name, name) == 0)
+			return record;
+		if (path != NULL && record->path != NULL && strcmp(record->path, path) == 0)
+			return record;
+	}
+
+	/* Forget the most recent record if we run out of space. */
+	if (context.nsdks < CONTEXT_SLOTS)
+		context.nsdks++;
+
+	record = &context.sdks[context.nsdks - 1];
+	memset(record, 0, sizeof(*record));
+	record->name = (name != NULL) ? arena_strdup(name) : NULL;
+	record->path = (path != NULL) ? arena_strdup(path) : NULL;
+
+	return record;
+}
+
+/**
+ * @func find_toolchain_record -- find (or add) the context record for a toolchain
+ * @arg name - short name of the toolchain (or NULL)
+ * @arg path - absolute path of the toolchain (or NULL)
+ * @return: record for the toolchain
+ */
+static toolchain_record *find_toolchain_record(const char *name, const char *path)
+{
+	int i;
+	toolchain_record *record = NULL;
+
+	for (i = 0; i < context.ntoolchains; i++) {
+		record = &context.toolchains[i];
+		if (name != NULL && record->name != NULL && strcmp(record->name, name) == 0)
+			return record;
+		if (path != NULL && record->path != NULL && strcmp(record->path, path) == 0)
+			return record;
+	}
+
+	/* Forget the most recent record if we run out of space. */
+	if (context.ntoolchains < CONTEXT_SLOTS)
+		context.ntoolchains++;
+
+	record = &context.toolchains[context.ntoolchains - 1];
+	memset(record, 0, sizeof(*record));
+	record->name = (name != NULL) ? arena_strdup(name) : NULL;
+	record->path = (path != NULL) ? arena_strdup(path) : NULL;
+
+	return record;
+}
+
+/**
+ * @func get_toolchain_info -- fetch config info from a toolchain's info.ini
+ * @arg path - path to toolchain's info.ini
+ * @return: struct containing toolchain config info
+ */
+toolchain_config get_toolchain_info(const char *path)
+{
+	toolchain_record *record = NULL;
+	registry_toolchain registered;
+	char *info_path = NULL;
+
+	record = find_toolchain_record(NULL, path);
+	if (record->have_config == 1)
+		return record->config;
+
+	if (open_registry() == 1 && registry_find_toolchain(path, &registered) == 0) {
+		record->config.name = registered.name;
+		record->config.version = registered.version;
+		record->have_config = 1;
+		return record->config;
+	}
+
+	info_path = arena_printf("%s/info.ini", path);
+
+	if (parse_ini(info_path, &toolchain_schema, &record->config) != (-1)) {
+		record->have_config = 1;
+		return record->config;
+	} else {
+		resolve_fail("failed to retrieve toolchain info from '\%s\'. (errno=%s)", info_path, strerror(errno));
+	}
+}
+
+/**
+ * @func get_sdk_info -- fetch config info from a toolchain's info.ini
+ * @arg path - path to sdk's info.ini
+ * @return: struct containing sdk config info
+ */
+sdk_config get_sdk_info(const char *path)
+{
+	sdk_record *record = NULL;
+	registry_sdk registered;
+	char *info_path = NULL;
+
+	record = find_sdk_record(NULL, path);
+	if (record->have_config == 1)
+		return record->config;
+
+	if (open_registry() == 1 && registry_find_sdk(path, &registered) == 0) {
+		record->config.name = registered.name;
+		record->config.version = registered.version;
+		record->config.toolchain = registered.toolchain;
+		record->config.default_arch = registered.default_arch;
+		record->config.deployment_target = registered.deployment_target;
+		record->config.deployment_kind = registered.deployment_kind;
+		record->config.target_triple = registered.target_triple;
+		record->config.archs = registered.archs;
+		record->config.target_triples = registered.target_triples;
+		record->have_config = 1;
+		return record->config;
+	}
+
+	info_path = arena_printf("%s/info.ini", path);
+
+	if (parse_ini(info_path, &sdk_schema, &record->config) != (-1)) {
+		record->have_config = 1;
+		return record->config;
+	} else {
+		resolve_fail("failed to retrieve sdk info from '\%s\'. (errno=%s)", info_path, strerror(errno));
+	}
+}
+
+#ifdef XCRUN_BAKED_TIME
+/**
+ * @func is_newer_than_build -- Check whether a configuration file overrides the defaults built into xcrun.
+ * @arg path - configuration file
+ * @return: 1 if path exists and was modified after xcrun was built, 0 otherwise
+ */
+static int is_newer_than_build(const char *path)
+{
+	struct stat st;
+
+	if (fs_stat(path, &st) != 0)
+		return 0;
+
+	return (st.st_mtime > XCRUN_BAKED_TIME);
+}
+#endif
+
+/**
+ * @func get_default_info -- fetch default configuration for xcrun
+ * @arg path - path to xcrun.ini
+ * @return: struct containing default config info
+ */
+default_config get_default_info(const char *path)
+{
+	if (context.have_defaults == 1)
+		return context.defaults;
+
+#ifdef XCRUN_BAKED_SDK
+	if (is_newer_than_build(path) == 0) {
+		verbose_printf(stdout, "xcrun: info: using built-in default sdk '%s' and toolchain '%s'.\n", XCRUN_BAKED_SDK, XCRUN_BAKED_TOOLCHAIN);
+		context.defaults.sdk = XCRUN_BAKED_SDK;
+		context.defaults.toolchain = XCRUN_BAKED_TOOLCHAIN;
+		context.have_defaults = 1;
+		return context.defaults;
+	}
+#endif
+
+	if (open_registry() == 1 && registry_defaults(path, &context.defaults.sdk, &context.defaults.toolchain) == 0) {
+		context.have_defaults = 1;
+		return context.defaults;
+	}
+
+	if (parse_ini(path, &default_schema, &context.defaults) != (-1)) {
+		context.have_defaults = 1;
+		return context.defaults;
+	} else {
+		resolve_fail("failed to retrieve default info from '\%s\'. (errno=%s)", path, strerror(errno));
+	}
+}
+
+/**
+ * @func get_developer_path -- retrieve current developer path (and its generation, see xcode-select)
+ * @return: string of current path on success, NULL string on failure
+ */
+static char *get_developer_path(void)
+{
+	int fd;
+	ssize_t len;
+	char devpath[PATH_MAX + 32];
+	char *eol = NULL;
+	char *pathtocfg = NULL;
+	char *cfg_path = NULL;
+	char *value = NULL;
+
+	verbose_printf(stdout, "xcrun: info: attempting to retrieve developer path from DEVELOPER_DIR...\n");
+
+	if ((value = getenv("DEVELOPER_DIR")) != NULL) {
+		verbose_printf(stdout, "xcrun: info: using developer path \'%s\' from DEVELOPER_DIR.\n", value);
+		return value;
+	}
+
+	verbose_printf(stdout, "xcrun: info: attempting to retrieve developer path from configuration cache...\n");
+	if ((pathtocfg = getenv("HOME")) == NULL) {
+		resolve_error("failed to read HOME variable.");
+		return NULL;
+	}
+
+	cfg_path = arena_printf("%s/%s", pathtocfg, SDK_CFG);
+
+#ifdef XCRUN_BAKED_DEVELOPER_DIR
+	if (is_newer_than_build(cfg_path) == 0) {
+		verbose_printf(stdout, "xcrun: info: using built-in developer path '%s'.\n", XCRUN_BAKED_DEVELOPER_DIR);
+		return XCRUN_BAKED_DEVELOPER_DIR;
+	}
+#endif
+
+	if ((fd = fs_open(cfg_path, O_RDONLY)) != -1) {
+		len = fs_read(fd, devpath, (sizeof(devpath) - 1));
+		devpath[(len > 0) ? len : 0] = '\0';
+		fs_close(fd);
+		/* The path, optionally followed by a line holding the generation. */
+		if ((eol = strchr(devpath, '\n')) != NULL) {
+			*eol++ = '\0';
+			developer_generation = strtoul(eol, NULL, 10);
+		}
+		value = arena_strdup(devpath);
+	} else {
+		resolve_error("unable to read configuration cache. (errno=%s)", strerror(errno));
+		return NULL;
+	}
+
+	verbose_printf(stdout, "xcrun: info: using developer path \'%s\' (generation %lu) from configuration cache.\n", value, developer_generation);
+
+	return value;
+}
+
+/* helper function to switch to a developer dir's cache store and keep the dir open */
+static void open_developer_dir(const char *dir)
+{
+	/* Users sharing XCRUN_CACHE_DIR share the caches of every developer dir they use. */
+	if (store_set_shared(getenv(XCRUN_CACHE_DIR_ENV), dir) != 0)
+		resolve_warn("%s is too long, caching in $HOME instead.", XCRUN_CACHE_DIR_ENV);
+
+	/* Everything else lives under it, so only walk its path once. A missing one is reported where it's used. */
+	(void)fs_dir_open(dir);
+}
+
+/**
+ * @func find_developer_dir -- Find the developer dir, and the cache store that goes with it.
+ * @return: the developer dir on success, NULL on failure
+ */
+char *find_developer_dir(void)
+{
+	char *dir = NULL;
+
+	if ((dir = get_developer_path()) == NULL)
+		return NULL;
+
+	open_developer_dir(dir);
+
+	return dir;
+}
+
+/**
+ * @func resolve_select_developer_dir -- Use a developer dir instead of finding one, as DEVELOPER_DIR does.
+ * @arg dir - the developer dir
+ */
+void resolve_select_developer_dir(const char *dir)
+{
+	developer_dir = arena_strdup(dir);
+	developer_generation = 0;
+
+	open_developer_dir(dir);
+}
+
+/**
+ * @func list_bundles -- List the sdk or toolchain bundles in a directory.
+ * @arg dir - directory to list
+ * @arg ext - bundle extension, including the dot
+ * @arg paths - array to place the bundles' absolute paths in
+ * @arg max - size of paths
+ * @return: number of bundles found
+ */
+int list_bundles(const char *dir, const char *ext, char *paths[], int max)
+{
+	int count = 0;
+	size_t len;
+	size_t ext_len = strlen(ext);
+	DIR *dp = NULL;
+	struct dirent *ent = NULL;
+
+	if ((dp = fs_opendir(dir)) == NULL)
+		return 0;
+
+	while (count < max && (ent = readdir(dp)) != NULL) {
+		len = strlen(ent->d_name);
+		if (len > ext_len && strcmp(ent->d_name + len - ext_len, ext) == 0)
+			paths[count++] = arena_printf("%s/%s", dir, ent->d_name);
+	}
+
+	fs_closedir(dp);
+
+	return count;
+}
+
+/* helper function to order sdks by path */
+static int compare_sdks(const void *a, const void *b)
+{
+	return strcmp(((const registry_sdk *)a)->path, ((const registry_sdk *)b)->path);
+}
+
+/* helper function to order toolchains by path */
+static int compare_toolchains(const void *a, const void *b)
+{
+	return strcmp(((const registry_toolchain *)a)->path, ((const registry_toolchain *)b)->path);
+}
+
+/* helper function for scan_developer_dir to read one info.ini (on any thread) */
+static void read_info_job(void *arg, int i)
+{
+	int fd;
+	info_job *job = &((info_job *)arg)[i];
+
+	if ((fd = fs_open(job->path, O_RDONLY)) == -1)
+		return;
+
+	/* The registry records what was read, instead of looking at every file again. */
+	job->stamped = (fs_fstat(fd, &job->st) == 0);
+	job->buf = fs_read_fd(fd, &job->len);
+}
+
+/* helper function to parse an info.ini read by read_info_job, and free what was read */
+static int parse_info_job(info_job *job, ini_schema *schema, void *config)
+{
+	int error = -1;
+	trace_span span = trace_begin();
+
+	if (job->buf != NULL)
+		error = parse_ini_buffer(job->path, job->buf, job->len, schema, config);
+
+	free(job->buf);
+	trace_end(span, "ini_parse", job->path);
+
+	return error;
+}
+
+/**
+ * @func scan_developer_dir -- Read xcrun.ini and every sdk's and toolchain's info.ini in the developer dir.
+ * @arg contents - filled with what was read, sdks and toolchains sorted by path
+ */
+void scan_developer_dir(registry_contents *contents)
+{
+	int i;
+	int nsdk_bundles;
+	int ntoolchain_bundles;
+	char *sdk_bundles[REGISTRY_MAX_ENTRIES];
+	char *toolchain_bundles[REGISTRY_MAX_ENTRIES];
+	info_job *jobs = NULL;
+	registry_sdk *sdks = NULL;
+	registry_toolchain *toolchains = NULL;
+	default_config defaults;
+	sdk_config sdk;
+	toolchain_config toolchain;
+
+	if (developer_dir == NULL)
+		resolve_fail("failed to retrieve developer path, do you have it set?");
+
+	memset(contents, 0, sizeof(*contents));
+	contents->developer_dir = developer_dir;
+	contents->generation = developer_generation;
+	contents->defaults_path = XCRUN_DEFAULT_CFG;
+
+	memset(&defaults, 0, sizeof(defaults));
+	if (parse_ini(XCRUN_DEFAULT_CFG, &default_schema, &defaults) != (-1)) {
+		contents->default_sdk = defaults.sdk;
+		contents->default_toolchain = defaults.toolchain;
+	}
+
+	nsdk_bundles = list_bundles(arena_printf("%s/SDKs", developer_dir), ".sdk", sdk_bundles, REGISTRY_MAX_ENTRIES);
+	ntoolchain_bundles = list_bundles(arena_printf("%s/Toolchains", developer_dir), ".toolchain", toolchain_bundles, REGISTRY_MAX_ENTRIES);
+
+	/* Reading is all round trips to the filesystem, so every info.ini is read at once; parsing uses the arena, so it isn't. */
+	jobs = (info_job *)arena_alloc((nsdk_bundles + ntoolchain_bundles) * sizeof(info_job));
+	memset(jobs, 0, (nsdk_bundles + ntoolchain_bundles) * sizeof(info_job));
+	for (i = 0; i < nsdk_bundles; i++)
+		jobs[i].path = arena_printf("%s/info.ini", sdk_bundles[i]);
+	for (i = 0; i < ntoolchain_bundles; i++)
+		jobs[nsdk_bundles + i].path = arena_printf("%s/info.ini", toolchain_bundles[i]);
+	fs_parallel(nsdk_bundles + ntoolchain_bundles, read_info_job, jobs);
+
+	sdks = (registry_sdk *)arena_alloc(REGISTRY_MAX_ENTRIES * sizeof(registry_sdk));
+	for (i = 0; i < nsdk_bundles; i++) {
+		memset(&sdk, 0, sizeof(sdk));
+		if (parse_info_job(&jobs[i], &sdk_schema, &sdk) == (-1)) {
+			verbose_printf(stdout, "xcrun: info: skipping sdk \'%s\', it has no readable info.ini.\n", sdk_bundles[i]);
+			continue;
+		}
+		sdks[contents->nsdks].path = sdk_bundles[i];
+		sdks[contents->nsdks].name = sdk.name;
+		sdks[contents->nsdks].version = sdk.version;
+		sdks[contents->nsdks].toolchain = sdk.toolchain;
+		sdks[contents->nsdks].default_arch = sdk.default_arch;
+		sdks[contents->nsdks].deployment_target = sdk.deployment_target;
+		sdks[contents->nsdks].deployment_kind = sdk.deployment_kind;
+		sdks[contents->nsdks].target_triple = (sdk.default_arch != NULL) ? parse_target_triple(sdk.deployment_target, sdk.default_arch) : NULL;
+		sdks[contents->nsdks].archs = sdk.archs;
+		sdks[contents->nsdks].target_triples = parse_target_triples(sdk.deployment_target, sdk.archs);
+		sdks[contents->nsdks].stamped = jobs[i].stamped;
+		sdks[contents->nsdks].info_sec = (long long)jobs[i].st.st_mtime;
+		sdks[contents->nsdks].info_nsec = (long)ST_MTIME_NSEC(jobs[i].st);
+		contents->nsdks++;
+	}
+	qsort(sdks, contents->nsdks, sizeof(registry_sdk), compare_sdks);
+	contents->sdks = sdks;
+
+	toolchains = (registry_toolchain *)arena_alloc(REGISTRY_MAX_ENTRIES * sizeof(registry_toolchain));
+	for (i = 0; i < ntoolchain_bundles; i++) {
+		memset(&toolchain, 0, sizeof(toolchain));
+		if (parse_info_job(&jobs[nsdk_bundles + i], &toolchain_schema, &toolchain) == (-1)) {
+			verbose_printf(stdout, "xcrun: info: skipping toolchain \'%s\', it has no readable info.ini.\n", toolchain_bundles[i]);
+			continue;
+		}
+		toolchains[contents->ntoolchains].path = toolchain_bundles[i];
+		toolchains[contents->ntoolchains].name = toolchain.name;
+		toolchains[contents->ntoolchains].version = toolchain.version;
+		toolchains[contents->ntoolchains].stamped = jobs[nsdk_bundles + i].stamped;
+		toolchains[contents->ntoolchains].info_sec = (long long)jobs[nsdk_bundles + i].st.st_mtime;
+		toolchains[contents->ntoolchains].info_nsec = (long)ST_MTIME_NSEC(jobs[nsdk_bundles + i].st);
+		contents->ntoolchains++;
+	}
+	qsort(toolchains, contents->ntoolchains, sizeof(registry_toolchain), compare_toolchains);
+	contents->toolchains = toolchains;
+}
+
+/**
+ * @func get_developer_dir_contents -- List every sdk and toolchain in the developer dir, from the registry while it is current.
+ * @return: the developer dir's contents
+ */
+const registry_contents *get_developer_dir_contents(void)
+{
+	trace_span span;
+	registry_sdk *sdks = NULL;
+	registry_toolchain *toolchains = NULL;
+
+	if (context.have_contents == 1)
+		return &context.contents;
+
+	span = trace_begin();
+	sdks = (registry_sdk *)arena_alloc(REGISTRY_MAX_ENTRIES * sizeof(registry_sdk));
+	toolchains = (registry_toolchain *)arena_alloc(REGISTRY_MAX_ENTRIES * sizeof(registry_toolchain));
+
+	if (open_registry() == 1 && registry_list(&context.contents, sdks, toolchains) == 0) {
+		trace_end(span, "registry_list", "hit");
+	} else {
+		scan_developer_dir(&context.contents);
+		/* Compile what was just read, so that the next listing doesn't have to read it again. */
+		if (nocache_mode == 0 && registry_write(&context.contents) != 0)
+			verbose_printf(stdout, "xcrun: info: failed to update sdk and toolchain registry.\n");
+		trace_end(span, "registry_list", "miss");
+	}
+
+	context.have_contents = 1;
+
+	return &context.contents;
+}
+
+/* helper function to compare two versions, a number at a time */
+static int compare_versions(const char *a, const char *b)
+{
+	long x, y;
+	char *end_a = NULL;
+	char *end_b = NULL;
+
+	if (a == NULL || b == NULL)
+		return (a != NULL) - (b != NULL);
+
+	while (*a != '\0' || *b != '\0') {
+		x = strtol(a, &end_a, 10);
+		y = strtol(b, &end_b, 10);
+		if (x != y)
+			return (x < y) ? -1 : 1;
+		if (end_a == a && end_b == b)
+			return strcmp(a, b);
+		a = (*end_a == '.') ? end_a + 1 : end_a;
+		b = (*end_b == '.') ? end_b + 1 : end_b;
+	}
+
+	return 0;
+}
+
+/* helper function to check if a name given for an sdk stands for key, a bundle name or an sdk's name and version */
+static int sdk_name_matches(const char *name, const char *key)
+{
+	size_t len = strlen(name);
+
+	if (key == NULL || len == 0 || strncasecmp(key, name, len) != 0)
+		return 0;
+
+	if (key[len] == '\0')
+		return 1;
+
+	/* Only whole version numbers: "Foo1" stands for "Foo1.2" but not "Foo12", "Foo" for "Foo1.2" but not "FooBar". */
+	if (isdigit((unsigned char)name[len - 1]))
+		return (key[len] == '.');
+
+	return (isdigit((unsigned char)key[len]) || key[len] == '.');
+}
+
+/**
+ * @func match_sdk -- Find the newest sdk that a partial, versioned or differently cased name stands for.
+ * @arg name - name given for the sdk (e.g. "DarwinARM0.0" for "DarwinARM" version 0.0.1)
+ * @return: the sdk's absolute path, or NULL if no sdk matches
+ */
+static char *match_sdk(const char *name)
+{
+	int i;
+	const char *base = NULL;
+	const char *key = NULL;
+	const registry_sdk *sdk = NULL;
+	const registry_sdk *best = NULL;
+	const registry_contents *contents = get_developer_dir_contents();
+
+	for (i = 0; i < contents->nsdks; i++) {
+		sdk = &contents->sdks[i];
+		base = ((base = strrchr(sdk->path, '/')) != NULL) ? base + 1 : sdk->path;
+		key = (sdk->name != NULL && sdk->version != NULL) ? arena_printf("%s%s", sdk->name, sdk->version) : NULL;
+		if (sdk_name_matches(name, stripext(base, ".sdk")) == 0 && sdk_name_matches(name, key) == 0)
+			continue;
+		if (best == NULL || compare_versions(sdk->version, best->version) > 0)
+			best = sdk;
+	}
+
+	if (best == NULL)
+		return NULL;
+
+	verbose_printf(stdout, "xcrun: info: using sdk \'%s\' for \'%s\'.\n", best->path, name);
+	context.matched_sdk = 1;
+
+	return arena_strdup(best->path);
+}
+
+/**
+ * @func get_toolchain_path -- Return the specified toolchain path
+ * @arg name - name of the toolchain
+ * @return: absolute path of toolchain on success, exit on failure
+ */
+char *get_toolchain_path(const char *name)
+{
+	char *path = NULL;
+	char *devpath = NULL;
+	toolchain_record *record = NULL;
+
+	record = find_toolchain_record(name, NULL);
+	if (record->path != NULL)
+		return record->path;
+
+	devpath = developer_dir;
+
+	if (devpath != NULL) {
+		path = arena_printf("%s/Toolchains/%s.toolchain", devpath, name);
+		if (validate_directory_path(path) != (-1)) {
+			record->path = path;
+			return path;
+		} else {
+			resolve_fail("\'%s\' is not a valid toolchain path.", path);
+		}
+	} else {
+		resolve_fail("failed to retrieve developer path, do you have it set?");
+	}
+}
+
+/**
+ * @func get_sdk_path -- Return the specified sdk path
+ * @arg name - name of the sdk
+ * @return: absolute path of sdk on success, exit on failure
+ */
+char *get_sdk_path(const char *name)
+{
+	char *path = NULL;
+	char *match = NULL;
+	char *devpath = NULL;
+	sdk_record *record = NULL;
+
+	record = find_sdk_record(name, NULL);
+	if (record->path != NULL)
+		return record->path;
+
+	devpath = developer_dir;
+
+	if (devpath != NULL) {
+		path = arena_printf("%s/SDKs/%s.sdk", devpath, name);
+		if (open_directory(path) == 0) {
+			record->path = path;
+			return path;
+		}
+		/* Not an sdk's exact name? It may still stand for one (see match_sdk). */
+		if ((match = match_sdk(name)) != NULL && validate_directory_path(match) != (-1)) {
+			record->path = match;
+			return match;
+		}
+		/* Otherwise report why the exact name didn't do. */
+		if (match == NULL)
+			(void)validate_directory_path(path);
+		resolve_fail("\'%s\' is not a valid sdk path.", (match != NULL) ? match : path);
+	} else {
+		resolve_fail("failed to retrieve developer path, do you have it set?");
+	}
+}
+
+/**
+ * @func darwin_version -- Find the darwin kernel version that an iOS/MacOSX version shipped with
+ * @arg ver - Mac OSX or iOS version
+ * @return: the darwin major version, or -1 if there is no version
+ */
+static int darwin_version(const char *ver)
+{
+	int where = 1;
+	int xx, yy, zz, ch, kern_ver;
+
+	if (ver == NULL)
+		return -1;
+
+	xx = yy = zz = 0;
+
+	do {
+		ch = (int)*ver;
+
+		switch (ch) {
+			case '9':
+			case '8':
+			case '7':
+			case '6':
+			case '5':
+			case '4':
+			case '3':
+			case '2':
+			case '1':
+			case '0':
+				{
+					switch (where) {
+						case 1: /* major */
+							xx *= 10;
+							xx += (ch - '0');
+							break;
+						case 2: /* minor */
+							yy *= 10;
+							yy += (ch - '0');
+							break;
+						case 3: /* patch */
+							zz *= 10;
+							zz += (ch - '0');
+						default:
+							break;
+					}
+					break;
+				}
+			case '.':
+			default:
+				where++;
+				break;
+		}
+	} while (*ver++ != '\0');
+
+	switch (xx) {
+		case 10:
+			kern_ver = (yy + 4);
+			break;
+		case 9:
+		case 8:
+			kern_ver = 14;
+			break;
+		case 7:
+			kern_ver = 14;
+			break;
+		case 6:
+			kern_ver = 13;
+			break;
+		case 5:
+			kern_ver = 11;
+			break;
+		case 4:
+			{
+				if (yy <= 2)
+					kern_ver = 10;
+				else
+					kern_ver = 11;
+				break;
+			}
+		case 3:
+			kern_ver = 10;
+			break;
+		case 2:
+			kern_ver = 9;
+			break;
+		case 1:
+		default:
+			kern_ver = 9;
+			break;
+	}
+
+	return kern_ver;
+}
+
+/**
+ * @func parse_target_triple -- Generate target triple by parsing iOS/MacOSX version and cpu architecture
+ * @arg ver - Mac OSX or iOS version
+ * @arg arch - Mac OSX or iOS cpu architecture
+ * @return: the target triple, or NULL if there is no version
+ */
+char *parse_target_triple(const char *ver, const char *arch)
+{
+	int kern_ver;
+
+	if ((kern_ver = darwin_version(ver)) == -1)
+		return NULL;
+
+	return arena_printf("%s-apple-darwin%d", arch, kern_ver);
+}
+
+/**
+ * @func split_archs -- Split a list of architectures, dropping duplicates.
+ * @arg list - architectures, separated by spaces or commas
+ * @arg archs - filled with at most ARCH_MAX architectures
+ * @arg narchs - number of architectures already in archs, the new ones are appended
+ * @return: the number of architectures in archs
+ */
+static int split_archs(const char *list, char *archs[], int narchs)
+{
+	int i;
+	size_t len;
+
+	while (list != NULL && *list != '\0') {
+		if ((len = strcspn(list, " ,\t")) != 0) {
+			for (i = 0; i < narchs; i++) {
+				if (strlen(archs[i]) == len && strncmp(archs[i], list, len) == 0)
+					break;
+			}
+			if (i == narchs) {
+				if (narchs == ARCH_MAX) {
+					resolve_fail("too many architectures (at most %d are supported).", ARCH_MAX);
+				}
+				archs[narchs++] = arena_strndup(list, len);
+			}
+			list += len;
+		} else
+			list++;
+	}
+
+	return narchs;
+}
+
+/**
+ * @func parse_target_triples -- Generate the target triple of every architecture in a list.
+ * @arg ver - Mac OSX or iOS version
+ * @arg list - architectures, separated by spaces or commas
+ * @return: the target triples separated by spaces, or NULL if there is no version or no architecture
+ */
+char *parse_target_triples(const char *ver, const char *list)
+{
+	int i;
+	int narchs;
+	int kern_ver;
+	char *archs[ARCH_MAX];
+	char *triples = NULL;
+
+	/* Every arch shares the same kernel version, so only work it out once. */
+	if ((kern_ver = darwin_version(ver)) == -1 || (narchs = split_archs(list, archs, 0)) == 0)
+		return NULL;
+
+	for (i = 0; i < narchs; i++) {
+		if (triples == NULL)
+			triples = arena_printf("%s-apple-darwin%d", archs[i], kern_ver);
+		else
+			triples = arena_printf("%s %s-apple-darwin%d", triples, archs[i], kern_ver);
+	}
+
+	return triples;
+}
+
+/**
+ * @func select_sdk_and_toolchain -- Fall back to the environment or defaults for an unspecified sdk and/or toolchain.
+ */
+void select_sdk_and_toolchain(void)
+{
+	char *sdk_env = NULL;
+	char *toolchain_env = NULL;
+
+	trace_span span;
+
+	/* Nothing can be resolved without a developer dir. */
+	if (developer_dir == NULL) {
+		span = trace_begin();
+		developer_dir = find_developer_dir();
+		trace_end(span, "get_developer_path", developer_dir);
+	}
+
+	if (current_sdk == NULL) {
+		if ((sdk_env = getenv("SDKROOT")) != NULL)
+			current_sdk = stripext(basename(sdk_env), ".sdk");
+		else
+			current_sdk = arena_strdup(get_default_info(XCRUN_DEFAULT_CFG).sdk);
+	}
+
+	if (current_toolchain == NULL) {
+		if ((toolchain_env = getenv("TOOLCHAINS")) != NULL)
+			current_toolchain = stripext(basename(toolchain_env), ".toolchain");
+		else
+			current_toolchain = arena_strdup(get_default_info(XCRUN_DEFAULT_CFG).toolchain);
+	}
+}
+
+/**
+ * @func resolve_select_sdk -- Select an sdk by name or absolute path, as --sdk does.
+ * @arg sdk - short name (an extension is ignored) or absolute path of the sdk
+ */
+void resolve_select_sdk(const char *sdk)
+{
+	/* we support absolute paths and short names */
+	if (*sdk == '/') {
+		if (validate_directory_path(sdk) == (-1))
+			resolve_fail(NULL);
+		alternate_sdk_path = arena_strdup(sdk);
+	} else {
+		current_sdk = stripext(sdk, ".sdk");
+		explicit_sdk_mode = 1;
+	}
+}
+
+/**
+ * @func resolve_select_toolchain -- Select a toolchain by name or absolute path, as --toolchain does.
+ * @arg toolchain - short name (an extension is ignored) or absolute path of the toolchain
+ */
+void resolve_select_toolchain(const char *toolchain)
+{
+	/* we support absolute paths and short names */
+	if (*toolchain == '/') {
+		if (validate_directory_path(toolchain) == (-1))
+			resolve_fail(NULL);
+		alternate_toolchain_path = arena_strdup(toolchain);
+	} else {
+		current_toolchain = stripext(toolchain, ".toolchain");
+		explicit_toolchain_mode = 1;
+	}
+}
+
+/**
+ * @func resolve_reset -- Forget the selection and everything resolved for it, and free the arena.
+ */
+void resolve_reset(void)
+{
+	explicit_sdk_mode = 0;
+	explicit_toolchain_mode = 0;
+	developer_dir = NULL;
+	developer_generation = 0;
+	current_sdk = NULL;
+	current_toolchain = NULL;
+	alternate_sdk_path = NULL;
+	alternate_toolchain_path = NULL;
+	current_driver = NULL;
+
+	memset(&context, 0, sizeof(context));
+
+	/* The next lookup may be for another developer dir, or find this one rebuilt. */
+	registry_state = -1;
+	registry_close();
+	fs_dir_close_all();
+	cache_dir_forget();
+
+	arena_release();
+}
+
+/**
+ * @func get_target_triple -- get the target triple for the current sdk.
+ * @arg current_sdk - specified sdk (ignored if TARGET_TRIPLE env variable is set)
+ * @return: target triple string or NULL on error
+ */
+char *get_target_triple(const char *current_sdk)
+{
+	char *triple = NULL;
+	sdk_config config;
+
+	if ((triple = getenv("TARGET_TRIPLE")) != NULL)
+		return triple;
+	else {
+		config = get_sdk_info(get_sdk_path(current_sdk));
+
+		if (config.target_triple != NULL)
+			return (char *)config.target_triple;
+
+		if (config.default_arch == NULL || config.deployment_target == NULL)
+			return NULL;
+
+		return parse_target_triple(config.deployment_target, config.default_arch);
+	}
+}
+
+/**
+ * @func arch_target_triples -- Resolve the target triple of each of a list of architectures.
+ * @arg list - architectures separated by spaces or commas, "all" stands for every architecture the sdk lists
+ * @arg sdk_path - path of the sdk the architectures are for
+ * @arg triple - the sdk's target triple (or TARGET_TRIPLE), the others are derived from it
+ * @arg deployment_target - the sdk's deployment target, used if there is no triple
+ * @arg archs - filled with at most ARCH_MAX architectures
+ * @arg triples - filled with the target triple of each architecture, NULL if it can't be resolved
+ * @return: the number of architectures
+ */
+int arch_target_triples(const char *list, const char *sdk_path, const char *triple, const char *deployment_target, char *archs[], char *triples[])
+{
+	int i;
+	int narchs = 0;
+	size_t len;
+	const char *all = NULL;
+	const char *suffix = NULL;
+	sdk_config config;
+
+	while (*list != '\0') {
+		len = strcspn(list, " ,\t");
+		if (len == 3 && strncmp(list, "all", 3) == 0) {
+			config = get_sdk_info(sdk_path);
+			if ((all = (config.archs != NULL) ? config.archs : config.default_arch) == NULL) {
+				resolve_fail("\'%s\' lists no architectures.", sdk_path);
+			}
+			/* The registry has these worked out already, unless TARGET_TRIPLE overrides them. */
+			if (narchs == 0 && config.target_triples != NULL && getenv("TARGET_TRIPLE") == NULL) {
+				narchs = split_archs(all, archs, 0);
+				if (split_archs(config.target_triples, triples, 0) != narchs)
+					narchs = 0;
+			}
+			i = narchs;
+			narchs = split_archs(all, archs, narchs);
+		} else {
+			i = narchs;
+			narchs = split_archs(arena_strndup(list, len), archs, narchs);
+		}
+
+		/* The vendor and os don't depend on the arch, so derive from the sdk's own triple. */
+		for (; i < narchs; i++) {
+			if (triple != NULL && (suffix = strchr(triple, '-')) != NULL)
+				triples[i] = arena_printf("%s%s", archs[i], suffix);
+			else
+				triples[i] = parse_target_triple(deployment_target, archs[i]);
+		}
+
+		list += len;
+		if (*list != '\0')
+			list++;
+	}
+
+	return narchs;
+}
+
+/**
+ * @func canonical_path -- Join the developer dir and toolchain's tools with the host's PATH, without duplicates.
+ * @arg toolchain_path - resolved toolchain
+ * @arg host - host's PATH
+ * @return: the joined PATH
+ */
+static char *canonical_path(const char *toolchain_path, const char *host)
+{
+	int i;
+	int ndirs = 0;
+	size_t len;
+	size_t out_len = 0;
+	const char *dir = NULL;
+	const char *end = NULL;
+	char *joined = arena_printf("%s/usr/bin:%s/usr/bin:%s", developer_dir, toolchain_path, host);
+	char *out = (char *)arena_alloc(strlen(joined) + 1);
+	path_span seen[PATH_DIRS_MAX];
+
+	/* Nested xcrun calls would otherwise prepend the same directories again and again. */
+	for (dir = joined; *dir != '\0'; dir = (*end == ':') ? end + 1 : end) {
+		if ((end = strchr(dir, ':')) == NULL)
+			end = dir + strlen(dir);
+		/* Empty entries (the current directory) don't belong in a reproducible environment. */
+		if ((len = end - dir) == 0)
+			continue;
+
+		for (i = 0; i < ndirs; i++) {
+			if (seen[i].len == len && memcmp(out + seen[i].offset, dir, len) == 0)
+				break;
+		}
+		if (i < ndirs)
+			continue;
+
+		if (out_len > 0)
+			out[out_len++] = ':';
+		/* Past PATH_DIRS_MAX, directories are only kept, not checked for duplicates. */
+		if (ndirs < PATH_DIRS_MAX) {
+			seen[ndirs].offset = out_len;
+			seen[ndirs++].len = len;
+		}
+		memcpy(out + out_len, dir, len);
+		out_len += len;
+	}
+
+	out[out_len] = '\0';
+
+	return out;
+}
+
+/**
+ * @func parse_pass_list -- Split the XCRUN_PASS_ENV list into patterns.
+ * @arg list - space, comma or colon separated names, each optionally ending in '*'
+ * @arg patterns - array of PASS_PATTERNS_MAX patterns to fill
+ * @return: number of patterns filled in
+ */
+static int parse_pass_list(const char *list, pass_pattern patterns[])
+{
+	size_t plen;
+	int npatterns = 0;
+	const char *pattern = NULL;
+
+	for (pattern = list; *pattern != '\0'; pattern += plen) {
+		pattern += strspn(pattern, " ,:");
+		if ((plen = strcspn(pattern, " ,:")) == 0)
+			break;
+
+		if (npatterns == PASS_PATTERNS_MAX) {
+			resolve_warn("only the first %d names in XCRUN_PASS_ENV are used.", PASS_PATTERNS_MAX);
+			break;
+		}
+
+		patterns[npatterns].name = pattern;
+		patterns[npatterns].prefix = (pattern[plen - 1] == '*');
+		patterns[npatterns].len = plen - patterns[npatterns].prefix;
+		npatterns++;
+	}
+
+	return npatterns;
+}
+
+/**
+ * @func pass_env_matches -- Check whether a variable is in the XCRUN_PASS_ENV list.
+ * @arg patterns - patterns from parse_pass_list
+ * @arg npatterns - number of patterns
+ * @arg name - variable's name
+ * @arg len - length of name
+ * @return: 1 if it is, 0 otherwise
+ */
+static int pass_env_matches(const pass_pattern patterns[], int npatterns, const char *name, size_t len)
+{
+	int i;
+
+	for (i = 0; i < npatterns; i++) {
+		/* Most variables already differ in their first character. */
+		if (patterns[i].len > 0 && patterns[i].name[0] != name[0])
+			continue;
+
+		if ((patterns[i].prefix == 1) ? (len >= patterns[i].len) : (len == patterns[i].len)) {
+			if (strncmp(name, patterns[i].name, patterns[i].len) == 0)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @func compare_env_vars -- qsort comparator ordering environment variables by name.
+ */
+static int compare_env_vars(const void *a, const void *b)
+{
+	return strcmp(((const env_var *)a)->name, ((const env_var *)b)->name);
+}
+
+/**
+ * @func build_environment -- Build the environment that is passed on to a called program.
+ * @arg env_info - resolved sdk and toolchain information
+ * @arg vars - array of ENV_VARS variables to fill
+ * @arg pass_through - also pass on the variables listed in XCRUN_PASS_ENV
+ * @return: number of variables filled in, sorted by name
+ */
+int build_environment(const cache_entry *env_info, env_var vars[], int pass_through)
+{
+	int i;
+	int nbuilt;
+	int npatterns;
+	char **var = NULL;
+	const char *eq = NULL;
+	const char *pass_list = NULL;
+	pass_pattern patterns[PASS_PATTERNS_MAX];
+	int nvars = 0;
+	const char *path = NULL;
+	const char *home = NULL;
+	const char *target_triple = NULL;
+	const char *deployment_target = NULL;
+
+	/*
+	 * Pass SDKROOT, PATH, HOME, LD_LIBRARY_PATH, TARGET_TRIPLE, and MACOSX_DEPLOYMENT_TARGET to the called program's environment.
+	 *
+	 * > SDKROOT is used for when programs such as clang need to know the location of the sdk.
+	 * > PATH is used for when programs such as clang need to call on another program (such as the linker).
+	 * > HOME is used for recursive calls to xcrun (such as when xcrun calls a script calling xcrun ect).
+	 * > LD_LIBRARY_PATH is used for when tools needs to access libraries that are specific to the toolchain.
+	 * > TARGET_TRIPLE is used for clang/clang++ cross compilation when building on a foreign host.
+	 * > {MACOSX|IOS}_DEPLOYMENT_TARGET is used for tools like ld that need to set the minimum compatibility
+	 *   version number for a linked binary.
+	 */
+	if ((path = getenv("PATH")) == NULL)
+		path = "";
+	if ((home = getenv("HOME")) == NULL)
+		home = "";
+
+	vars[nvars].name = "SDKROOT";
+	vars[nvars++].value = env_info->sdk_path;
+
+	vars[nvars].name = "PATH";
+	vars[nvars++].value = canonical_path(env_info->toolchain_path, path);
+
+	vars[nvars].name = "LD_LIBRARY_PATH";
+	vars[nvars++].value = arena_printf("%s/usr/lib", env_info->toolchain_path);
+
+	vars[nvars].name = "HOME";
+	vars[nvars++].value = home;
+
+	if ((target_triple = getenv("TARGET_TRIPLE")) == NULL)
+		target_triple = env_info->target_triple;
+
+	if (target_triple != NULL) {
+		vars[nvars].name = "TARGET_TRIPLE";
+		vars[nvars++].value = target_triple;
+	} else
+		resolve_warn("failed to retrieve target triple information for %s.sdk.", current_sdk);
+
+	if ((deployment_target = getenv("IOS_DEPLOYMENT_TARGET")) != NULL)
+		vars[nvars].name = "IOS_DEPLOYMENT_TARGET";
+	else if ((deployment_target = getenv("MACOSX_DEPLOYMENT_TARGET")) != NULL)
+		vars[nvars].name = "MACOSX_DEPLOYMENT_TARGET";
+	else {
+		/* Use the deployment target info that is provided by the SDK. */
+		if ((deployment_target = env_info->deployment_target) != NULL) {
+			if (env_info->deployment_kind == DEPLOYMENT_TARGET_MACOSX)
+				vars[nvars].name = "MACOSX_DEPLOYMENT_TARGET";
+			else if (env_info->deployment_kind == DEPLOYMENT_TARGET_IOS)
+				vars[nvars].name = "IOS_DEPLOYMENT_TARGET";
+			else
+				deployment_target = NULL;
+		} else {
+			resolve_fail("failed to retrieve deployment target information for %s.sdk.", current_sdk);
+		}
+	}
+
+	if (deployment_target != NULL)
+		vars[nvars++].value = deployment_target;
+
+	nbuilt = nvars;
+
+	/*
+	 * Everything else is dropped, except for what compiler caches and distributed builds rely on
+	 * (CCACHE_*, DISTCC_HOSTS, SOURCE_DATE_EPOCH, ...). The variables we set ourselves always win.
+	 */
+	if ((pass_list = getenv("XCRUN_PASS_ENV")) == NULL)
+		pass_list = ENV_PASS_DEFAULT;
+
+	npatterns = (pass_through == 1) ? parse_pass_list(pass_list, patterns) : 0;
+
+	for (var = environ; npatterns > 0 && *var != NULL; var++) {
+		if ((eq = strchr(*var, '=')) == NULL || pass_env_matches(patterns, npatterns, *var, eq - *var) == 0)
+			continue;
+
+		for (i = 0; i < nbuilt; i++) {
+			if (strncmp(vars[i].name, *var, eq - *var) == 0 && vars[i].name[eq - *var] == '\0')
+				break;
+		}
+		if (i < nbuilt)
+			continue;
+
+		if (nvars == ENV_VARS) {
+			resolve_warn("only the first %d variables in XCRUN_PASS_ENV are passed on.", ENV_PASS_MAX);
+			break;
+		}
+
+		vars[nvars].name = arena_strndup(*var, eq - *var);
+		vars[nvars++].value = eq + 1;
+	}
+
+	/* The same sdk and toolchain always give the same environment, in the same order. */
+	qsort(vars, nvars, sizeof(env_var), compare_env_vars);
+
+	return nvars;
+}
+
+/**
+ * @func environment_size -- Get the size of the block pack_environment lays variables out in.
+ * @arg vars - variables, as filled in by build_environment
+ * @arg nvars - number of variables
+ * @return: size of the block in bytes
+ */
+size_t environment_size(const env_var vars[], int nvars)
+{
+	int i;
+	size_t size = (nvars + 1) * sizeof(char *);
+
+	for (i = 0; i < nvars; i++)
+		size += strlen(vars[i].name) + strlen(vars[i].value) + 2;
+
+	return size;
+}
+
+/**
+ * @func pack_environment -- Lay variables out as an execve environment, array and strings in one block.
+ * @arg vars - variables, as filled in by build_environment
+ * @arg nvars - number of variables
+ * @arg block - memory of at least environment_size(vars, nvars) bytes
+ * @return: the NULL terminated environment, at the start of block
+ */
+char **pack_environment(const env_var vars[], int nvars, void *block)
+{
+	int i;
+	size_t len;
+	char **envp = (char **)block;
+	char *p = (char *)(envp + nvars + 1);
+
+	for (i = 0; i < nvars; i++) {
+		envp[i] = p;
+		len = strlen(vars[i].name);
+		memcpy(p, vars[i].name, len);
+		p += len;
+		*p++ = '=';
+		len = strlen(vars[i].value) + 1;
+		memcpy(p, vars[i].value, len);
+		p += len;
+	}
+	envp[nvars] = NULL;
+
+	return envp;
+}
+
+/**
+ * @func resolve_environment -- Resolve the sdk and toolchain information that call_command passes on.
+ * @arg entry - lookup result to fill
+ */
+void resolve_environment(cache_entry *entry)
+{
+	sdk_config config;
+
+	entry->sdk_path = get_sdk_path(current_sdk);
+	entry->toolchain_path = get_toolchain_path(current_toolchain);
+
+	config = get_sdk_info(entry->sdk_path);
+	entry->deployment_target = config.deployment_target;
+	entry->deployment_kind = config.deployment_kind;
+
+	if (config.target_triple != NULL)
+		entry->target_triple = config.target_triple;
+	else if (config.default_arch != NULL && config.deployment_target != NULL)
+		entry->target_triple = parse_target_triple(config.deployment_target, config.default_arch);
+	else
+		entry->target_triple = NULL;
+
+	/* The environment depends on the contents of both info.ini files. */
+	cache_stamp_add(entry, arena_printf("%s/info.ini", entry->sdk_path));
+	cache_stamp_add(entry, arena_printf("%s/info.ini", entry->toolchain_path));
+
+	entry->has_env = 1;
+}
+
+/**
+ * @func stamp_search_dirs -- Record the directories (and their info.ini files) a lookup depended on.
+ * @arg entry - lookup result to record the dependencies in
+ * @arg list - directories searched
+ */
+void stamp_search_dirs(cache_entry *entry, const search_list *list)
+{
+	int i;
+	size_t len;
+	const char *dir = NULL;
+
+	/* An sdk chosen by part of its name is only right until another one is installed. */
+	if (context.matched_sdk == 1)
+		cache_stamp_add(entry, arena_printf("%s/SDKs", developer_dir));
+
+	for (i = 0; i < list->ndirs; i++) {
+		dir = list->dirs[i];
+		cache_stamp_add(entry, dir);
+
+		/* SDK and toolchain directories also depend on their info.ini. */
+		len = strlen(dir);
+		if (len > 8 && strcmp(dir + len - 8, "/usr/bin") == 0) {
+			if (strncmp(dir, developer_dir, len - 8) != 0 || developer_dir[len - 8] != '\0')
+				cache_stamp_add(entry, arena_printf("%.*s/info.ini", (int)(len - 8), dir));
+		}
+	}
+}
+
+/**
+ * @func get_compiler_driver -- Look up the compiler driver that a name stands for.
+ * @arg name - name that xcrun was called as
+ * @return: the compiler driver, or NULL if name isn't one
+ */
+const compiler_driver *get_compiler_driver(const char *name)
+{
+	int i;
+
+	for (i = 0; i < (int)(sizeof(compiler_drivers) / sizeof(compiler_drivers[0])); i++) {
+		if (strcmp(name, compiler_drivers[i].name) == 0)
+			return &compiler_drivers[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * @func is_xcrun_binary -- Check if a path refers to the binary that is running right now.
+ * @arg path - path to check
+ * @return: 1 if it does, 0 if it doesn't (or if we can't tell)
+ */
+int is_xcrun_binary(const char *path)
+{
+	static int have_self = 0;
+	static struct stat self;
+	struct stat fstat;
+#ifdef __APPLE__
+	char self_path[PATH_MAX];
+	uint32_t size = sizeof(self_path);
+#endif
+
+	if (have_self == 0) {
+#ifdef __APPLE__
+		if (_NSGetExecutablePath(self_path, &size) == 0 && fs_stat(self_path, &self) == 0)
+			have_self = 1;
+#else
+		if (fs_stat("/proc/self/exe", &self) == 0)
+			have_self = 1;
+#endif
+		else
+			have_self = -1;
+	}
+
+	if (have_self != 1 || fs_stat(path, &fstat) != 0)
+		return 0;
+
+	return (fstat.st_dev == self.st_dev && fstat.st_ino == self.st_ino);
+}
+
+/**
+ * @func search_list_add -- Append the usr/bin directory of a developer dir, sdk or toolchain to a search list.
+ * @arg list - search list to append to
+ * @arg root - directory containing usr/bin
+ */
+static void search_list_add(search_list *list, const char *root)
+{
+	if (list->ndirs < SEARCH_MAX_DIRS)
+		list->dirs[list->ndirs++] = arena_printf("%s/usr/bin", root);
+}
+
+/**
+ * @func search_command -- Search a set of directories for a given command
+ * @arg name - program's name
+ * @arg list - directories to search, in order
+ * @return: the program's absolute path on success, NULL on failure
+ */
+static char *search_command(const char *name, const search_list *list)
+{
+	int i;
+	int found;		/* result of probing a candidate */
+	char cmd[PATH_MAX];	/* candidate's absolute path */
+	trace_span span;
+
+	/* Search each directory in the list until we find our program. */
+	for (i = 0; i < list->ndirs; i++) {
+		verbose_printf(stdout, "xcrun: info: checking directory \'%s\' for command \'%s\'...\n", list->dirs[i], name);
+
+		/* Construct our program's absolute path. */
+		if (snprintf(cmd, sizeof(cmd), "%s/%s", list->dirs[i], name) >= (int)sizeof(cmd))
+			continue;
+
+		/* Does it exist? Is it an executable? Ask the directory index first. */
+		span = trace_begin();
+		found = (nocache_mode == 0) ? cache_dir_lookup(list->dirs[i], name) : (-1);
+		if (found != (-1))
+			trace_end(span, "dir_index", list->dirs[i]);
+		else {
+			found = (fs_access(cmd, (F_OK | X_OK)) == 0);
+			trace_end(span, "access", cmd);
+		}
+
+		if (found == 0)
+			continue;
+
+		/* Compiler drivers must not end up running themselves. */
+		if (current_driver != NULL && is_xcrun_binary(cmd) == 1) {
+			verbose_printf(stdout, "xcrun: info: skipping \'%s\', it is xcrun itself.\n", cmd);
+			continue;
+		}
+
+		verbose_printf(stdout, "xcrun: info: found command's absolute path: \'%s\'\n", cmd);
+		if (nocache_mode == 0)
+			cache_dir_save();
+		return arena_strdup(cmd);
+	}
+
+	if (nocache_mode == 0)
+		cache_dir_save();
+
+	errno = ENOENT;
+
+	return NULL;
+}
+
+/**
+ * @func build_search_list -- List the directories a program is searched for in, in order.
+ * @arg list - list to fill
+ */
+void build_search_list(search_list *list)
+{
+	const char *toolch_name = NULL;	/* toolchain name to be used with sdk */
+
+	list->ndirs = 0;
+
+	/* No matter the circumstance, search the developer dir. */
+	search_list_add(list, developer_dir);
+
+	/* If we implicitly specified an sdk, search the sdk and it's associated toolchain. */
+	if (explicit_sdk_mode == 1) {
+		toolch_name = get_sdk_info(get_sdk_path(current_sdk)).toolchain;
+		search_list_add(list, get_sdk_path(current_sdk));
+		search_list_add(list, get_toolchain_path(toolch_name));
+		return;
+	}
+
+	/* If we implicitly specified a toolchain, only search the toolchain. */
+	if (explicit_toolchain_mode == 1) {
+		search_list_add(list, get_toolchain_path(current_toolchain));
+		return;
+	}
+
+	/* If we explicitly specified an SDK, append it to the search list. */
+	if (alternate_sdk_path != NULL) {
+		search_list_add(list, alternate_sdk_path);
+		/* We also want to append an associated toolchain if this is really an SDK folder. */
+		if (test_sdk_authenticity(alternate_sdk_path) == 1) {
+			toolch_name = get_sdk_info(alternate_sdk_path).toolchain;
+			search_list_add(list, get_toolchain_path(toolch_name));
+			/* We now have a toolchain, so we are done. */
+			return;
+		}
+	}
+
+	/* If we explicitly specified a toolchain, append it to the search list. */
+	if (alternate_toolchain_path != NULL)
+		search_list_add(list, alternate_toolchain_path);
+
+	/* By default, we search our developer dir, our default sdk, and our default toolchain only. */
+	if (explicit_sdk_mode == 0 && explicit_toolchain_mode == 0 && alternate_toolchain_path == NULL && alternate_sdk_path == NULL) {
+		search_list_add(list, get_sdk_path(current_sdk));
+		search_list_add(list, get_toolchain_path(current_toolchain));
+	}
+}
+
+/**
+ * @func lookup_command -- Search the developer dir, sdk and toolchain for a program.
+ * @arg name - program's name
+ * @arg entry - lookup result to record the program's path (and dependencies) in
+ * @return: the program's absolute path on success, NULL on failure
+ */
+char *lookup_command(const char *name, cache_entry *entry)
+{
+	char *cmd = NULL;	/* command's absolute path */
+	search_list list;	/* directories to search */
+
+	build_search_list(&list);
+
+	/* Compiler drivers fall back to the host's compiler. */
+	if (current_driver != NULL && list.ndirs < SEARCH_MAX_DIRS)
+		list.dirs[list.ndirs++] = COMPILER_HOST_DIR;
+
+	if (nocache_mode == 0)
+		stamp_search_dirs(entry, &list);
+
+	if ((cmd = search_command(name, &list)) != NULL)
+		entry->path = cmd;
+
+	return cmd;
+}
+
+/**
+ * @func path_under -- Check that a path lies within a directory, without climbing out of it with '..'.
+ * @arg path - absolute path
+ * @arg root - directory, or NULL
+ * @return: 1 if it does, 0 otherwise
+ */
+static int path_under(const char *path, const char *root)
+{
+	size_t len;
+	size_t path_len = strlen(path);
+
+	if (root == NULL || (len = strlen(root)) == 0 || strncmp(path, root, len) != 0 || path[len] != '/')
+		return 0;
+
+	return (strstr(path + len, "/../") == NULL && (path_len < 3 || strcmp(path + path_len - 3, "/..") != 0));
+}
+
+/**
+ * @func entry_is_plausible -- Check that a cached entry only points into the directories it was resolved against.
+ * @arg entry - lookup result from the cache
+ * @return: 1 if it does, 0 otherwise
+ */
+static int entry_is_plausible(const cache_entry *entry)
+{
+	int i;
+	int j;
+	const char *roots[4];
+	const char *paths[3];
+
+	/* Everything is searched for in the developer dir, the sdk and toolchain it was given or, for a compiler driver, the host. */
+	roots[0] = developer_dir;
+	roots[1] = alternate_sdk_path;
+	roots[2] = alternate_toolchain_path;
+	roots[3] = (current_driver != NULL) ? COMPILER_HOST_DIR : NULL;
+
+	paths[0] = entry->path;
+	paths[1] = (entry->has_env == 1) ? entry->sdk_path : NULL;
+	paths[2] = (entry->has_env == 1) ? entry->toolchain_path : NULL;
+
+	for (i = 0; i < 3; i++) {
+		if (paths[i] == NULL || *paths[i] == '\0')
+			continue;
+
+		for (j = 0; j < 4; j++) {
+			if (path_under(paths[i], roots[j]) == 1)
+				break;
+		}
+		if (j == 4)
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * @func resolve_command -- Find a program for the selected sdk and toolchain, using the lookup cache.
+ * @arg name - program's name
+ * @arg entry - lookup result to fill (with the environment too, unless we are only finding)
+ * @return: the program's absolute path on success, NULL on failure
+ */
+const char *resolve_command(const char *name, cache_entry *entry)
+{
+	int cached = 0;		/* did we find our command in the lookup cache? */
+	cache_key key;		/* what we are looking for */
+	trace_span span;
+
+	select_sdk_and_toolchain();
+
+	memset(entry, 0, sizeof(*entry));
+
+	key.developer_dir = developer_dir;
+	key.generation = developer_generation;
+	key.mode = (explicit_sdk_mode ? SEARCH_EXPLICIT_SDK : 0) | (explicit_toolchain_mode ? SEARCH_EXPLICIT_TOOLCHAIN : 0) | (current_driver ? SEARCH_COMPILER_DRIVER : 0);
+	key.sdk = current_sdk;
+	key.toolchain = current_toolchain;
+	key.alternate_sdk = alternate_sdk_path;
+	key.alternate_toolchain = alternate_toolchain_path;
+	key.tool = name;
+
+	/* Have we already looked this one up? */
+	span = trace_begin();
+	cached = (nocache_mode == 0 && cache_lookup(&key, entry) == 0);
+	trace_end(span, "cache_lookup", name);
+
+	/* A shared cache may be written by others; never run anything outside of what we would have searched. */
+	if (cached == 1 && entry_is_plausible(entry) == 0) {
+		verbose_printf(stdout, "xcrun: info: ignoring lookup cache entry for '%s' outside of the searched directories.\n", name);
+		cached = 0;
+	}
+
+	/* A miss is cached too, and stays valid until one of the searched directories changes. */
+	if (cached == 1 && *entry->path == '\0') {
+		trace_set_result(NULL, "hit");
+		trace_set_outcome("not-found");
+		verbose_printf(stdout, "xcrun: info: lookup cache says \'%s\' doesn\'t exist.\n", name);
+		resolve_error("can\'t stat \'%s\' (errno=%s)", name, strerror(ENOENT));
+		errno = ENOENT;
+		return NULL;
+	}
+
+	if (cached == 1)
+		verbose_printf(stdout, "xcrun: info: found command's absolute path in lookup cache: \'%s\'\n", entry->path);
+	else {
+		memset(entry, 0, sizeof(*entry));
+		if (lookup_command(name, entry) == NULL) {
+			/* We have searched everywhere, but we haven't found our program. State why. */
+			resolve_error("can\'t stat \'%s\' (errno=%s)", name, strerror(errno));
+			trace_set_result(NULL, "miss");
+			trace_set_outcome("not-found");
+			entry->path = NULL;
+			if (nocache_mode == 0 && cache_store(&key, entry) != 0)
+				verbose_printf(stdout, "xcrun: info: failed to update lookup cache.\n");
+			errno = ENOENT;
+			return NULL;
+		}
+	}
+
+	trace_set_result(entry->path, (cached == 1) ? "hit" : "miss");
+
+	/* Executing needs the environment too, which a cached entry from --find doesn't have. */
+	if (finding_mode == 0 && entry->has_env == 0) {
+		resolve_environment(entry);
+		cached = 0;
+	}
+
+	if (nocache_mode == 0 && cached == 0 && cache_store(&key, entry) != 0)
+		verbose_printf(stdout, "xcrun: info: failed to update lookup cache.\n");
+
+	return entry->path;
+}
@@ -0,0 +1,256 @@
+/* resolve.h - sdk, toolchain and tool resolution for xcrun and libxcrun
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __RESOLVE_H__
+#define __RESOLVE_H__
+
+#include <stdio.h>
+#include <setjmp.h>
+
+#include "cache.h"
+#include "ini.h"
+#include "registry.h"
+
+/* Configuration files (the first relative to $HOME) */
+#define SDK_CFG ".xcdev.dat"
+#define XCRUN_DEFAULT_CFG "/etc/xcrun.ini"
+
+/* Search mode flags (used as part of the lookup cache key) */
+#define SEARCH_EXPLICIT_SDK 0x1
+#define SEARCH_EXPLICIT_TOOLCHAIN 0x2
+#define SEARCH_COMPILER_DRIVER 0x4
+
+/* Where compiler drivers look for a compiler if the developer dir doesn't have one */
+#define COMPILER_HOST_DIR "/usr/bin"
+
+/* Kinds of deployment target an SDK may specify */
+#define DEPLOYMENT_TARGET_MACOSX 1
+#define DEPLOYMENT_TARGET_IOS 2
+
+/* Most architectures one call resolves target triples for (see --arch) */
+#define ARCH_MAX 16
+
+/* Most variables passed through from our own environment to a called program */
+#define ENV_PASS_MAX 32
+
+/* Most variables that are passed to a called program */
+#define ENV_VARS (6 + ENV_PASS_MAX)
+
+/* Toolchain configuration struct */
+typedef struct {
+	const char *name;
+	const char *version;
+} toolchain_config;
+
+/* SDK configuration struct */
+typedef struct {
+	const char *name;
+	const char *version;
+	const char *toolchain;
+	const char *default_arch;
+	const char *archs;		/* every architecture the sdk supports, space or comma separated */
+	const char *deployment_target;
+	int deployment_kind;
+	const char *target_triple;	/* precomputed by the registry, if any */
+	const char *target_triples;	/* one per archs entry, precomputed by the registry, if any */
+} sdk_config;
+
+/* xcrun default configuration struct */
+typedef struct {
+	const char *sdk;
+	const char *toolchain;
+} default_config;
+
+/* Compiler driver that xcrun may be called as */
+typedef struct {
+	const char *name;	/* name xcrun was called as */
+	const char *compiler;	/* name of the compiler to run */
+	int preprocess_only;	/* pass -E to the compiler */
+} compiler_driver;
+
+/* Most directories a single lookup searches */
+#define SEARCH_MAX_DIRS 8
+
+/* Directories a lookup searches, in order */
+typedef struct {
+	int ndirs;
+	const char *dirs[SEARCH_MAX_DIRS];
+} search_list;
+
+/* Variable for a called program's environment */
+typedef struct {
+	const char *name;
+	const char *value;
+} env_var;
+
+/* Output mode flags */
+extern int verbose_mode;
+extern int finding_mode;	/* only the path is wanted, not the environment */
+extern int nocache_mode;
+
+/* Behavior mode flags */
+extern int explicit_sdk_mode;
+extern int explicit_toolchain_mode;
+
+/* Runtime info, NULL until selected or resolved */
+extern char *developer_dir;
+extern unsigned long developer_generation;	/* see xcode-select, 0 if unknown */
+extern char *current_sdk;
+extern char *current_toolchain;
+extern char *alternate_sdk_path;
+extern char *alternate_toolchain_path;
+
+/* The compiler driver we were called as, if any */
+extern const compiler_driver *current_driver;
+
+/* Schemas of the toolchain and sdk info.ini files and of xcrun.ini */
+extern ini_schema toolchain_schema;
+extern ini_schema sdk_schema;
+extern ini_schema default_schema;
+
+/* Errors and warnings. These print "xcrun: error: ..." (or warning) to stderr,
+   and resolve_fail exits, unless resolve_catch is in effect: then the last
+   error's message is kept, warnings are dropped and resolve_fail longjmps to
+   the given jmp_buf. A NULL fmt fails without a message of its own. libxcrun
+   catches errors around every call, so only the xcrun binaries ever exit. */
+void resolve_error(const char *fmt, ...);
+void resolve_warn(const char *fmt, ...);
+void resolve_fail(const char *fmt, ...) __attribute__ ((noreturn));
+void resolve_catch(jmp_buf *jmp, char *buf, size_t size);
+
+/* Print to fp if verbose_mode is set. */
+void verbose_printf(FILE *fp, const char *str, ...);
+
+/* Copy src into the arena without the extension ext, if it ends with it. */
+char *stripext(const char *src, const char *ext);
+
+/* Check that dir is a directory and keep it open (see fs_dir_open). Returns 0
+   on success, -1 (after reporting an error) on failure. */
+int validate_directory_path(const char *dir);
+
+/* Parse the ini file at path into config. See ini_parse_schema() in ini.h. */
+int parse_ini(const char *path, ini_schema *schema, void *config);
+
+/* Like parse_ini, for the len bytes read from path into buf. */
+int parse_ini_buffer(const char *path, const char *buf, size_t len, ini_schema *schema, void *config);
+
+/* Configuration of the toolchain or sdk at path, and the defaults in the
+   xcrun.ini at path. These fail if the file can't be read. */
+toolchain_config get_toolchain_info(const char *path);
+sdk_config get_sdk_info(const char *path);
+default_config get_default_info(const char *path);
+
+/* Find the developer dir, and switch to the cache store that goes with it.
+   Returns the developer dir, NULL (after reporting an error) on failure. */
+char *find_developer_dir(void);
+
+/* List the bundles ending in ext (".sdk" or ".toolchain") in dir, placing their
+   absolute paths in paths (max long). Returns the number of bundles. */
+int list_bundles(const char *dir, const char *ext, char *paths[], int max);
+
+/* Read xcrun.ini and every sdk's and toolchain's info.ini in the developer dir
+   into contents, sorted by path. */
+void scan_developer_dir(registry_contents *contents);
+
+/* Every sdk and toolchain in the developer dir: from the registry while it is
+   current, otherwise scanned (and compiled into the registry for next time). */
+const registry_contents *get_developer_dir_contents(void);
+
+/* Use dir as the developer dir instead of finding one, as DEVELOPER_DIR does. */
+void resolve_select_developer_dir(const char *dir);
+
+/* Absolute path of the named toolchain or sdk in the developer dir. These fail
+   if it doesn't exist. */
+char *get_toolchain_path(const char *name);
+char *get_sdk_path(const char *name);
+
+/* Target triple for arch with the deployment target ver, and the space
+   separated triples for each architecture in list. */
+char *parse_target_triple(const char *ver, const char *arch);
+char *parse_target_triples(const char *ver, const char *list);
+
+/* Target triple for the named sdk (or $TARGET_TRIPLE), NULL if it has none. */
+char *get_target_triple(const char *current_sdk);
+
+/* Resolve the target triple for each architecture in list ("all" for every one
+   the sdk at sdk_path supports) into archs and triples, each ARCH_MAX long.
+   Returns the number of architectures. */
+int arch_target_triples(const char *list, const char *sdk_path, const char *triple, const char *deployment_target, char *archs[], char *triples[]);
+
+/* Select an sdk (or toolchain) by short name or absolute path, as --sdk and
+   --toolchain do. Fails if an absolute path isn't a directory. */
+void resolve_select_sdk(const char *sdk);
+void resolve_select_toolchain(const char *toolchain);
+
+/* Fall back to the environment or defaults for an unselected sdk and/or
+   toolchain, finding the developer dir first. */
+void select_sdk_and_toolchain(void);
+
+/* Forget the selection and everything resolved for it, close the registry and
+   every directory kept open, and free the arena. */
+void resolve_reset(void);
+
+/* The compiler driver that name stands for, NULL if it isn't one. */
+const compiler_driver *get_compiler_driver(const char *name);
+
+/* Check if path refers to the binary that is running right now. */
+int is_xcrun_binary(const char *path);
+
+/* Directories a lookup searches for the current selection, and recording them
+   (and their info.ini files) as dependencies of entry. */
+void build_search_list(search_list *list);
+void stamp_search_dirs(cache_entry *entry, const search_list *list);
+
+/* Search for name without the lookup cache, filling entry. Returns the
+   program's absolute path, NULL with errno set if it can't be found. */
+char *lookup_command(const char *name, cache_entry *entry);
+
+/* Resolve the sdk, toolchain, target triple and deployment target of entry. */
+void resolve_environment(cache_entry *entry);
+
+/* Build the variables for a called program's environment into vars (ENV_VARS
+   long), sorted by name. Returns the number of variables. Values may point
+   into env_info and the environment, so pack them before either changes. */
+int build_environment(const cache_entry *env_info, env_var vars[], int pass_through);
+
+/* Get the size of the block pack_environment needs for vars. */
+size_t environment_size(const env_var vars[], int nvars);
+
+/* Lay vars out in block as a NULL terminated execve environment, the array
+   first and the strings after it. Returns the array. */
+char **pack_environment(const env_var vars[], int nvars, void *block);
+
+/* Find name for the current selection using the lookup cache, filling entry
+   (with the environment too, unless finding_mode is set). Returns the
+   program's absolute path, NULL (after reporting an error) on failure. */
+const char *resolve_command(const char *name, cache_entry *entry);
+
+#endif /* __RESOLVE_H__ */
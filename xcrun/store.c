@@ -0,0 +1,269 @@
+/* store.c - where xcrun keeps its cache files, and how they are published
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Every cache file is immutable once written: writers build a complete new
+ * file next to it and rename it into place, so readers (which map or read the
+ * file without locking) always see a whole file. Writers serialize on a lock
+ * file next to the cache file, which lets each of them merge with what the
+ * previous one wrote instead of overwriting it.
+ *
+ * A shared directory is sticky, so nobody can replace a file another user
+ * published. Files are only read if they belong to us or to root and nobody
+ * else can write to them; xcrun runs the paths they hold. A shared file
+ * that fails that test is kept in $HOME instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "store.h"
+#include "fsops.h"
+#include "resolve.h"
+
+/* Shared directory for the current developer dir, empty to use $HOME */
+static char shared_dir[PATH_MAX];
+
+/* Has shared_dir been checked with trusted_dir yet? */
+static int shared_checked = 0;
+
+/**
+ * @func trusted_file -- check that only we (or root) can have written a cache file
+ * @arg st - the file's status
+ * @return: 1 if the file can be trusted, 0 otherwise
+ */
+static int trusted_file(const struct stat *st)
+{
+	return (S_ISREG(st->st_mode) && (st->st_uid == geteuid() || st->st_uid == 0) &&
+		(st->st_mode & (S_IWGRP | S_IWOTH)) == 0);
+}
+
+/**
+ * @func trusted_dir -- check that nobody but us (or root) can replace the files we keep in a directory
+ * @arg st - the directory's status
+ * @return: 1 if the directory can be trusted, 0 otherwise
+ */
+static int trusted_dir(const struct stat *st)
+{
+	return (S_ISDIR(st->st_mode) && (st->st_uid == geteuid() || st->st_uid == 0) &&
+		((st->st_mode & (S_IWGRP | S_IWOTH)) == 0 || (st->st_mode & S_ISVTX) != 0));
+}
+
+/**
+ * @func in_shared_dir -- check whether a cache file lives in the shared directory
+ * @arg path - the file's path
+ * @return: 1 if it does, 0 if it lives in $HOME
+ */
+static int in_shared_dir(const char *path)
+{
+	size_t len = strlen(shared_dir);
+
+	return (len > 0 && strncmp(path, shared_dir, len) == 0 && path[len] == '/');
+}
+
+/**
+ * @func make_shared_dir -- create the shared directory for the current developer dir if needed
+ * @return: 0 if the directory can be published into, -1 otherwise
+ */
+static int make_shared_dir(void)
+{
+	struct stat st;
+
+	/* Everyone sharing the store has to be able to publish into it, but not over each other's files. */
+	if (fs_mkdir(shared_dir, 01777) == 0)
+		(void)chmod(shared_dir, 01777);
+
+	if (fs_lstat(shared_dir, &st) != 0 || trusted_dir(&st) == 0) {
+		verbose_printf(stdout, "xcrun: info: can\'t publish into shared cache directory \'%s\', it is missing or other users could replace its files.\n", shared_dir);
+		errno = EPERM;
+		return -1;
+	}
+
+	return 0;
+}
+
+int store_set_shared(const char *root, const char *developer_dir)
+{
+	const char *p = NULL;
+	unsigned long long hash = 14695981039346656037ULL;
+
+	shared_dir[0] = '\0';
+	shared_checked = 0;
+
+	if (root == NULL || *root == '\0')
+		return 0;
+
+	/* FNV-1a, any stable hash will do. */
+	for (p = developer_dir; *p != '\0'; p++) {
+		hash ^= (unsigned char)*p;
+		hash *= 1099511628211ULL;
+	}
+
+	if (snprintf(shared_dir, sizeof(shared_dir), "%s/%016llx", root, hash) >= (int)sizeof(shared_dir)) {
+		shared_dir[0] = '\0';
+		return -1;
+	}
+
+	return 0;
+}
+
+const char *store_path(char *path, size_t size, const char *name)
+{
+	char *home = NULL;
+	struct stat st;
+
+	/* Someone else's directory could be swapped out under us, so use $HOME instead. */
+	if (shared_dir[0] != '\0' && shared_checked == 0) {
+		if (fs_lstat(shared_dir, &st) == 0 && trusted_dir(&st) == 0) {
+			verbose_printf(stdout, "xcrun: info: ignoring shared cache directory \'%s\', other users could replace its files (caching in $HOME instead).\n", shared_dir);
+			shared_dir[0] = '\0';
+		}
+		shared_checked = 1;
+	}
+
+	if (shared_dir[0] != '\0') {
+		snprintf(path, size, "%s/%s", shared_dir, name);
+		/* A file published by another user can't be read or replaced, so keep our own in $HOME. */
+		if (fs_lstat(path, &st) != 0 || trusted_file(&st) == 1)
+			return path;
+		verbose_printf(stdout, "xcrun: info: ignoring shared cache file \'%s\', it was written by another user (using $HOME instead).\n", path);
+	}
+
+	if ((home = getenv("HOME")) == NULL)
+		return NULL;
+
+	snprintf(path, size, "%s/%s", home, name);
+
+	return path;
+}
+
+int store_lock(const char *path)
+{
+	int fd;
+	char lock_path[PATH_MAX + 8];
+
+	if (in_shared_dir(path) == 1 && make_shared_dir() != 0)
+		return -1;
+
+	snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+	/* flock works on read only descriptors, so a lock file made by another user is fine. */
+	if ((fd = fs_open(lock_path, O_RDONLY | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644)) == -1)
+		return -1;
+
+	while (flock(fd, LOCK_EX) != 0) {
+		if (errno != EINTR) {
+			fs_close(fd);
+			return -1;
+		}
+	}
+
+	return fd;
+}
+
+void store_unlock(int lock)
+{
+	/* Closing the lock file releases the lock. */
+	if (lock != -1)
+		fs_close(lock);
+}
+
+int store_remove(const char *path)
+{
+	char lock_path[PATH_MAX + 8];
+
+	if (fs_unlink(path) != 0 && errno != ENOENT)
+		return -1;
+
+	/* A writer holding the old lock just publishes unlocked, like one that couldn't take it. */
+	snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+	if (fs_unlink(lock_path) != 0 && errno != ENOENT)
+		return -1;
+
+	return 0;
+}
+
+int store_publish(const char *path, const void *data, size_t len)
+{
+	int fd;
+	ssize_t n;
+	size_t written = 0;
+	char tmp_path[PATH_MAX + 16];
+
+	if (in_shared_dir(path) == 1 && make_shared_dir() != 0)
+		return -1;
+
+	snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+	if ((fd = fs_mkstemp(tmp_path)) == -1)
+		return -1;
+
+	while (written < len) {
+		if ((n = fs_write(fd, (const char *)data + written, len - written)) <= 0)
+			break;
+		written += n;
+	}
+
+	/* mkstemp only lets the owner read, which is fine for $HOME but not for a shared store. */
+	if (in_shared_dir(path) == 1)
+		(void)fchmod(fd, 0644);
+
+	if (fs_close(fd) != 0 || written != len || fs_rename(tmp_path, path) != 0) {
+		fs_unlink(tmp_path);
+		return -1;
+	}
+
+	return 0;
+}
+
+int store_open(const char *path)
+{
+	int fd;
+	struct stat st;
+
+	if ((fd = fs_open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) == -1)
+		return -1;
+
+	if (fs_fstat(fd, &st) != 0 || trusted_file(&st) == 0) {
+		verbose_printf(stdout, "xcrun: info: ignoring cache file \'%s\', someone else could have written it.\n", path);
+		fs_close(fd);
+		errno = EPERM;
+		return -1;
+	}
+
+	return fd;
+}
@@ -0,0 +1,72 @@
+/* store.h - where xcrun keeps its cache files, and how they are published
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __STORE_H__
+#define __STORE_H__
+
+#include <stddef.h>
+
+/* Environment variable naming a cache directory shared between users */
+#define XCRUN_CACHE_DIR_ENV "XCRUN_CACHE_DIR"
+
+/* Keep cache files for developer_dir in a subdirectory of root named after a
+   hash of developer_dir, instead of in $HOME. A NULL or empty root goes back to
+   $HOME. Returns 0 on success, -1 if the resulting path is too long (in which
+   case $HOME is used). */
+int store_set_shared(const char *root, const char *developer_dir);
+
+/* Absolute path of the cache file called name, in the shared directory if one
+   was set, in $HOME otherwise. Returns path, or NULL if HOME isn't set. */
+const char *store_path(char *path, size_t size, const char *name);
+
+/* Open the cache file at path for reading, but only if it belongs to us (or
+   root) and nobody else can write to it. Returns the descriptor, or -1 with
+   errno set (EPERM for a file that can't be trusted). */
+int store_open(const char *path);
+
+/* Take the exclusive writer lock for the cache file at path, waiting for any
+   other writer to finish. Readers never lock. Returns the lock, or -1 if the
+   lock can't be taken (writing unlocked is still safe, just racy). */
+int store_lock(const char *path);
+
+/* Release a lock taken with store_lock. */
+void store_unlock(int lock);
+
+/* Remove the cache file at path along with its lock file. A file that doesn't
+   exist is fine. Returns 0 on success, -1 on failure. */
+int store_remove(const char *path);
+
+/* Atomically replace the cache file at path with len bytes of data, so readers
+   see either the old or the new file, never a partial one. Returns 0 on
+   success, -1 on failure. */
+int store_publish(const char *path, const void *data, size_t len);
+
+#endif /* __STORE_H__ */
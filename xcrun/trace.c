@@ -0,0 +1,580 @@
+/* trace.c - per-phase timing instrumentation for xcrun
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Phases are timed with a monotonic clock, relative to the start of the
+ * invocation, and kept in memory until the invocation ends (or is about to
+ * execute a tool). They are then written as a single JSON line, with a single
+ * write, so records from many concurrent invocations appending to the same file
+ * don't interleave:
+ *
+ * {"pid":1234,"tool":"ld","total_us":812.4,"fs_calls":17,"lookups":31,"phases":[
+ *   {"phase":"get_developer_path","detail":null,"start_us":10.2,"duration_us":21.7,"fs_calls":3,"lookups":2}, ...]}
+ *
+ * lookups counts the path components the filesystem calls looked up by name,
+ * each of which is a metadata round trip on a network filesystem.
+ *
+ * XCRUN_LOG_FILE gets a much smaller record, meant to be left on for whole
+ * builds and summarized with trace_report (xcrun --stats). It is one tab
+ * separated line, written the same way, with the time spent in each phase
+ * summed up by phase name:
+ *
+ * <unix time> <pid> <tool> <path> <cache> <outcome> <total_us> <fs_calls> <phase>=<us>,<phase>=<us>,...
+ *
+ * Empty fields are written as "-".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "trace.h"
+#include "fsops.h"
+
+/* A finished phase */
+typedef struct {
+	const char *phase;
+	char *detail;
+	double start;
+	double duration;
+	unsigned int fs_calls;
+	unsigned int lookups;
+} trace_phase;
+
+static int tracing = 0;
+static int trace_fd = -1;
+static const char *trace_path = NULL;
+static const char *trace_tool = NULL;
+static int logging = 0;
+static const char *log_path = NULL;
+static char *log_result = NULL;
+static const char *log_cache = NULL;
+static const char *log_outcome = NULL;
+static double trace_epoch = 0;
+static int nphases = 0;
+static int dropped = 0;
+static trace_phase phases[TRACE_MAX_PHASES];
+
+/* Simple growable output buffer */
+typedef struct {
+	char *data;
+	size_t len;
+	size_t size;
+} tracebuf;
+
+/* Totals trace_report keeps for a tool or a phase */
+typedef struct {
+	char *name;
+	unsigned long calls;
+	double total;
+	double max;
+} trace_total;
+
+/**
+ * @func now_usec -- get a monotonic timestamp
+ * @return: microseconds since an arbitrary point in time
+ */
+static double now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((double)ts.tv_sec * 1000000.0) + ((double)ts.tv_nsec / 1000.0);
+}
+
+/**
+ * @func buf_printf -- append formatted text to buf
+ * @arg buf - buffer to append to
+ * @arg fmt - printf style format
+ */
+static void buf_printf(tracebuf *buf, const char *fmt, ...)
+{
+	int n;
+	char *data;
+	size_t size;
+	va_list args;
+
+	for (;;) {
+		if (buf->data != NULL) {
+			va_start(args, fmt);
+			n = vsnprintf(buf->data + buf->len, buf->size - buf->len, fmt, args);
+			va_end(args);
+			if (n < 0)
+				return;
+			if ((size_t)n < buf->size - buf->len) {
+				buf->len += n;
+				return;
+			}
+		}
+
+		size = (buf->size != 0) ? (buf->size * 2) : 4096;
+		if ((data = (char *)realloc(buf->data, size)) == NULL)
+			return;
+		buf->data = data;
+		buf->size = size;
+	}
+}
+
+/**
+ * @func buf_json_string -- append a quoted JSON string (or null) to buf
+ * @arg buf - buffer to append to
+ * @arg str - string to append, NULL for null
+ */
+static void buf_json_string(tracebuf *buf, const char *str)
+{
+	const char *p = NULL;
+
+	if (str == NULL) {
+		buf_printf(buf, "null");
+		return;
+	}
+
+	buf_printf(buf, "\"");
+	for (p = str; *p != '\0'; p++) {
+		if (*p == '"' || *p == '\\')
+			buf_printf(buf, "\\%c", *p);
+		else if ((unsigned char)*p < 0x20)
+			buf_printf(buf, "\\u%04x", (unsigned char)*p);
+		else
+			buf_printf(buf, "%c", *p);
+	}
+	buf_printf(buf, "\"");
+}
+
+/**
+ * @func buf_log_field -- append a field of a log record to buf
+ * @arg buf - buffer to append to
+ * @arg str - field to append, NULL or "" for none
+ */
+static void buf_log_field(tracebuf *buf, const char *str)
+{
+	const char *p = NULL;
+
+	if (str == NULL || *str == '\0') {
+		buf_printf(buf, "\t-");
+		return;
+	}
+
+	/* Tabs and newlines would split the record. */
+	buf_printf(buf, "\t");
+	for (p = str; *p != '\0'; p++)
+		buf_printf(buf, "%c", (*p == '\t' || *p == '\n') ? ' ' : *p);
+}
+
+/**
+ * @func append_all -- append buf to a file, or write it to a file descriptor, with as few writes as possible
+ * @arg path - file to append to, NULL to use fd
+ * @arg fd - file descriptor to write to if path is NULL
+ * @arg buf - what to write
+ */
+static void append_all(const char *path, int fd, const tracebuf *buf)
+{
+	size_t written = 0;
+	ssize_t n;
+
+	/* Append if it is a file, so concurrent invocations can share one. */
+	if (path != NULL)
+		fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+
+	while (fd != -1 && written < buf->len) {
+		if ((n = write(fd, buf->data + written, buf->len - written)) <= 0) {
+			if (n == -1 && errno == EINTR)
+				continue;
+			break;
+		}
+		written += n;
+	}
+
+	if (path != NULL && fd != -1)
+		close(fd);
+}
+
+void trace_init(void)
+{
+	char *value = NULL;
+	char *end = NULL;
+	long fd;
+
+	trace_epoch = now_usec();
+
+	if ((value = getenv(XCRUN_LOG_FILE_ENV)) != NULL && *value != '\0') {
+		log_path = value;
+		logging = 1;
+	}
+
+	if ((value = getenv(XCRUN_TRACE_ENV)) == NULL || *value == '\0')
+		return;
+
+	/* A number is a file descriptor the caller left open for us, anything else a file. */
+	fd = strtol(value, &end, 10);
+	if (*end == '\0' && fd >= 0)
+		trace_fd = (int)fd;
+	else
+		trace_path = value;
+
+	tracing = 1;
+}
+
+void trace_enable(int fd)
+{
+	if (tracing == 1)
+		return;
+
+	trace_fd = fd;
+	tracing = 1;
+}
+
+void trace_skip_log(void)
+{
+	logging = 0;
+}
+
+void trace_set_tool(const char *tool)
+{
+	trace_tool = tool;
+}
+
+void trace_set_result(const char *path, const char *cache)
+{
+	if (logging == 0)
+		return;
+
+	/* The path may live in the lookup cache's buffer, which gets reused. */
+	free(log_result);
+	log_result = (path != NULL) ? strdup(path) : NULL;
+	log_cache = cache;
+}
+
+void trace_set_outcome(const char *outcome)
+{
+	log_outcome = outcome;
+}
+
+trace_span trace_begin(void)
+{
+	trace_span span;
+
+	if (tracing == 0 && logging == 0) {
+		span.start = -1;
+		span.fs_calls = 0;
+		span.lookups = 0;
+		return span;
+	}
+
+	span.start = now_usec() - trace_epoch;
+	span.fs_calls = fs_total();
+	span.lookups = fs_count.lookups;
+
+	return span;
+}
+
+void trace_end(trace_span span, const char *phase, const char *detail)
+{
+	trace_phase *p = NULL;
+
+	if ((tracing == 0 && logging == 0) || span.start < 0)
+		return;
+
+	if (nphases >= TRACE_MAX_PHASES) {
+		dropped++;
+		return;
+	}
+
+	/* Only the JSON record has room for the details. */
+	p = &phases[nphases++];
+	p->phase = phase;
+	p->detail = (detail != NULL && tracing == 1) ? strdup(detail) : NULL;
+	p->start = span.start;
+	p->duration = (now_usec() - trace_epoch) - span.start;
+	p->fs_calls = fs_total() - span.fs_calls;
+	p->lookups = fs_count.lookups - span.lookups;
+}
+
+/**
+ * @func flush_log -- append the log record for this invocation to XCRUN_LOG_FILE
+ * @arg total - microseconds the invocation took
+ */
+static void flush_log(double total)
+{
+	int i, j;
+	double duration;
+	tracebuf buf = { NULL, 0, 0 };
+
+	buf_printf(&buf, "%lld\t%ld", (long long)time(NULL), (long)getpid());
+	buf_log_field(&buf, trace_tool);
+	buf_log_field(&buf, log_result);
+	buf_log_field(&buf, log_cache);
+	buf_log_field(&buf, (log_outcome != NULL) ? log_outcome : "exit");
+	buf_printf(&buf, "\t%.1f\t%u\t", total, fs_total());
+
+	/* Sum up repeated phases (every probe while searching, say) under one name. */
+	for (i = 0; i < nphases; i++) {
+		for (j = 0; j < i; j++) {
+			if (strcmp(phases[j].phase, phases[i].phase) == 0)
+				break;
+		}
+		if (j < i)
+			continue;
+
+		for (duration = 0, j = i; j < nphases; j++) {
+			if (strcmp(phases[j].phase, phases[i].phase) == 0)
+				duration += phases[j].duration;
+		}
+		buf_printf(&buf, "%s%s=%.1f", (i > 0) ? "," : "", phases[i].phase, duration);
+	}
+	if (nphases == 0)
+		buf_printf(&buf, "-");
+
+	buf_printf(&buf, "\n");
+
+	if (buf.data != NULL)
+		append_all(log_path, -1, &buf);
+
+	free(buf.data);
+}
+
+void trace_flush(void)
+{
+	int i;
+	double total;
+	tracebuf buf = { NULL, 0, 0 };
+
+	if (tracing == 0 && logging == 0)
+		return;
+
+	total = now_usec() - trace_epoch;
+
+	if (logging == 1) {
+		logging = 0;
+		flush_log(total);
+	}
+
+	if (tracing == 0) {
+		nphases = 0;
+		return;
+	}
+	tracing = 0;
+
+	buf_printf(&buf, "{\"pid\":%ld,\"tool\":", (long)getpid());
+	buf_json_string(&buf, trace_tool);
+	buf_printf(&buf, ",\"total_us\":%.1f,\"fs_calls\":%u,\"lookups\":%u,\"dropped\":%d,\"phases\":[", total, fs_total(), fs_count.lookups, dropped);
+
+	for (i = 0; i < nphases; i++) {
+		buf_printf(&buf, "%s{\"phase\":", (i > 0) ? "," : "");
+		buf_json_string(&buf, phases[i].phase);
+		buf_printf(&buf, ",\"detail\":");
+		buf_json_string(&buf, phases[i].detail);
+		buf_printf(&buf, ",\"start_us\":%.1f,\"duration_us\":%.1f,\"fs_calls\":%u,\"lookups\":%u}", phases[i].start, phases[i].duration, phases[i].fs_calls, phases[i].lookups);
+		free(phases[i].detail);
+	}
+	nphases = 0;
+
+	buf_printf(&buf, "]}\n");
+
+	if (buf.data != NULL)
+		append_all(trace_path, trace_fd, &buf);
+
+	free(buf.data);
+}
+
+/**
+ * @func add_total -- count a call (or phase) that took duration towards name's totals
+ * @arg totals - totals so far
+ * @arg ntotals - number of totals so far, updated if name is new
+ * @arg name - tool or phase name, names past TRACE_MAX_TOOLS are counted as "(other)"
+ * @arg duration - microseconds it took
+ */
+static void add_total(trace_total *totals, int *ntotals, const char *name, double duration)
+{
+	int i;
+
+	for (i = 0; i < *ntotals; i++) {
+		if (strcmp(totals[i].name, name) == 0)
+			break;
+	}
+
+	if (i == *ntotals) {
+		if (*ntotals == TRACE_MAX_TOOLS)
+			i = TRACE_MAX_TOOLS - 1;
+		else if ((totals[i].name = strdup((*ntotals == TRACE_MAX_TOOLS - 1) ? "(other)" : name)) == NULL)
+			return;
+		else
+			(*ntotals)++;
+	}
+
+	totals[i].calls++;
+	totals[i].total += duration;
+	if (duration > totals[i].max)
+		totals[i].max = duration;
+}
+
+/**
+ * @func compare_totals -- qsort comparator putting the largest total first
+ */
+static int compare_totals(const void *a, const void *b)
+{
+	const trace_total *x = (const trace_total *)a;
+	const trace_total *y = (const trace_total *)b;
+
+	return (x->total < y->total) ? 1 : (x->total > y->total) ? -1 : 0;
+}
+
+/**
+ * @func print_totals -- print the largest of a set of totals
+ * @arg out - where to print them
+ * @arg title - heading for the list
+ * @arg totals - the totals, sorted in place
+ * @arg ntotals - number of totals
+ * @arg nshown - most totals to print
+ */
+static void print_totals(FILE *out, const char *title, trace_total *totals, int ntotals, int nshown)
+{
+	int i;
+
+	qsort(totals, ntotals, sizeof(trace_total), compare_totals);
+
+	fprintf(out, "%s:\n", title);
+	for (i = 0; i < ntotals && i < nshown; i++) {
+		fprintf(out, "  %-24s %8lu  %10.1f ms total  %8.1f us avg  %8.1f us max\n", totals[i].name, totals[i].calls,
+			totals[i].total / 1000.0, totals[i].total / totals[i].calls, totals[i].max);
+	}
+}
+
+int trace_report(const char *path, FILE *out, int ntools)
+{
+	int i;
+	int nfields;
+	int ntotals = 0;
+	int nphase_totals = 0;
+	int noutcomes = 0;
+	unsigned long calls = 0;
+	unsigned long malformed = 0;
+	unsigned long hits = 0, misses = 0, daemon = 0;
+	double total = 0;
+	double fs_calls = 0;
+	double duration;
+	char *line = NULL;
+	char *field[9];
+	char *p = NULL;
+	char *end = NULL;
+	size_t size = 0;
+	FILE *in = NULL;
+	trace_total *tools = NULL;
+	trace_total *phase_totals = NULL;
+	trace_total outcomes[TRACE_MAX_TOOLS];
+
+	if ((in = fopen(path, "r")) == NULL)
+		return -1;
+
+	tools = (trace_total *)calloc(TRACE_MAX_TOOLS, sizeof(trace_total));
+	phase_totals = (trace_total *)calloc(TRACE_MAX_TOOLS, sizeof(trace_total));
+	if (tools == NULL || phase_totals == NULL) {
+		fclose(in);
+		free(tools);
+		free(phase_totals);
+		return -1;
+	}
+	memset(outcomes, 0, sizeof(outcomes));
+
+	while (getline(&line, &size, in) != -1) {
+		line[strcspn(line, "\n")] = '\0';
+
+		for (nfields = 0, p = line; nfields < 9 && p != NULL; nfields++) {
+			field[nfields] = p;
+			if ((p = strchr(p, '\t')) != NULL)
+				*p++ = '\0';
+		}
+
+		/* Skip anything that isn't a whole record, e.g. a line cut short by a full disk. */
+		if (nfields != 9 || p != NULL || (duration = strtod(field[6], &end)) < 0 || *end != '\0') {
+			malformed++;
+			continue;
+		}
+
+		calls++;
+		total += duration;
+		fs_calls += strtod(field[7], NULL);
+
+		if (strcmp(field[4], "hit") == 0)
+			hits++;
+		else if (strcmp(field[4], "miss") == 0)
+			misses++;
+		else if (strcmp(field[4], "daemon") == 0)
+			daemon++;
+
+		add_total(tools, &ntotals, field[2], duration);
+		add_total(outcomes, &noutcomes, field[5], duration);
+
+		for (p = strtok(field[8], ","); p != NULL; p = strtok(NULL, ",")) {
+			if ((end = strchr(p, '=')) == NULL)
+				continue;
+			*end++ = '\0';
+			add_total(phase_totals, &nphase_totals, p, strtod(end, NULL));
+		}
+	}
+
+	free(line);
+	fclose(in);
+
+	fprintf(out, "calls:          %lu", calls);
+	if (malformed != 0)
+		fprintf(out, " (%lu malformed record(s) skipped)", malformed);
+	fprintf(out, "\n");
+	fprintf(out, "total overhead: %.3f s (%.1f us per call)\n", total / 1000000.0, (calls != 0) ? total / calls : 0.0);
+	fprintf(out, "fs calls:       %.0f (%.1f per call)\n", fs_calls, (calls != 0) ? fs_calls / calls : 0.0);
+	fprintf(out, "lookups:        %lu cache hit(s), %lu miss(es), %lu from the daemon\n", hits, misses, daemon);
+	fprintf(out, "outcomes:      ");
+	for (i = 0; i < noutcomes; i++)
+		fprintf(out, " %lu %s%s", outcomes[i].calls, outcomes[i].name, (i + 1 < noutcomes) ? "," : "");
+	fprintf(out, "\n");
+
+	if (ntotals > 0)
+		print_totals(out, "slowest tools (by total time)", tools, ntotals, ntools);
+	if (nphase_totals > 0)
+		print_totals(out, "slowest phases (by total time)", phase_totals, nphase_totals, ntools);
+
+	for (i = 0; i < ntotals; i++)
+		free(tools[i].name);
+	for (i = 0; i < nphase_totals; i++)
+		free(phase_totals[i].name);
+	for (i = 0; i < noutcomes; i++)
+		free(outcomes[i].name);
+	free(tools);
+	free(phase_totals);
+
+	return 0;
+}
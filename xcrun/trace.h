@@ -0,0 +1,91 @@
+/* trace.h - per-phase timing instrumentation for xcrun
+ *
+ * Copyright (c) 2013-2014, Brian McKenzie <mckenzba@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ *  3. Neither the name of the organization nor the names of its contributors may
+ *     be used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdio.h>
+
+/* Environment variable naming where trace records go: a file descriptor number or a file path */
+#define XCRUN_TRACE_ENV "XCRUN_TRACE"
+
+/* Environment variable naming a file that gets one compact record per invocation */
+#define XCRUN_LOG_FILE_ENV "XCRUN_LOG_FILE"
+
+/* Maximum number of phases recorded per invocation */
+#define TRACE_MAX_PHASES 256
+
+/* Maximum number of distinct tools (and phases) trace_report tells apart */
+#define TRACE_MAX_TOOLS 256
+
+/* A phase in progress */
+typedef struct {
+	double start;		/* microseconds since the invocation started, -1 if not tracing */
+	unsigned int fs_calls;	/* filesystem calls made before the phase started */
+	unsigned int lookups;	/* path components looked up before the phase started */
+} trace_span;
+
+/* Start tracing if XCRUN_TRACE or XCRUN_LOG_FILE is set. Call as early as possible. */
+void trace_init(void);
+
+/* Start tracing to fd, unless XCRUN_TRACE already named a destination. */
+void trace_enable(int fd);
+
+/* Don't append a record for this invocation to XCRUN_LOG_FILE. */
+void trace_skip_log(void);
+
+/* Set the tool name reported in the trace record. */
+void trace_set_tool(const char *tool);
+
+/* Set the path a tool resolved to and where it came from ("hit", "miss" or
+   "daemon"), as reported in the log record. path may be NULL. */
+void trace_set_result(const char *path, const char *cache);
+
+/* Set how the invocation ended ("exec", "find", "not-found", ...), as
+   reported in the log record. Invocations that never set it end in "exit". */
+void trace_set_outcome(const char *outcome);
+
+/* Start timing a phase. */
+trace_span trace_begin(void);
+
+/* Record a phase that was started with trace_begin. detail may be NULL. */
+void trace_end(trace_span span, const char *phase, const char *detail);
+
+/* Write the trace record (one JSON line) and the log record, and stop tracing.
+   Safe to call more than once; only the first call writes anything. */
+void trace_flush(void);
+
+/* Summarize the log records in path: call counts, total time and the ntools
+   tools (and phases) that took longest overall. Returns 0 on success, -1 if
+   path can't be read. */
+int trace_report(const char *path, FILE *out, int ntools);
+
+#endif /* __TRACE_H__ */
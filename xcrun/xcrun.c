@@ -31,117 +31,100 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdarg.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <string.h>
+#include <ctype.h>
 #include <libgen.h>
 #include <limits.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+extern char **environ;
 
 #include "ini.h"
+#include "arena.h"
+#include "batch.h"
+#include "cache.h"
+#include "daemon.h"
+#include "fsops.h"
+#include "registry.h"
+#include "resolve.h"
+#include "store.h"
+#include "trace.h"
 
 /* General stuff */
 #define TOOL_VERSION "1.0.0"
-#define SDK_CFG ".xcdev.dat"
-#define XCRUN_DEFAULT_CFG "/etc/xcrun.ini"
-
-/* Toolchain configuration struct */
-typedef struct {
-	const char *name;
-	const char *version;
-} toolchain_config;
-
-/* SDK configuration struct */
-typedef struct {
-	const char *name;
-	const char *version;
-	const char *toolchain;
-	const char *default_arch;
-	const char *deployment_target;
-} sdk_config;
-
-/* xcrun default configuration struct */
-typedef struct {
-	const char *sdk;
-	const char *toolchain;
-} default_config;
 
-/* Output mode flags */
-static int logging_mode = 0;
-static int verbose_mode = 0;
-static int finding_mode = 0;
+/* Fields that may be requested with the --show-* options */
+#define SHOW_SDK_PATH 1
+#define SHOW_SDK_VERSION 2
+#define SHOW_SDK_TARGET_TRIPLE 3
+#define SHOW_SDK_TOOLCHAIN_PATH 4
+#define SHOW_SDK_TOOLCHAIN_VERSION 5
+#define SHOW_MAX_FIELDS 5
+
+/* Output formats for the --show-* options */
+#define SHOW_FORMAT_TEXT 0	/* human readable, one field per line */
+#define SHOW_FORMAT_LINES 1	/* raw values, one per line */
+#define SHOW_FORMAT_NUL 2	/* raw values, each terminated by a NUL */
+#define SHOW_FORMAT_SH 3	/* shell assignments, one per line */
+
+/* Syntax for --export-env */
+#define EXPORT_FORMAT_SH 0	/* export NAME='value' */
+#define EXPORT_FORMAT_MAKE 1	/* export NAME := value */
+#define EXPORT_FORMAT_JSON 2	/* { "NAME": "value", ... } */
+
+/* Number of tools (and phases) --stats lists */
+#define STATS_SHOWN 10
 
-/* Behavior mode flags */
-static int explicit_sdk_mode = 0;
-static int explicit_toolchain_mode = 0;
-static int ios_deployment_target_set = 0;
-static int macosx_deployment_target_set = 0;
+/* Name of the file that records what a --materialize directory was made for */
+#define MATERIALIZE_STAMP ".xcrun.materialized"
 
-/* Runtime info */
-static char *developer_dir = NULL;
-static char *current_sdk = NULL;
-static char *current_toolchain = NULL;
+/* Most tools (not counting target triple aliases) a --materialize directory holds */
+#define MATERIALIZE_MAX_TOOLS 1024
 
-/* Alternate behavior flags */
-static char *alternate_sdk_path = NULL;
-static char *alternate_toolchain_path = NULL;
+/* Most distinct tools --exec-batch remembers the paths of */
+#define BATCH_MAX_TOOLS 64
+
+/* Output mode flags */
+static int logging_mode = 0;
+static int show_format = SHOW_FORMAT_TEXT;
+
+/* Architectures given with --arch, NULL if none */
+static const char *requested_archs = NULL;
 
 /* Ways that this tool may be called */
-static const char *multicall_tool_names[4] = {
+static const char *multicall_tool_names[5] = {
 	"xcrun",
 	"xcrun_log",
 	"xcrun_verbose",
-	"xcrun_nocache"
+	"xcrun_nocache",
+	"xcrun-tool"
 };
 
 /* Our program's name as called by the user */
 static char *progname;
 
-/* helper function to strip file extensions */
-static void stripext(char *dst, const char *src)
-{
-	int len;
-	char *s;
-
-	if ((s = strchr(src, '.')) != NULL)
-		len = (s - src);
-	else
-		len = strlen(src);
-
-	strncpy(dst, src, len);
-}
-
-/* helper function to test for the authenticity of an sdk */
-static int test_sdk_authenticity(const char *path)
-{
-	int retval = 0;
-	char *fname = NULL;
-
-	fname = (char *)malloc(PATH_MAX - 1);
-
-	sprintf(fname, "%s/info.ini", path);
-	if (access(fname, F_OK) != (-1))
-		retval = 1;
-
-	free(fname);
-
-	return retval;
-}
-
 /**
- * @func verbose_printf -- Print output to fp in verbose mode.
+ * @func logging_printf -- Print output to fp in logging mode.
  * @arg fp - pointer to file (file, stderr, or stdio)
  * @arg str - string to print
  * @arg ... - additional arguments used
  */
-static void verbose_printf(FILE *fp, const char *str, ...)
+static void logging_printf(FILE *fp, const char *str, ...)
 {
 	va_list args;
 
-	if (verbose_mode == 1) {
+	if (logging_mode == 1) {
 		va_start(args, str);
 		vfprintf(fp, str, args);
 		va_end(args);
@@ -149,20 +132,12 @@ static void verbose_printf(FILE *fp, const char *str, ...)
 }
 
 /**
- * @func logging_printf -- Print output to fp in logging mode.
- * @arg fp - pointer to file (file, stderr, or stdio)
- * @arg str - string to print
- * @arg ... - additional arguments used
+ * @func report_fs_calls -- Print the number of filesystem calls made so far in verbose mode.
  */
-static void logging_printf(FILE *fp, const char *str, ...)
+static void report_fs_calls(void)
 {
-	va_list args;
-
-	if (logging_mode == 1) {
-		va_start(args, str);
-		vfprintf(fp, str, args);
-		va_end(args);
-	}
+	verbose_printf(stdout, "xcrun: info: resolution took %u filesystem calls (%u stat, %u access, %u open, %u read, %u write, %u other) and %u path lookups.\n",
+		fs_total(), fs_count.stat, fs_count.access, fs_count.open, fs_count.read, fs_count.write, fs_count.other, fs_count.lookups);
 }
 
 /**
@@ -182,20 +157,32 @@ static void usage(void)
 		"  -h, --help                   show this help message and exit\n"
 		"  --version                    show the xcrun version\n"
 		"  -v, --verbose                show verbose logging output\n"
-		"  --sdk <sdk name>             find the tool for the given SDK name\n"
+		"  --sdk <sdk name>             find the tool for the given SDK name (or the newest SDK it is part of)\n"
 		"  --toolchain <name>           find the tool for the given toolchain\n"
 		"  -l, --log                    show commands to be executed (with --run)\n"
-		"  -f, --find                   only find and print the tool path\n"
+		"  -f, --find                   only find and print the tool path (or the path of each tool named)\n"
+		"  --find-all                   find each tool named on stdin (one per line), printing '-' for a miss\n"
 		"  -r, --run                    find and execute the tool (the default behavior)\n"
-#if 0
-		"  -n, --no-cache               do not use the lookup cache (not implemented yet - does nothing)\n"
-		"  -k, --kill-cache             invalidate all existing cache entries (not implemented yet - does nothing)\n"
-#endif
+		"  -n, --no-cache               do not use the lookup cache\n"
+		"  -k, --kill-cache             invalidate all existing cache entries\n"
 		"  --show-sdk-path              show selected SDK install path\n"
 		"  --show-sdk-version           show selected SDK version\n"
 		"  --show-sdk-target-triple     show selected SDK target triple\n"
 		"  --show-sdk-toolchain-path    show selected SDK toolchain path\n"
-		"  --show-sdk-toolchain-version show selected SDK toolchain version\n\n"
+		"  --show-sdk-toolchain-version show selected SDK toolchain version\n"
+		"  --show-sdks                  list every SDK and toolchain with its name, version, toolchain and target triple\n"
+		"  --show-format <format>       print --show-* fields (and the --find result) as text, lines, nul or sh\n"
+		"  --daemon                     resolve other xcrun calls from memory until interrupted\n"
+		"  --export-env <format>        print the environment tools are called with as sh, make or json\n"
+		"  --trace-timing               print a JSON timing record for this call to stderr (see XCRUN_TRACE)\n"
+		"  --rebuild-registry           compile every SDK and toolchain info.ini into ~/.xcrun.registry\n"
+		"  --warm                       rebuild the registry and index every tool directory ahead of a build\n"
+		"  --exec-batch                 run NUL separated commands read from stdin (see -j)\n"
+		"  -j <jobs>                    run at most <jobs> --exec-batch commands at once (default: make's jobserver)\n"
+		"  --materialize <dir>          link every tool of the selected SDK and toolchain into <dir>\n"
+		"  --arch <arch,...>            show the target triple of each of these architectures (\"all\" for\n"
+		"                               every architecture of the SDK) with --show-sdk-target-triple\n"
+		"  --stats                      summarize the calls recorded in XCRUN_LOG_FILE\n\n"
 		, progname);
 
 	exit(0);
@@ -211,596 +198,1131 @@ static void version(void)
 }
 
 /**
- * @func validate_directory_path -- validate if requested directory path exists
- * @arg dir - directory to validate
- * @return: 0 on success, -1 on failure
+ * @func rebuild_registry -- Compile xcrun.ini and every sdk's and toolchain's info.ini in the developer dir into the registry.
  */
-static int validate_directory_path(const char *dir)
+static void rebuild_registry(void)
 {
-	struct stat fstat;
-	int retval = -1;
+	registry_contents contents;
 
-	if (stat(dir, &fstat) != 0)
-		fprintf(stderr, "xcrun: error: unable to validate path \'%s\' (errno=%s)\n", dir, strerror(errno));
-	else {
-		if (S_ISDIR(fstat.st_mode) == 0)
-			fprintf(stderr, "xcrun: error: \'%s\' is not a valid path\n", dir);
-		else
-			retval = 0;
+	if (developer_dir == NULL && (developer_dir = find_developer_dir()) == NULL)
+		exit(1);
+
+	scan_developer_dir(&contents);
+
+	if (registry_write(&contents) != 0) {
+		fprintf(stderr, "xcrun: error: failed to write sdk and toolchain registry. (errno=%s)\n", strerror(errno));
+		exit(1);
 	}
 
-	return retval;
+	verbose_printf(stdout, "xcrun: info: registered %d sdk(s) and %d toolchain(s) in \'%s\'.\n", contents.nsdks, contents.ntoolchains, developer_dir);
 }
 
 /**
- * @func toolchain_cfg_handler -- handler used to process toolchain info.ini contents
- * @arg user - ini user pointer (see ini.h)
- * @arg section - ini section name (see ini.h)
- * @arg name - ini variable name (see ini.h)
- * @arg value - ini variable value (see ini.h)
- * @return: 1 on success, 0 on failure
+ * @func warm_developer_dir -- Compile the registry and index every usr/bin in the developer dir ahead of the first build.
  */
-static int toolchain_cfg_handler(void *user, const char *section, const char *name, const char *value)
+static void warm_developer_dir(void)
 {
-	toolchain_config *config = (toolchain_config *)user;
+	int i;
+	int pass;
+	int ndirs = 0;
+	int nracy = 0;
+	int nbundles;
+	char *bundles[REGISTRY_MAX_ENTRIES];
+	const char **dirs = NULL;
 
-	if (MATCH_INI_STON("TOOLCHAIN", "name"))
-		config->name = strdup(value);
-	else if (MATCH_INI_STON("TOOLCHAIN", "version"))
-		config->version = strdup(value);
-	else
-		return 0;
+	rebuild_registry();
+
+	dirs = (const char **)arena_alloc(((REGISTRY_MAX_ENTRIES * 2) + 2) * sizeof(char *));
+	dirs[ndirs++] = arena_printf("%s/usr/bin", developer_dir);
+
+	nbundles = list_bundles(arena_printf("%s/SDKs", developer_dir), ".sdk", bundles, REGISTRY_MAX_ENTRIES);
+	for (i = 0; i < nbundles; i++)
+		dirs[ndirs++] = arena_printf("%s/usr/bin", bundles[i]);
+
+	nbundles = list_bundles(arena_printf("%s/Toolchains", developer_dir), ".toolchain", bundles, REGISTRY_MAX_ENTRIES);
+	for (i = 0; i < nbundles; i++)
+		dirs[ndirs++] = arena_printf("%s/usr/bin", bundles[i]);
 
-	return 1;
+	/* Compiler drivers fall back to the host's compiler. */
+	dirs[ndirs++] = COMPILER_HOST_DIR;
+
+	/* A developer dir installed a moment ago is too new to be indexed, so wait for it once. */
+	for (pass = 0; pass < 2; pass++) {
+		nracy = cache_dir_warm(dirs, ndirs);
+		if (nracy == 0 || pass == 1)
+			break;
+		verbose_printf(stdout, "xcrun: info: %d directories changed just now, waiting before indexing them...\n", nracy);
+		sleep(2);
+	}
+
+	if (cache_dir_save() != 0) {
+		fprintf(stderr, "xcrun: error: failed to write directory index. (errno=%s)\n", strerror(errno));
+		exit(1);
+	}
+
+	verbose_printf(stdout, "xcrun: info: indexed %d directories in \'%s\'.\n", ndirs - nracy, developer_dir);
 }
 
 /**
- * @func sdk_cfg_handler -- handler used to process sdk info.ini contents
- * @arg user - ini user pointer (see ini.h)
- * @arg section - ini section name (see ini.h)
- * @arg name - ini variable name (see ini.h)
- * @arg value - ini variable value (see ini.h)
- * @return: 1 on success, 0 on failure
+ * @func query_daemon -- Ask the resolver daemon, if one is running, to resolve a request.
+ * @arg name - program's name, or NULL for sdk and toolchain information only
+ * @arg reply - the daemon's answer
+ * @return: 0 if the daemon answered, -1 if we have to resolve the request ourselves
  */
-static int sdk_cfg_handler(void *user, const char *section, const char *name, const char *value)
+static int query_daemon(const char *name, daemon_reply *reply)
 {
-	sdk_config *config = (sdk_config *)user;
-
-	if (MATCH_INI_STON("SDK", "name"))
-		config->name = strdup(value);
-	else if (MATCH_INI_STON("SDK", "version"))
-		config->version = strdup(value);
-	else if (MATCH_INI_STON("SDK", "toolchain"))
-		config->toolchain = strdup(value);
-	else if (MATCH_INI_STON("SDK", "default_arch"))
-		config->default_arch = strdup(value);
-	else if (MATCH_INI_STON("SDK", "ios_deployment_target")) {
-		ios_deployment_target_set = 1;
-		macosx_deployment_target_set = 0;
-		config->deployment_target = strdup(value);
-	} else if (MATCH_INI_STON("SDK", "macosx_deployment_target")) {
-		ios_deployment_target_set = 0;
-		macosx_deployment_target_set = 1;
-		config->deployment_target = strdup(value);
-	} else
-		return 0;
+	int retval;
+	daemon_query query;
+	trace_span span;
+
+	/* The daemon is a cache too, and it would hide what verbose mode is supposed to show. */
+	if (nocache_mode == 1 || verbose_mode == 1)
+		return -1;
+
+	query.home = getenv("HOME");
+	query.developer_dir = getenv("DEVELOPER_DIR");
+	query.sdkroot = getenv("SDKROOT");
+	query.toolchains = getenv("TOOLCHAINS");
+	query.mode = (explicit_sdk_mode ? SEARCH_EXPLICIT_SDK : 0) | (explicit_toolchain_mode ? SEARCH_EXPLICIT_TOOLCHAIN : 0) | (current_driver ? SEARCH_COMPILER_DRIVER : 0);
+	query.sdk = (explicit_sdk_mode == 1) ? current_sdk : NULL;
+	query.toolchain = (explicit_toolchain_mode == 1) ? current_toolchain : NULL;
+	query.alternate_sdk = alternate_sdk_path;
+	query.alternate_toolchain = alternate_toolchain_path;
+	query.driver = (current_driver != NULL) ? current_driver->name : NULL;
+	query.tool = name;
+
+	span = trace_begin();
+	retval = daemon_resolve(&query, reply);
+	trace_end(span, "daemon_query", name);
+
+	if (retval != 0)
+		return -1;
+
+	/* Adopt the daemon's selection, as if we had made it ourselves. */
+	developer_dir = arena_strdup(reply->developer_dir);
+	(void)store_set_shared(getenv(XCRUN_CACHE_DIR_ENV), developer_dir);
+	current_sdk = (reply->sdk != NULL) ? arena_strdup(reply->sdk) : NULL;
+	current_toolchain = (reply->toolchain != NULL) ? arena_strdup(reply->toolchain) : NULL;
+
+	return 0;
+}
+
+/**
+ * @func print_sh_quoted -- Print a value single quoted, so a shell can eval it as is.
+ * @arg value - value to print
+ */
+static void print_sh_quoted(const char *value)
+{
+	const char *p = NULL;
 
-	return 1;
+	fputc('\'', stdout);
+	for (p = value; *p != '\0'; p++) {
+		if (*p == '\'')
+			fputs("'\\''", stdout);
+		else
+			fputc(*p, stdout);
+	}
+	fputc('\'', stdout);
 }
 
 /**
- * @func default_cfg_handler -- handler used to process xcrun's xcrun.ini contents
- * @arg user - ini user pointer (see ini.h)
- * @arg section - ini section name (see ini.h)
- * @arg name - ini variable name (see ini.h)
- * @arg value - ini variable value (see ini.h)
- * @return: 1 on success, 0 on failure
+ * @func value_key -- Build the shell variable name for one of several values of the same kind.
+ * @arg buf - buffer for the name
+ * @arg size - size of buf
+ * @arg prefix - name of the kind of value
+ * @arg name - which value of that kind it is
+ * @return: buf, holding <prefix>_<name> with anything that can't be in a variable name replaced by '_'
  */
-static int default_cfg_handler(void *user, const char *section, const char *name, const char *value)
+static char *value_key(char *buf, size_t size, const char *prefix, const char *name)
 {
-	default_config *config = (default_config *)user;
+	char *p = NULL;
 
-	if (MATCH_INI_STON("SDK", "name"))
-		config->sdk = strdup(value);
-	else if (MATCH_INI_STON("TOOLCHAIN", "name"))
-		config->toolchain = strdup(value);
-	else
-		return 0;
+	snprintf(buf, size, "%s_%s", prefix, name);
+	for (p = buf; *p != '\0'; p++) {
+		if (isalnum((unsigned char)*p) == 0)
+			*p = '_';
+	}
 
-	return 1;
+	return buf;
 }
 
 /**
- * @func get_toolchain_info -- fetch config info from a toolchain's info.ini
- * @arg path - path to toolchain's info.ini
- * @return: struct containing toolchain config info
+ * @func print_value -- Print a resolved value in the requested --show-format.
+ * @arg key - name of the value, used for shell assignments
+ * @arg raw - the value itself
+ * @arg text - human readable form of the value
  */
-static toolchain_config get_toolchain_info(const char *path)
+static void print_value(const char *key, const char *raw, const char *text)
 {
-	toolchain_config config;
-	char *info_path = NULL;
-
-	info_path = (char *)malloc(PATH_MAX - 1);
-	sprintf(info_path, "%s/info.ini", path);
-
-	if (ini_parse(info_path, toolchain_cfg_handler, &config) != (-1)) {
-		free(info_path);
-		return config;
-	} else {
-		fprintf(stderr, "xcrun: error: failed to retrieve toolchain info from '\%s\'. (errno=%s)\n", info_path, strerror(errno));
-		free(info_path);
-		exit(1);
+	if (raw == NULL)
+		raw = "";
+
+	switch (show_format) {
+		case SHOW_FORMAT_LINES:
+			fprintf(stdout, "%s\n", raw);
+			break;
+		case SHOW_FORMAT_NUL:
+			fputs(raw, stdout);
+			fputc('\0', stdout);
+			break;
+		case SHOW_FORMAT_SH:
+			fprintf(stdout, "%s=", key);
+			print_sh_quoted(raw);
+			fputc('\n', stdout);
+			break;
+		case SHOW_FORMAT_TEXT:
+		default:
+			fprintf(stdout, "%s\n", (text != NULL) ? text : raw);
+			break;
 	}
 }
 
 /**
- * @func get_sdk_info -- fetch config info from a toolchain's info.ini
- * @arg path - path to sdk's info.ini
- * @return: struct containing sdk config info
+ * @func show_field -- Print one of the fields requested with the --show-* options.
+ * @arg field - field to print (SHOW_*)
+ * @arg reply - sdk and toolchain information resolved by the daemon, NULL to resolve it here
  */
-static sdk_config get_sdk_info(const char *path)
+static void show_field(int field, const daemon_reply *reply)
 {
-	sdk_config config;
-	char *info_path = NULL;
-
-	info_path = (char *)malloc(PATH_MAX - 1);
-	sprintf(info_path, "%s/info.ini", path);
-
-	if (ini_parse(info_path, sdk_cfg_handler, &config) != (-1)) {
-		free(info_path);
-		return config;
-	} else {
-		fprintf(stderr, "xcrun: error: failed to retrieve sdk info from '\%s\'. (errno=%s)\n", info_path, strerror(errno));
-		free(info_path);
-		exit(1);
+	int i;
+	int narchs;
+	char text[PATH_MAX];
+	char *archs[ARCH_MAX];
+	char *triples[ARCH_MAX];
+	const char *triple = NULL;
+	const char *sdk_path = NULL;
+	sdk_config sdk;
+	toolchain_config toolchain;
+
+	if (reply != NULL) {
+		sdk.name = reply->sdk_name;
+		sdk.version = reply->sdk_version;
+		toolchain.name = reply->toolchain_name;
+		toolchain.version = reply->toolchain_version;
 	}
+
+	switch (field) {
+		case SHOW_SDK_PATH:
+			print_value("SDK_PATH", (reply != NULL) ? reply->entry.sdk_path : get_sdk_path(current_sdk), NULL);
+			break;
+		case SHOW_SDK_VERSION:
+			if (reply == NULL)
+				sdk = get_sdk_info(get_sdk_path(current_sdk));
+			snprintf(text, sizeof(text), "%s SDK version %s", sdk.name, sdk.version);
+			print_value("SDK_VERSION", sdk.version, text);
+			break;
+		case SHOW_SDK_TARGET_TRIPLE:
+			if (reply == NULL || (triple = getenv("TARGET_TRIPLE")) == NULL)
+				triple = (reply != NULL) ? reply->entry.target_triple : get_target_triple(current_sdk);
+			if (requested_archs == NULL) {
+				print_value("SDK_TARGET_TRIPLE", triple, NULL);
+				break;
+			}
+			/* With --arch, every requested triple is printed in one go. */
+			if (reply != NULL) {
+				sdk_path = reply->entry.sdk_path;
+				sdk.deployment_target = reply->entry.deployment_target;
+			} else {
+				sdk_path = get_sdk_path(current_sdk);
+				sdk = get_sdk_info(sdk_path);
+			}
+			narchs = arch_target_triples(requested_archs, sdk_path, triple, sdk.deployment_target, archs, triples);
+			for (i = 0; i < narchs; i++)
+				print_value(value_key(text, sizeof(text), "SDK_TARGET_TRIPLE", archs[i]), triples[i], NULL);
+			break;
+		case SHOW_SDK_TOOLCHAIN_PATH:
+			print_value("SDK_TOOLCHAIN_PATH", (reply != NULL) ? reply->entry.toolchain_path : get_toolchain_path(current_toolchain), NULL);
+			break;
+		case SHOW_SDK_TOOLCHAIN_VERSION:
+			if (reply == NULL) {
+				sdk = get_sdk_info(get_sdk_path(current_sdk));
+				toolchain = get_toolchain_info(get_toolchain_path(current_toolchain));
+			}
+			snprintf(text, sizeof(text), "%s SDK Toolchain version %s (%s)", sdk.name, toolchain.version, toolchain.name);
+			print_value("SDK_TOOLCHAIN_VERSION", toolchain.version, text);
+			break;
+	}
+}
+
+/* helper function to print an optional field of --show-sdks */
+static const char *field(const char *value)
+{
+	return (value != NULL) ? value : "-";
 }
 
 /**
- * @func get_default_info -- fetch default configuration for xcrun
- * @arg path - path to xcrun.ini
- * @return: struct containing default config info
+ * @func show_sdks -- Print every sdk and toolchain in the developer dir, for --show-sdks.
  */
-static default_config get_default_info(const char *path)
+static void show_sdks(void)
 {
-	default_config config;
-
-	if (ini_parse(path, default_cfg_handler, &config) != (-1))
-		return config;
-	else {
-		fprintf(stderr, "xcrun: error: failed to retrieve default info from '\%s\'. (errno=%s)\n", path, strerror(errno));
+	int i;
+	char key[PATH_MAX];
+	char *name = NULL;
+	const char *base = NULL;
+	const registry_sdk *sdk = NULL;
+	const registry_toolchain *toolchain = NULL;
+	const registry_contents *contents = NULL;
+
+	if (developer_dir == NULL && (developer_dir = find_developer_dir()) == NULL)
 		exit(1);
+
+	contents = get_developer_dir_contents();
+
+	for (i = 0; i < contents->nsdks; i++) {
+		sdk = &contents->sdks[i];
+		base = ((base = strrchr(sdk->path, '/')) != NULL) ? base + 1 : sdk->path;
+		name = stripext(base, ".sdk");
+		if (show_format == SHOW_FORMAT_SH) {
+			print_value(value_key(key, sizeof(key), "SDK_PATH", name), sdk->path, NULL);
+			print_value(value_key(key, sizeof(key), "SDK_NAME", name), sdk->name, NULL);
+			print_value(value_key(key, sizeof(key), "SDK_VERSION", name), sdk->version, NULL);
+			print_value(value_key(key, sizeof(key), "SDK_TOOLCHAIN", name), sdk->toolchain, NULL);
+			print_value(value_key(key, sizeof(key), "SDK_TARGET_TRIPLE", name), sdk->target_triple, NULL);
+		} else {
+			print_value(NULL, arena_printf("sdk\t%s\t%s\t%s\t%s\t%s\t%s", name, field(sdk->name), field(sdk->version), field(sdk->toolchain), field(sdk->target_triple), sdk->path),
+				    arena_printf("%s: %s SDK version %s, toolchain %s, target %s", base, field(sdk->name), field(sdk->version), field(sdk->toolchain), field(sdk->target_triple)));
+		}
+	}
+
+	for (i = 0; i < contents->ntoolchains; i++) {
+		toolchain = &contents->toolchains[i];
+		base = ((base = strrchr(toolchain->path, '/')) != NULL) ? base + 1 : toolchain->path;
+		name = stripext(base, ".toolchain");
+		if (show_format == SHOW_FORMAT_SH) {
+			print_value(value_key(key, sizeof(key), "TOOLCHAIN_PATH", name), toolchain->path, NULL);
+			print_value(value_key(key, sizeof(key), "TOOLCHAIN_NAME", name), toolchain->name, NULL);
+			print_value(value_key(key, sizeof(key), "TOOLCHAIN_VERSION", name), toolchain->version, NULL);
+		} else {
+			print_value(NULL, arena_printf("toolchain\t%s\t%s\t%s\t%s", name, field(toolchain->name), field(toolchain->version), toolchain->path),
+				    arena_printf("%s: %s Toolchain version %s", base, field(toolchain->name), field(toolchain->version)));
+		}
 	}
 }
 
 /**
- * @func get_developer_path -- retrieve current developer path
- * @return: string of current path on success, NULL string on failure
+ * @func strip_target_triple -- Strip the current sdk's target triple off a tool name.
+ * @arg name - tool name, possibly of the form <target triple>-<tool>
+ * @return: the tool name without the target triple, or name if it doesn't start with the triple
  */
-static char *get_developer_path(void)
+static char *strip_target_triple(char *name)
 {
-	FILE *fp = NULL;
-	char devpath[PATH_MAX - 1];
-	char *pathtocfg = NULL;
-	char *cfg_path = NULL;
-	char *value = NULL;
+	const char *triple = NULL;
+	daemon_reply reply;
+	size_t len;
 
-	verbose_printf(stdout, "xcrun: info: attempting to retrieve developer path from DEVELOPER_DIR...\n");
+	/* Don't bother resolving the sdk for names that can't carry a darwin triple. */
+	if (strstr(name, "-apple-darwin") == NULL)
+		return name;
 
-	if ((value = getenv("DEVELOPER_DIR")) != NULL) {
-		verbose_printf(stdout, "xcrun: info: using developer path \'%s\' from DEVELOPER_DIR.\n", value);
-		return value;
+	if ((triple = getenv("TARGET_TRIPLE")) == NULL) {
+		if (query_daemon(NULL, &reply) == 0)
+			triple = reply.entry.target_triple;
+		else {
+			select_sdk_and_toolchain();
+			triple = get_target_triple(current_sdk);
+		}
 	}
 
-	bzero(devpath, (PATH_MAX - 1));
+	if (triple == NULL)
+		return name;
 
-	verbose_printf(stdout, "xcrun: info: attempting to retrieve developer path from configuration cache...\n");
-	if ((pathtocfg = getenv("HOME")) == NULL) {
-		fprintf(stderr, "xcrun: error: failed to read HOME variable.\n");
-		return NULL;
+	len = strlen(triple);
+	if (strncmp(name, triple, len) == 0 && name[len] == '-' && name[len + 1] != '\0') {
+		verbose_printf(stdout, "xcrun: info: stripped target triple \'%s\' from \'%s\'.\n", triple, name);
+		return (name + len + 1);
 	}
 
-	cfg_path = (char *)malloc((strlen(pathtocfg) + sizeof(SDK_CFG)));
+	return name;
+}
 
-	sprintf(cfg_path, "%s/%s", pathtocfg, SDK_CFG);
+/**
+ * @func call_command -- Execute new process to replace this one.
+ * @arg cmd - program's absolute path
+ * @arg launcher - absolute path of a program to run cmd through (e.g. ccache), or NULL
+ * @arg env_info - resolved sdk and toolchain information to pass to the program
+ * @arg argc - number of arguments to be passed to new process
+ * @arg argv - arguments to be passed to new process
+ * @return: -1 on error, otherwise no return
+ */
+static int call_command(const char *cmd, const char *launcher, const cache_entry *env_info, int argc, char *argv[])
+{
+	int i;
+	int nvars;
+	env_var vars[ENV_VARS];
+	char **envp = NULL;
+	char **args = NULL;
+	trace_span span = trace_begin();
+
+	nvars = build_environment(env_info, vars, 1);
+	envp = pack_environment(vars, nvars, arena_alloc(environment_size(vars, nvars)));
+
+	trace_end(span, "environment", NULL);
+
+	/* launcher cmd args... */
+	if (launcher != NULL) {
+		args = (char **)arena_alloc((argc + 2) * sizeof(char *));
+		args[0] = (char *)launcher;
+		args[1] = (char *)cmd;
+		for (i = 1; i < argc; i++)
+			args[i + 1] = argv[i];
+		args[++argc] = NULL;
+		argv = args;
+		cmd = launcher;
+	}
 
-	if ((fp = fopen(cfg_path, "r")) != NULL) {
-		fseek(fp, 0, SEEK_SET);
-		(void)fread(devpath, (PATH_MAX - 1), 1, fp);
-		value = devpath;
-		fclose(fp);
-	} else {
-		fprintf(stderr, "xcrun: error: unable to read configuration cache. (errno=%s)\n", strerror(errno));
-		return NULL;
+	if (logging_mode == 1) {
+		logging_printf(stdout, "xcrun: info: invoking command:\n\t\"%s", cmd);
+		for (i = 1; i < argc; i++)
+			logging_printf(stdout, " %s", argv[i]);
+		logging_printf(stdout, "\"\n");
 	}
 
-	verbose_printf(stdout, "xcrun: info: using developer path \'%s\' from configuration cache.\n", value);
+	report_fs_calls();
+
+	/* The exec itself can only be timestamped, the trace has to be out before it happens. */
+	span = trace_begin();
+	trace_end(span, "execve", cmd);
+	trace_flush();
 
-	free(cfg_path);
+	/* Anything still buffered would be lost once we exec. */
+	fflush(stdout);
 
-	return value;
+	return execve(cmd, argv, envp);
 }
 
 /**
- * @func get_toolchain_path -- Return the specified toolchain path
- * @arg name - name of the toolchain
- * @return: absolute path of toolchain on success, exit on failure
+ * @func print_json_string -- Print a string as a quoted JSON string.
+ * @arg str - string to print
  */
-static char *get_toolchain_path(const char *name)
+static void print_json_string(const char *str)
 {
-	char *path = NULL;
-	char *devpath = NULL;
+	const char *p = NULL;
+
+	fputc('"', stdout);
+	for (p = str; *p != '\0'; p++) {
+		if (*p == '"' || *p == '\\')
+			fprintf(stdout, "\\%c", *p);
+		else if ((unsigned char)*p < 0x20)
+			fprintf(stdout, "\\u%04x", (unsigned char)*p);
+		else
+			fputc(*p, stdout);
+	}
+	fputc('"', stdout);
+}
 
-	devpath = developer_dir;
-	path = (char *)malloc(PATH_MAX - 1);
+/**
+ * @func print_make_value -- Print a value so make assigns it literally.
+ * @arg value - value to print
+ */
+static void print_make_value(const char *value)
+{
+	const char *p = NULL;
 
-	if (devpath != NULL) {
-		sprintf(path, "%s/Toolchains/%s.toolchain", devpath, name);
-		if (validate_directory_path(path) != (-1))
-			return path;
-		else {
-			fprintf(stderr, "xcrun: error: \'%s\' is not a valid toolchain path.\n", path);
-			free(path);
-			exit(1);
-		}
-	} else {
-		fprintf(stderr, "xcrun: error: failed to retrieve developer path, do you have it set?\n");
-		free(path);
-		exit(1);
+	for (p = value; *p != '\0'; p++) {
+		if (*p == '$')
+			fputs("$$", stdout);
+		else if (*p == '#')
+			fputs("\\#", stdout);
+		else
+			fputc(*p, stdout);
 	}
 }
 
 /**
- * @func get_sdk_path -- Return the specified sdk path
- * @arg name - name of the sdk
- * @return: absolute path of sdk on success, exit on failure
+ * @func show_stats -- Summarize the records xcrun calls appended to XCRUN_LOG_FILE.
  */
-static char *get_sdk_path(const char *name)
+static void show_stats(void)
 {
-	char *path = NULL;
-	char *devpath = NULL;
+	const char *path = NULL;
 
-	devpath = developer_dir;
-	path = (char *)malloc(PATH_MAX - 1);
+	if ((path = getenv(XCRUN_LOG_FILE_ENV)) == NULL || *path == '\0') {
+		fprintf(stderr, "xcrun: error: --stats requires XCRUN_LOG_FILE to name the log to summarize.\n");
+		exit(1);
+	}
 
-	if (devpath != NULL) {
-		sprintf(path, "%s/SDKs/%s.sdk", devpath, name);
-		if (validate_directory_path(path) != (-1))
-			return path;
-		else {
-			fprintf(stderr, "xcrun: error: \'%s\' is not a valid sdk path.\n", path);
-			free(path);
-			exit(1);
-		}
-	} else {
-		fprintf(stderr, "xcrun: error: failed to retrieve developer path, do you have it set?\n");
-		free(path);
+	if (trace_report(path, stdout, STATS_SHOWN) != 0) {
+		fprintf(stderr, "xcrun: error: failed to read \'%s\'. (errno=%s)\n", path, strerror(errno));
 		exit(1);
 	}
 }
 
 /**
- * @func parse_target_triple -- Generate target triple by parsing iOS/MacOSX version and cpu architecture
- * @arg triple - buffer to place the target triple
- * @arg ver - Mac OSX or iOS version
- * @arg arch - Mac OSX or iOS cpu architecture
+ * @func export_environment -- Print the environment call_command would pass, for use without xcrun.
+ * @arg format - syntax to print it in (EXPORT_FORMAT_*)
  */
-static void parse_target_triple(char *triple, const char *ver, const char *arch)
+static void export_environment(int format)
 {
-	int where = 1;
-	int xx, yy, zz, ch, kern_ver;
+	int i;
+	int nvars;
+	env_var vars[ENV_VARS];
+	cache_entry entry;
+	daemon_reply reply;
 
-	if (ver == NULL)
-		return;
+	if (query_daemon(NULL, &reply) == 0)
+		entry = reply.entry;
+	else {
+		select_sdk_and_toolchain();
+		memset(&entry, 0, sizeof(entry));
+		resolve_environment(&entry);
+	}
 
-	xx = yy = zz = 0;
-
-	do {
-		ch = (int)*ver;
-
-		switch (ch) {
-			case '9':
-			case '8':
-			case '7':
-			case '6':
-			case '5':
-			case '4':
-			case '3':
-			case '2':
-			case '1':
-			case '0':
-				{
-					switch (where) {
-						case 1: /* major */
-							xx *= 10;
-							xx += (ch - '0');
-							break;
-						case 2: /* minor */
-							yy *= 10;
-							yy += (ch - '0');
-							break;
-						case 3: /* patch */
-							zz *= 10;
-							zz += (ch - '0');
-						default:
-							break;
-					}
-					break;
-				}
-			case '.':
+	nvars = build_environment(&entry, vars, 0);
+
+	if (format == EXPORT_FORMAT_JSON)
+		fputs("{\n", stdout);
+
+	for (i = 0; i < nvars; i++) {
+		switch (format) {
+			case EXPORT_FORMAT_MAKE:
+				fprintf(stdout, "export %s := ", vars[i].name);
+				print_make_value(vars[i].value);
+				fputc('\n', stdout);
+				break;
+			case EXPORT_FORMAT_JSON:
+				fputs("\t", stdout);
+				print_json_string(vars[i].name);
+				fputs(": ", stdout);
+				print_json_string(vars[i].value);
+				fputs((i < (nvars - 1)) ? ",\n" : "\n", stdout);
+				break;
+			case EXPORT_FORMAT_SH:
 			default:
-				where++;
+				fprintf(stdout, "export %s=", vars[i].name);
+				print_sh_quoted(vars[i].value);
+				fputc('\n', stdout);
 				break;
 		}
-	} while (*ver++ != '\0');
+	}
 
-	switch (xx) {
-		case 10:
-			kern_ver = (yy + 4);
-			break;
-		case 9:
-		case 8:
-			kern_ver = 14;
-			break;
-		case 7:
-			kern_ver = 14;
-			break;
-		case 6:
-			kern_ver = 13;
-			break;
-		case 5:
-			kern_ver = 11;
-			break;
-		case 4:
-			{
-				if (yy <= 2)
-					kern_ver = 10;
-				else
-					kern_ver = 11;
-				break;
-			}
-		case 3:
-			kern_ver = 10;
-			break;
-		case 2:
-			kern_ver = 9;
-			break;
-		case 1:
-		default:
-			kern_ver = 9;
-			break;
+	if (format == EXPORT_FORMAT_JSON)
+		fputs("}\n", stdout);
+}
+
+/**
+ * @func compiler_driver_args -- Build the arguments for the compiler behind a compiler driver.
+ * @arg cmd - compiler's absolute path
+ * @arg env_info - resolved sdk and toolchain information
+ * @arg argc - number of arguments given to the driver, updated to the new count
+ * @arg argv - arguments given to the driver
+ * @return: arguments to pass to the compiler
+ */
+static char **compiler_driver_args(const char *cmd, const cache_entry *env_info, int *argc, char *argv[])
+{
+	int i;
+	int nargs = 0;
+	int narchs = 0;
+	char **args = NULL;
+	char *list = NULL;
+	char *archs[ARCH_MAX];
+	char *triples[ARCH_MAX];
+	const char *target_triple = NULL;
+
+	if ((target_triple = getenv("TARGET_TRIPLE")) == NULL)
+		target_triple = env_info->target_triple;
+
+	/* Any -arch flags decide the target triple. */
+	list = "";
+	for (i = 1; i < *argc; i++) {
+		if (strcmp(argv[i], "-arch") == 0 && (i + 1) < *argc)
+			list = arena_printf("%s %s", list, argv[++i]);
+	}
+	if (*list != '\0' && (narchs = arch_target_triples(list, env_info->sdk_path, target_triple, env_info->deployment_target, archs, triples)) > 0)
+		target_triple = triples[0];
+
+	/* cmd -target <triple> [-arch <arch>...] -isysroot <sdk> -B<toolchain>/usr/bin [-E] args... */
+	args = (char **)arena_alloc((*argc + 8 + (2 * narchs)) * sizeof(char *));
+
+	args[nargs++] = (char *)cmd;
+
+	if (target_triple != NULL) {
+		args[nargs++] = "-target";
+		args[nargs++] = (char *)target_triple;
+	} else
+		fprintf(stderr, "xcrun: warning: failed to retrieve target triple information for %s.sdk.\n", current_sdk);
+
+	/* A single arch is all in the triple, a universal build lets clang's darwin driver fan out. */
+	if (narchs > 1) {
+		for (i = 0; i < narchs; i++) {
+			args[nargs++] = "-arch";
+			args[nargs++] = archs[i];
+		}
 	}
 
-	sprintf(triple, "%s-apple-darwin%d", arch, kern_ver);
+	args[nargs++] = "-isysroot";
+	args[nargs++] = (char *)env_info->sdk_path;
+
+	args[nargs++] = arena_printf("-B%s/usr/bin", env_info->toolchain_path);
+
+	if (current_driver->preprocess_only == 1)
+		args[nargs++] = "-E";
+
+	for (i = 1; i < *argc; i++) {
+		if (narchs > 0 && strcmp(argv[i], "-arch") == 0 && (i + 1) < *argc)
+			i++;
+		else
+			args[nargs++] = argv[i];
+	}
 
-	return;
+	args[nargs] = NULL;
+	*argc = nargs;
+
+	return args;
 }
 
 /**
- * @func get_target_triple -- get the target triple for the current sdk.
- * @arg current_sdk - specified sdk (ignored if TARGET_TRIPLE env variable is set)
- * @return: target triple string or NULL on error
+ * @func compiler_launcher -- Find the XCRUN_LAUNCHER (e.g. ccache or sccache) to run a compiler through.
+ * @arg cmd - absolute path of the program about to be run
+ * @return: the launcher's absolute path, or NULL if cmd isn't a compiler, is xcrun itself or there is no launcher
  */
-static char *get_target_triple(const char *current_sdk)
+static const char *compiler_launcher(const char *cmd)
 {
-	char *triple = NULL;
-	char *default_arch = NULL;
-	char *deployment_target = NULL;
+	static int have_launcher = 0;
+	static char *launcher = NULL;
+	const char *name = NULL;
+	const char *path = NULL;
+	const char *end = NULL;
+	char *candidate = NULL;
+
+	if (get_compiler_driver(((name = strrchr(cmd, '/')) != NULL) ? name + 1 : cmd) == NULL)
+		return NULL;
 
-	if ((triple = getenv("TARGET_TRIPLE")) != NULL)
-		return triple;
-	else {
-		triple = (char *)malloc(64);
+	/* One of our own driver links (make install puts them in the Toolchain): the xcrun it runs will add the launcher. */
+	if (is_xcrun_binary(cmd) == 1)
+		return NULL;
+
+	if (have_launcher == 1)
+		return launcher;
+	have_launcher = 1;
+
+	if ((name = getenv("XCRUN_LAUNCHER")) == NULL || *name == '\0')
+		return NULL;
+
+	/* Bare names are looked up in the caller's PATH, just like a shell would. */
+	if (strchr(name, '/') != NULL) {
+		if (fs_access(name, X_OK) == 0)
+			launcher = arena_strdup(name);
+	} else if ((path = getenv("PATH")) != NULL) {
+		for (; launcher == NULL && *path != '\0'; path = (*end == ':') ? end + 1 : end) {
+			if ((end = strchr(path, ':')) == NULL)
+				end = path + strlen(path);
+			if (end == path)
+				continue;
+			candidate = arena_printf("%.*s/%s", (int)(end - path), path, name);
+			/* A ccache masquerading as the compiler would simply call us again. */
+			if (fs_access(candidate, X_OK) == 0 && is_xcrun_binary(candidate) == 0)
+				launcher = candidate;
+		}
+	}
+
+	if (launcher == NULL)
+		fprintf(stderr, "xcrun: warning: launcher \'%s\' not found, running the compiler directly.\n", name);
+	else
+		verbose_printf(stdout, "xcrun: info: running compilers through launcher \'%s\'.\n", launcher);
+
+	return launcher;
+}
+
+/**
+ * @func get_self_path -- Find the absolute path of the running xcrun binary.
+ * @return: the path on success, NULL on failure
+ */
+static char *get_self_path(void)
+{
+	char path[PATH_MAX];
+#ifdef __APPLE__
+	char resolved[PATH_MAX];
+	uint32_t size = sizeof(path);
+
+	if (_NSGetExecutablePath(path, &size) != 0 || realpath(path, resolved) == NULL)
+		return NULL;
+
+	return arena_strdup(resolved);
+#else
+	ssize_t len;
+
+	if ((len = readlink("/proc/self/exe", path, sizeof(path) - 1)) == -1)
+		return NULL;
+	path[len] = '\0';
+
+	return arena_strdup(path);
+#endif
+}
+
+/**
+ * @func materialize_link -- Point a link in a --materialize directory at target, replacing what was there.
+ * @arg dir - directory to create the link in
+ * @arg name - link's name
+ * @arg target - absolute path the link points to
+ * @return: 0 on success, -1 on failure
+ */
+static int materialize_link(const char *dir, const char *name, const char *target)
+{
+	char *path = arena_printf("%s/%s", dir, name);
+	char *tmp = arena_printf("%s/.%s.tmp", dir, name);
+
+	/* Build systems may be running tools from here, so a link is never missing, only replaced. */
+	(void)fs_unlink(tmp);
+	if (fs_symlink(target, tmp) != 0)
+		return -1;
+
+	if (fs_rename(tmp, path) != 0) {
+		(void)fs_unlink(tmp);
+		return -1;
+	}
 
-		if ((default_arch = strdup(get_sdk_info(get_sdk_path(current_sdk)).default_arch)) == NULL)
-			return NULL;
+	return 0;
+}
 
-		if ((deployment_target = strdup(get_sdk_info(get_sdk_path(current_sdk)).deployment_target)) == NULL)
-			return NULL;
+/**
+ * @func materialize_is_current -- Check whether a --materialize directory was made for the same selection.
+ * @arg stamp_path - directory's stamp file
+ * @arg header - first line that the stamp file should start with
+ * @return: 1 if the directory is up to date, 0 otherwise
+ */
+static int materialize_is_current(const char *stamp_path, const char *header)
+{
+	int current = 0;
+	size_t len = strlen(header);
+	char *data = NULL;
+	char *end = NULL;
+	cache_entry stamps;
 
-		parse_target_triple(triple, deployment_target, default_arch);
+	if ((data = fs_read_file(stamp_path, NULL)) == NULL)
+		return 0;
 
-		return triple;
+	/* The second line records the directories the links were made from. */
+	if (strncmp(data, header, len) == 0 && data[len] == '\n') {
+		if ((end = strchr(data + len + 1, '\n')) != NULL)
+			*end = '\0';
+		if (cache_parse_entry(data + len + 1, &stamps) == 0)
+			current = cache_entry_is_current(&stamps);
 	}
+
+	free(data);
+
+	return current;
 }
 
 /**
- * @func call_command -- Execute new process to replace this one.
- * @arg cmd - program's absolute path
- * @arg argc - number of arguments to be passed to new process
- * @arg argv - arguments to be passed to new process
- * @return: -1 on error, otherwise no return
+ * @func materialize -- Fill a directory with links to every tool the selected sdk and toolchain provide.
+ * @arg dir - directory to fill (created if needed)
  */
-static int call_command(const char *cmd, int argc, char *argv[])
+static void materialize(const char *dir)
 {
 	int i;
-	char *envp[7] = { NULL };
-	char *target_triple = NULL;
-	char *deployment_target = NULL;
-
-	/*
-	 * Pass SDKROOT, PATH, HOME, LD_LIBRARY_PATH, TARGET_TRIPLE, and MACOSX_DEPLOYMENT_TARGET to the called program's environment.
-	 *
-	 * > SDKROOT is used for when programs such as clang need to know the location of the sdk.
-	 * > PATH is used for when programs such as clang need to call on another program (such as the linker).
-	 * > HOME is used for recursive calls to xcrun (such as when xcrun calls a script calling xcrun ect).
-	 * > LD_LIBRARY_PATH is used for when tools needs to access libraries that are specific to the toolchain.
-	 * > TARGET_TRIPLE is used for clang/clang++ cross compilation when building on a foreign host.
-	 * > {MACOSX|IOS}_DEPLOYMENT_TARGET is used for tools like ld that need to set the minimum compatibility
-	 *   version number for a linked binary.
-	 */
-	envp[0] = (char *)malloc(PATH_MAX - 1);
-	envp[1] = (char *)malloc(PATH_MAX - 1);
-	envp[2] = (char *)malloc(PATH_MAX - 1);
-	envp[3] = (char *)malloc(PATH_MAX - 1);
-	envp[4] = (char *)malloc(64);
-	envp[5] = (char *)malloc(255);
-
-	sprintf(envp[0], "SDKROOT=%s", get_sdk_path(current_sdk));
-	sprintf(envp[1], "PATH=%s/usr/bin:%s/usr/bin:%s", developer_dir, get_toolchain_path(current_toolchain), getenv("PATH"));
-	sprintf(envp[2], "LD_LIBRARY_PATH=%s/usr/lib", get_toolchain_path(current_toolchain));
-	sprintf(envp[3], "HOME=%s", getenv("HOME"));
-
-	if ((target_triple = get_target_triple(current_sdk)) != NULL)
-		sprintf(envp[4], "TARGET_TRIPLE=%s", target_triple);
-	else
-		fprintf(stderr, "xcrun: warning: failed to retrieve target triple information for %s.sdk.\n", current_sdk);
+	int j;
+	int ntools = 0;
+	int nlinks = 0;
+	int found;
+	size_t triple_len = 0;
+	char *self = NULL;
+	char *header = NULL;
+	char *stamp_path = NULL;
+	char *stamp_data = NULL;
+	const char *triple = NULL;
+	const char *target = NULL;
+	const char **tools = NULL;
+	DIR *dp = NULL;
+	FILE *fp = NULL;
+	struct dirent *ent = NULL;
+	struct stat st;
+	search_list list;
+	cache_entry stamps;
 
-	if ((deployment_target = getenv("IOS_DEPLOYMENT_TARGET")) != NULL)
-		sprintf(envp[5], "IOS_DEPLOYMENT_TARGET=%s", deployment_target);
-	else if ((deployment_target = getenv("MACOSX_DEPLOYMENT_TARGET")) != NULL)
-		sprintf(envp[5], "MACOSX_DEPLOYMENT_TARGET=%s", deployment_target);
-	else {
-		/* Use the deployment target info that is provided by the SDK. */
-		if ((deployment_target = strdup(get_sdk_info(get_sdk_path(current_sdk)).deployment_target)) != NULL) {
-			if (macosx_deployment_target_set == 1)
-				sprintf(envp[5], "MACOSX_DEPLOYMENT_TARGET=%s", deployment_target);
-			else if (ios_deployment_target_set == 1)
-				sprintf(envp[5], "IOS_DEPLOYMENT_TARGET=%s", deployment_target);
-		} else {
-			fprintf(stderr, "xcrun: error: failed to retrieve deployment target information for %s.sdk.\n", current_sdk);
-			exit(1);
+	select_sdk_and_toolchain();
+	build_search_list(&list);
+
+	if ((self = get_self_path()) == NULL) {
+		fprintf(stderr, "xcrun: error: failed to find xcrun's own path. (errno=%s)\n", strerror(errno));
+		exit(1);
+	}
+
+	if ((triple = getenv("TARGET_TRIPLE")) == NULL)
+		triple = get_target_triple(current_sdk);
+	if (triple != NULL)
+		triple_len = strlen(triple);
+
+	/* A directory made for the same developer dir generation, selection and tools is left alone. */
+	header = arena_printf("%s\t%lu\t%s\t%s\t%s\t%s\t%s\t%s", developer_dir, developer_generation, current_sdk, current_toolchain,
+			(alternate_sdk_path != NULL) ? alternate_sdk_path : "-", (alternate_toolchain_path != NULL) ? alternate_toolchain_path : "-",
+			(triple != NULL) ? triple : "-", self);
+	stamp_path = arena_printf("%s/%s", dir, MATERIALIZE_STAMP);
+
+	if (materialize_is_current(stamp_path, header) == 1) {
+		verbose_printf(stdout, "xcrun: info: '%s' is already up to date.\n", dir);
+		return;
+	}
+
+	if (fs_mkdir(dir, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "xcrun: error: failed to create '%s'. (errno=%s)\n", dir, strerror(errno));
+		exit(1);
+	}
+
+	/* Take the stamps before reading the directories, so a change while we do is not missed. */
+	memset(&stamps, 0, sizeof(stamps));
+	stamps.path = self;
+	stamp_search_dirs(&stamps, &list);
+
+	tools = (const char **)arena_alloc(MATERIALIZE_MAX_TOOLS * 2 * sizeof(char *));
+
+	/* The first directory in the search order that has a tool wins, just like a lookup. */
+	for (i = 0; i < list.ndirs; i++) {
+		if ((dp = fs_opendir(list.dirs[i])) == NULL)
+			continue;
+
+		while ((ent = readdir(dp)) != NULL && ntools < MATERIALIZE_MAX_TOOLS) {
+			if (ent->d_name[0] == '.')
+				continue;
+
+			for (j = 0, found = 0; j < ntools && found == 0; j++)
+				found = (strcmp(tools[j], ent->d_name) == 0);
+			if (found == 1)
+				continue;
+
+			target = arena_printf("%s/%s", list.dirs[i], ent->d_name);
+			if (fs_access(target, (F_OK | X_OK)) != 0 || fs_stat(target, &st) != 0 || S_ISDIR(st.st_mode))
+				continue;
+
+			tools[ntools++] = arena_strdup(ent->d_name);
+
+			/* Compiler drivers have to go through xcrun to get their target and sysroot. */
+			if (get_compiler_driver(ent->d_name) != NULL)
+				target = self;
+
+			if (materialize_link(dir, ent->d_name, target) != 0) {
+				fprintf(stderr, "xcrun: error: failed to link '%s' in '%s'. (errno=%s)\n", ent->d_name, dir, strerror(errno));
+				exit(1);
+			}
+			nlinks++;
+
+			/* Tools are also called by the sdk's target triple, e.g. arm-apple-darwin11-ld. */
+			tools[MATERIALIZE_MAX_TOOLS + ntools - 1] = NULL;
+			if (triple != NULL && (strncmp(ent->d_name, triple, triple_len) != 0 || ent->d_name[triple_len] != '-')) {
+				tools[MATERIALIZE_MAX_TOOLS + ntools - 1] = arena_printf("%s-%s", triple, ent->d_name);
+				if (materialize_link(dir, tools[MATERIALIZE_MAX_TOOLS + ntools - 1], target) != 0) {
+					fprintf(stderr, "xcrun: error: failed to link '%s-%s' in '%s'. (errno=%s)\n", triple, ent->d_name, dir, strerror(errno));
+					exit(1);
+				}
+				nlinks++;
+			}
 		}
+
+		fs_closedir(dp);
 	}
 
-	if (logging_mode == 1) {
-		logging_printf(stdout, "xcrun: info: invoking command:\n\t\"%s", cmd);
-		for (i = 1; i < argc; i++)
-			logging_printf(stdout, " %s", argv[i]);
-		logging_printf(stdout, "\"\n");
+	if (ntools == MATERIALIZE_MAX_TOOLS)
+		fprintf(stderr, "xcrun: warning: only the first %d tools were linked in '%s'.\n", MATERIALIZE_MAX_TOOLS, dir);
+
+	/* Drop links to tools that went away. Anything that isn't a link is not ours to remove. */
+	if ((dp = fs_opendir(dir)) != NULL) {
+		while ((ent = readdir(dp)) != NULL) {
+			if (ent->d_name[0] == '.')
+				continue;
+
+			for (j = 0, found = 0; j < ntools && found == 0; j++)
+				found = (strcmp(tools[j], ent->d_name) == 0 || (tools[MATERIALIZE_MAX_TOOLS + j] != NULL && strcmp(tools[MATERIALIZE_MAX_TOOLS + j], ent->d_name) == 0));
+			if (found == 1)
+				continue;
+
+			target = arena_printf("%s/%s", dir, ent->d_name);
+			if (fs_lstat(target, &st) == 0 && S_ISLNK(st.st_mode)) {
+				verbose_printf(stdout, "xcrun: info: removing stale link '%s'.\n", target);
+				(void)fs_unlink(target);
+			}
+		}
+		fs_closedir(dp);
 	}
 
-	return execve(cmd, argv, envp);
+	/* The stamp goes last, an interrupted run is simply redone next time. */
+	if ((stamp_data = cache_format_entry(&stamps)) == NULL) {
+		fprintf(stderr, "xcrun: error: failed to record the state of '%s'.\n", dir);
+		exit(1);
+	}
+
+	target = arena_printf("%s.tmp", stamp_path);
+	if ((fp = fopen(target, "w")) == NULL || fprintf(fp, "%s\n%s\n", header, stamp_data) < 0 || fclose(fp) != 0 || fs_rename(target, stamp_path) != 0) {
+		fprintf(stderr, "xcrun: error: failed to write '%s'. (errno=%s)\n", stamp_path, strerror(errno));
+		exit(1);
+	}
+
+	free(stamp_data);
+
+	verbose_printf(stdout, "xcrun: info: linked %d tools (%d links) in '%s'.\n", ntools, nlinks, dir);
 }
 
 /**
- * @func search_command -- Search a set of directories for a given command
- * @arg name - program's name
- * @arg dirs - set of directories to search, seperated by colons
- * @return: the program's absolute path on success, NULL on failure
+ * @func resolve_query -- Resolve a request on behalf of the daemon (in a child process).
+ * @arg query - request to resolve
+ * @arg reply - resolved developer dir, sdk, toolchain and program
+ * @return: 0 on success, -1 on failure (errors may also exit)
  */
-static char *search_command(const char *name, char *dirs)
+static int resolve_query(const daemon_query *query, daemon_reply *reply)
 {
-	char *cmd = NULL;	/* command's absolute path */
-	char *absl_path = NULL;		/* path entry to search */
-	char delimiter[2] = ":";	/* delimiter for directories in dirs argument */
+	sdk_config sdk;
+	toolchain_config toolchain;
 
-	/* Allocate space for the program's absolute path */
-	cmd = (char *)malloc(PATH_MAX - 1);
+	/* Resolve in the caller's environment, not ours. */
+	if (query->home != NULL)
+		setenv("HOME", query->home, 1);
+	else
+		unsetenv("HOME");
 
-	/* Search each path entry in dirs until we find our program. */
-	absl_path = strtok(dirs, delimiter);
-	while (absl_path != NULL) {
-		verbose_printf(stdout, "xcrun: info: checking directory \'%s\' for command \'%s\'...\n", absl_path, name);
+	if (query->developer_dir != NULL)
+		setenv("DEVELOPER_DIR", query->developer_dir, 1);
+	else
+		unsetenv("DEVELOPER_DIR");
 
-		/* Construct our program's absolute path. */
-		sprintf(cmd, "%s/%s", absl_path, name);
+	if (query->sdkroot != NULL)
+		setenv("SDKROOT", query->sdkroot, 1);
+	else
+		unsetenv("SDKROOT");
 
-		/* Does it exist? Is it an executable? */
-		if (access(cmd, (F_OK | X_OK)) != (-1)) {
-			verbose_printf(stdout, "xcrun: info: found command's absolute path: \'%s\'\n", cmd);
-			break;
-		}
+	if (query->toolchains != NULL)
+		setenv("TOOLCHAINS", query->toolchains, 1);
+	else
+		unsetenv("TOOLCHAINS");
+
+	explicit_sdk_mode = (query->mode & SEARCH_EXPLICIT_SDK) ? 1 : 0;
+	explicit_toolchain_mode = (query->mode & SEARCH_EXPLICIT_TOOLCHAIN) ? 1 : 0;
+	current_sdk = (query->sdk != NULL) ? arena_strdup(query->sdk) : NULL;
+	current_toolchain = (query->toolchain != NULL) ? arena_strdup(query->toolchain) : NULL;
+	alternate_sdk_path = (char *)query->alternate_sdk;
+	alternate_toolchain_path = (char *)query->alternate_toolchain;
+	current_driver = (query->driver != NULL) ? get_compiler_driver(query->driver) : NULL;
 
-		/* If not, move onto the next entry.. */
-		absl_path = strtok(NULL, delimiter);
+	if ((explicit_sdk_mode == 1 && current_sdk == NULL) || (explicit_toolchain_mode == 1 && current_toolchain == NULL))
+		return -1;
+
+	nocache_mode = 0;
+	developer_dir = NULL;
+	select_sdk_and_toolchain();
+	if (developer_dir == NULL)
+		return -1;
+
+	if (query->tool != NULL && lookup_command(query->tool, &reply->entry) == NULL)
+		return -1;
+
+	resolve_environment(&reply->entry);
+
+	/* The selection itself depends on the configuration cache and the defaults. */
+	if (query->developer_dir == NULL && query->home != NULL) {
+		cache_stamp_add(&reply->entry, arena_printf("%s/%s", query->home, SDK_CFG));
 	}
+	if (query->sdkroot == NULL || query->toolchains == NULL)
+		cache_stamp_add(&reply->entry, XCRUN_DEFAULT_CFG);
 
-	return cmd;
+	sdk = get_sdk_info(reply->entry.sdk_path);
+	toolchain = get_toolchain_info(reply->entry.toolchain_path);
+
+	reply->developer_dir = developer_dir;
+	reply->sdk = current_sdk;
+	reply->toolchain = current_toolchain;
+	reply->sdk_name = sdk.name;
+	reply->sdk_version = sdk.version;
+	reply->toolchain_name = toolchain.name;
+	reply->toolchain_version = toolchain.version;
+
+	return 0;
+}
+
+/**
+ * @func request_entry -- Find a program, asking the resolver daemon first.
+ * @arg name - program's name
+ * @arg entry - lookup result to fill (with the environment too, unless we are only finding)
+ * @return: 0 on success, -1 on failure
+ */
+static int request_entry(const char *name, cache_entry *entry)
+{
+	daemon_reply reply;	/* what the daemon found */
+
+	/* A running daemon already knows the answer (or finds it without us paying for it). */
+	if (query_daemon(name, &reply) == 0) {
+		*entry = reply.entry;
+		trace_set_result(entry->path, "daemon");
+		/* The daemon's entry may come from --find, without the environment. */
+		if (finding_mode == 0 && entry->has_env == 0) {
+			select_sdk_and_toolchain();
+			resolve_environment(entry);
+		}
+	} else if (resolve_command(name, entry) == NULL)
+		return -1;
+
+	return 0;
 }
 
 /**
  * @func request_command - Request a program.
  * @arg name -- name of program
  * @arg argv -- arguments to be passed if program found
- * @return: -1 on failed search, 0 on successful search, no return on execute
+ * @return: -1 on failed search (already reported), 0 on successful search, no return on execute
  */
 static int request_command(const char *name, int argc, char *argv[])
 {
-	char *cmd = NULL;	/* used to hold our command's absolute path */
-	char *sdk_env = NULL;	/* used for passing SDKROOT in call_command */
-	char *toolch_name = NULL;	/* toolchain name to be used with sdk */
-	char *toolchain_env = NULL;	/* used for passing PATH in call_command */
-	char search_string[PATH_MAX * 1024];	/* our search string */
-
-	/*
-	 * If xcrun was called in a multicall state, we still want to specify current_sdk for SDKROOT and
-	 * current_toolchain for PATH.
-	 */
-	if (current_sdk == NULL) {
-		current_sdk = (char *)malloc(255);
-		if ((sdk_env = getenv("SDKROOT")) != NULL)
-			stripext(current_sdk, basename(sdk_env));
-		else
-			current_sdk = strdup(get_default_info(XCRUN_DEFAULT_CFG).sdk);
-	}
+	cache_entry entry;	/* what we found */
 
-	if (current_toolchain == NULL) {
-		current_toolchain = (char *)malloc(255);
-		if ((toolchain_env = getenv("TOOLCHAINS")) != NULL)
-			stripext(current_toolchain, basename(toolchain_env));
-		else
-			current_toolchain = strdup(get_default_info(XCRUN_DEFAULT_CFG).toolchain);
+	trace_set_tool(name);
+
+	if (request_entry(name, &entry) != 0)
+		return -1;
+
+	if (finding_mode == 1) {
+		trace_set_outcome("find");
+		print_value("TOOL_PATH", entry.path, NULL);
+		return 0;
 	}
 
-	/* No matter the circumstance, search the developer dir. */
-	sprintf(search_string, "%s/usr/bin:", developer_dir);
+	if (current_driver != NULL)
+		argv = compiler_driver_args(entry.path, &entry, &argc, argv);
+
+	trace_set_outcome("exec");
+
+	call_command(entry.path, compiler_launcher(entry.path), &entry, argc, argv);
+	/* NOREACH */
+	fprintf(stderr, "xcrun: error: can\'t exec \'%s\' (errno=%s)\n", entry.path, strerror(errno));
+
+	return -1;
+}
+
+/**
+ * @func find_one -- Find one of several programs for --find, printing its path or a '-' if it can't be found.
+ * @arg name - program's name
+ * @return: 0 on success, -1 on failure
+ */
+static int find_one(const char *name)
+{
+	char key[PATH_MAX];
+	cache_entry entry;
+	int retval = request_entry(name, &entry);
+
+	/* Every name gets a line, so the output lines up with the names asked for. */
+	if (show_format == SHOW_FORMAT_SH)
+		print_value(value_key(key, sizeof(key), "TOOL_PATH", name), (retval == 0) ? entry.path : "", NULL);
+	else
+		print_value(NULL, (retval == 0) ? entry.path : "-", NULL);
 
-	/* If we implicitly specified an sdk, search the sdk and it's associated toolchain. */
-	if (explicit_sdk_mode == 1) {
-		toolch_name = strdup(get_sdk_info(get_sdk_path(current_sdk)).toolchain);
-		sprintf((search_string + strlen(search_string)), "%s/usr/bin:%s/usr/bin", get_sdk_path(current_sdk), get_toolchain_path(toolch_name));
-		goto do_search;
+	return retval;
+}
+
+/**
+ * @func find_tools -- Find several programs in one go, for --find with more than one name or --find-all.
+ * @arg names - programs' names
+ * @arg nnames - number of names
+ * @arg from_stdin - find the names read from stdin (one per line) as well
+ * @return: 0 if every program was found, 1 otherwise
+ */
+static int find_tools(char *names[], int nnames, int from_stdin)
+{
+	int i;
+	int missed = 0;
+	size_t len;
+	char line[PATH_MAX];
+
+	finding_mode = 1;
+	trace_set_tool((nnames > 0) ? names[0] : NULL);
+
+	for (i = 0; i < nnames; i++) {
+		if (find_one(basename(names[i])) != 0)
+			missed++;
 	}
 
-	/* If we implicitly specified a toolchain, only search the toolchain. */
-	if (explicit_toolchain_mode == 1) {
-		sprintf((search_string + strlen(search_string)), "%s/usr/bin", get_toolchain_path(current_toolchain));
-		goto do_search;
+	while (from_stdin == 1 && fgets(line, sizeof(line), stdin) != NULL) {
+		len = strcspn(line, "\r\n");
+		line[len] = '\0';
+		if (len == 0)
+			continue;
+		if (find_one(basename(line)) != 0)
+			missed++;
 	}
 
-	/* If we explicitly specified an SDK, append it to the search string. */
-	if (alternate_sdk_path != NULL) {
-		sprintf((search_string + strlen(search_string)), "%s/usr/bin:", alternate_sdk_path);
-		/* We also want to append an associated toolchain if this is really an SDK folder. */
-		if (test_sdk_authenticity(alternate_sdk_path) == 1) {
-			toolch_name = strdup(get_sdk_info(alternate_sdk_path).toolchain);
-			sprintf((search_string + strlen(search_string)), "%s/usr/bin", get_toolchain_path(toolch_name));
-			/* We now have a toolchain, so skip to search. */
-			goto do_search;
+	trace_set_outcome((missed == 0) ? "find" : "not-found");
+
+	return (missed == 0) ? 0 : 1;
+}
+
+/**
+ * @func batch_resolve -- Find a program for --exec-batch, remembering what was already found.
+ * @arg name - program's name
+ * @arg launcher - set to the program to run it through, or NULL
+ * @return: the program's absolute path on success, NULL on failure
+ */
+static const char *batch_resolve(const char *name, const char **launcher)
+{
+	int i;
+	const char *path = NULL;
+	cache_entry entry;
+	static int ntools = 0;
+	static const char *names[BATCH_MAX_TOOLS];
+	static const char *paths[BATCH_MAX_TOOLS];
+
+	for (i = 0; i < ntools; i++) {
+		if (strcmp(names[i], name) == 0) {
+			*launcher = compiler_launcher(paths[i]);
+			return paths[i];
 		}
 	}
 
-	/* If we explicitly specified a toolchain, append it to the search string. */
-	if (alternate_toolchain_path != NULL)
-		sprintf((search_string + strlen(search_string)), "%s/usr/bin", alternate_toolchain_path);
-
-	/* By default, we search our developer dir, our default sdk, and our default toolchain only. */
-	if (explicit_sdk_mode == 0 && explicit_toolchain_mode == 0 && alternate_toolchain_path == NULL && alternate_sdk_path == NULL)
-		sprintf((search_string + strlen(search_string)), "%s/usr/bin:%s/usr/bin", get_sdk_path(current_sdk), get_toolchain_path(current_toolchain));
-
-	/* Search each path entry in search_string until we find our program. */
-do_search:
-	if ((cmd = search_command(name, search_string)) != NULL) {
-		if (finding_mode == 1) {
-			if (access(cmd, (F_OK | X_OK)) != (-1)) {
-				fprintf(stdout, "%s\n", cmd);
-				free(cmd);
-				return 0;
-			} else
-				return -1;
-		} else {
-			call_command(cmd, argc, argv);
-			/* NOREACH */
-			fprintf(stderr, "xcrun: error: can't exec \'%s\' (errno=%s)\n", cmd, strerror(errno));
-			return -1;
-		}
+	if (resolve_command(name, &entry) == NULL)
+		return NULL;
+
+	/* Strings from the lookup cache only last until the next lookup. */
+	path = arena_strdup(entry.path);
+	*launcher = compiler_launcher(path);
+
+	if (ntools < BATCH_MAX_TOOLS) {
+		names[ntools] = arena_strdup(name);
+		paths[ntools++] = path;
 	}
 
-	/* We have searched everywhere, but we haven't found our program. State why. */
-	fprintf(stderr, "xcrun: error: can't stat \'%s\' (errno=%s)\n", name, strerror(errno));
+	return path;
+}
 
-	return -1;
+/**
+ * @func exec_batch -- Run the commands read from stdin, all in the selected sdk and toolchain's environment.
+ * @arg jobs - most commands to run at once, 0 to follow make's jobserver
+ * @return: 0 if every command succeeded, 1 otherwise
+ */
+static int exec_batch(int jobs)
+{
+	int nvars;
+	int nfailed;
+	env_var vars[ENV_VARS];
+	char **envp = NULL;
+	cache_entry entry;
+	daemon_reply reply;
+
+	/* Every command shares one environment, so it is only built once. */
+	if (query_daemon(NULL, &reply) == 0)
+		entry = reply.entry;
+	else {
+		select_sdk_and_toolchain();
+		memset(&entry, 0, sizeof(entry));
+		resolve_environment(&entry);
+	}
+
+	nvars = build_environment(&entry, vars, 1);
+	envp = pack_environment(vars, nvars, arena_alloc(environment_size(vars, nvars)));
+
+	/* The tools themselves only need their paths. */
+	finding_mode = 1;
+
+	trace_set_outcome("exec-batch");
+
+	nfailed = batch_run(stdin, jobs, batch_resolve, envp, verbose_mode, logging_mode);
+	trace_set_result(NULL, NULL);
+
+	if (nfailed == -1) {
+		fprintf(stderr, "xcrun: error: failed to run commands. (errno=%s)\n", strerror(errno));
+		return 1;
+	}
+
+	(void)cache_dir_save();
+
+	if (nfailed > 0) {
+		fprintf(stderr, "xcrun: error: %d command(s) failed.\n", nfailed);
+		return 1;
+	}
+
+	return 0;
 }
 
 /**
@@ -811,19 +1333,27 @@ do_search:
  */
 static int xcrun_main(int argc, char *argv[])
 {
+	int i;
 	int ch;
 	int retval = 1;
 	int optindex = 0;
 	int argc_offset = 0;
-	char *sdk = NULL;
-	char *toolchain = NULL;
+	int nshow_fields = 0;
+	int show_fields[SHOW_MAX_FIELDS];
 	char *tool_called = NULL;
 
-	char *sdk_env = NULL;
-	char *toolchain_env = NULL;
+	daemon_reply reply;
+	const daemon_reply *show_reply = NULL;
+
+	int export_format = -1;
+	int batch_jobs = 0;
+	char *materialize_dir = NULL;
+	char *end = NULL;
+	int find_names = 0;		/* index of the names following the first -f name */
+	int nfind_names = 0;
 
-	static int help_f, verbose_f, log_f, find_f, run_f, nocache_f, killcache_f, version_f, sdk_f, toolchain_f, ssdkp_f, ssdkv_f, ssdkpp_f, ssdktt_f, ssdkpv_f;
-	help_f = verbose_f = log_f = find_f = run_f = nocache_f = killcache_f = version_f = sdk_f = toolchain_f = ssdkp_f = ssdkv_f = ssdkpp_f = ssdktt_f = ssdkpv_f = 0;
+	static int help_f, verbose_f, log_f, find_f, run_f, nocache_f, killcache_f, version_f, sdk_f, toolchain_f, ssdkp_f, ssdkv_f, ssdkpp_f, ssdktt_f, ssdkpv_f, daemon_f, rebuild_f, warm_f, exec_batch_f, stats_f, find_all_f, show_sdks_f;
+	help_f = verbose_f = log_f = find_f = run_f = nocache_f = killcache_f = version_f = sdk_f = toolchain_f = ssdkp_f = ssdkv_f = ssdkpp_f = ssdktt_f = ssdkpv_f = daemon_f = rebuild_f = warm_f = exec_batch_f = stats_f = find_all_f = show_sdks_f = 0;
 
 	/* Supported options */
 	static struct option options[] = {
@@ -842,6 +1372,18 @@ static int xcrun_main(int argc, char *argv[])
 		{ "show-sdk-target-triple", no_argument, &ssdktt_f, 1},
 		{ "show-sdk-toolchain-path", no_argument, &ssdkpp_f, 1 },
 		{ "show-sdk-toolchain-version", no_argument, &ssdkpv_f, 1 },
+		{ "show-format", required_argument, 0, 0 },
+		{ "daemon", no_argument, &daemon_f, 1 },
+		{ "export-env", required_argument, 0, 0 },
+		{ "trace-timing", no_argument, 0, 0 },
+		{ "rebuild-registry", no_argument, &rebuild_f, 1 },
+		{ "warm", no_argument, &warm_f, 1 },
+		{ "exec-batch", no_argument, &exec_batch_f, 1 },
+		{ "materialize", required_argument, 0, 0 },
+		{ "arch", required_argument, 0, 0 },
+		{ "stats", no_argument, &stats_f, 1 },
+		{ "find-all", no_argument, &find_all_f, 1 },
+		{ "show-sdks", no_argument, &show_sdks_f, 1 },
 		{ NULL, 0, 0, 0 }
 	};
 
@@ -853,7 +1395,7 @@ static int xcrun_main(int argc, char *argv[])
 	if (*(*(argv + 1)) == '-') {
 		if (strcmp(argv[1], "-") == 0 || strcmp(argv[1], "--") == 0)
 			usage();
-		while ((ch = getopt_long_only(argc, argv, "+hvlr:f:nk", options, &optindex)) != (-1)) {
+		while ((ch = getopt_long_only(argc, argv, "+hvlr:f:nkj:", options, &optindex)) != (-1)) {
 			switch (ch) {
 				case 'h':
 					help_f = 1;
@@ -873,6 +1415,10 @@ static int xcrun_main(int argc, char *argv[])
 					find_f = 1;
 					tool_called = basename(optarg);
 					++argc_offset;
+					/* More names may follow, up to the next option. */
+					for (find_names = optind; optind < argc && argv[optind][0] != '-'; optind++)
+						;
+					nfind_names = optind - find_names;
 					break;
 				case 'n':
 					nocache_f = 1;
@@ -880,6 +1426,14 @@ static int xcrun_main(int argc, char *argv[])
 				case 'k':
 					killcache_f = 1;
 					break;
+				case 'j':
+					++argc_offset;
+					batch_jobs = (int)strtol(optarg, &end, 10);
+					if (*optarg == '\0' || *end != '\0' || batch_jobs < 1) {
+						fprintf(stderr, "xcrun: error: -j requires a positive number of jobs.\n");
+						exit(1);
+					}
+					break;
 				case 0: /* long-only options */
 					switch (optindex) {
 						case 1: /* --version */
@@ -887,18 +1441,7 @@ static int xcrun_main(int argc, char *argv[])
 						case 3: /* --sdk */
 							if (*optarg != '-') {
 								++argc_offset;
-								sdk = optarg;
-								/* we support absolute paths and short names */
-								if (*sdk == '/') {
-									if (validate_directory_path(sdk) != (-1))
-										alternate_sdk_path = sdk;
-									else
-										exit(1);
-								} else {
-									current_sdk = (char *)malloc(255);
-									explicit_sdk_mode = 1;
-									stripext(current_sdk, sdk);
-								}
+								resolve_select_sdk(optarg);
 							} else {
 								fprintf(stderr, "xcrun: error: sdk flag requires an argument.\n");
 								exit(1);
@@ -907,32 +1450,67 @@ static int xcrun_main(int argc, char *argv[])
 						case 4: /* --toolchain */
 							if (*optarg != '-') {
 								++argc_offset;
-								toolchain = optarg;
-								/* we support absolute paths and short names */
-								if (*toolchain == '/') {
-									if (validate_directory_path(toolchain) != (-1))
-										alternate_toolchain_path = toolchain;
-									else
-										exit(1);
-								} else {
-									current_toolchain = (char *)malloc(255);
-									explicit_toolchain_mode = 1;
-									stripext(current_toolchain, toolchain);
-								}
+								resolve_select_toolchain(optarg);
 							} else {
 								fprintf(stderr, "xcrun: error: toolchain flag requires an argument.\n");
 								exit(1);
 							}
 							break;
 						case 10: /* --show-sdk-path */
-							break;
 						case 11: /* --show-sdk-version */
-							break;
 						case 12: /* --snow-sdk-target-triple */
-							break;
 						case 13: /* --show-sdk-toolchain-path */
-							break;
 						case 14: /* --show-sdk-toolchain-version */
+							/* Remember the order the fields were asked for in. */
+							for (i = 0; i < nshow_fields; i++) {
+								if (show_fields[i] == (optindex - 9))
+									break;
+							}
+							if (i == nshow_fields)
+								show_fields[nshow_fields++] = (optindex - 9);
+							break;
+						case 15: /* --show-format */
+							++argc_offset;
+							if (strcmp(optarg, "text") == 0)
+								show_format = SHOW_FORMAT_TEXT;
+							else if (strcmp(optarg, "lines") == 0)
+								show_format = SHOW_FORMAT_LINES;
+							else if (strcmp(optarg, "nul") == 0)
+								show_format = SHOW_FORMAT_NUL;
+							else if (strcmp(optarg, "sh") == 0)
+								show_format = SHOW_FORMAT_SH;
+							else {
+								fprintf(stderr, "xcrun: error: unknown show format \'%s\' (expected text, lines, nul or sh).\n", optarg);
+								exit(1);
+							}
+							break;
+						case 17: /* --export-env */
+							++argc_offset;
+							if (strcmp(optarg, "sh") == 0)
+								export_format = EXPORT_FORMAT_SH;
+							else if (strcmp(optarg, "make") == 0)
+								export_format = EXPORT_FORMAT_MAKE;
+							else if (strcmp(optarg, "json") == 0)
+								export_format = EXPORT_FORMAT_JSON;
+							else {
+								fprintf(stderr, "xcrun: error: unknown export format \'%s\' (expected sh, make or json).\n", optarg);
+								exit(1);
+							}
+							break;
+						case 18: /* --trace-timing */
+							trace_enable(STDERR_FILENO);
+							break;
+						case 22: /* --materialize */
+							++argc_offset;
+							materialize_dir = optarg;
+							break;
+						case 23: /* --arch */
+							++argc_offset;
+							if (optarg[strspn(optarg, " ,\t")] == '\0') {
+								fprintf(stderr, "xcrun: error: --arch requires a list of architectures.\n");
+								exit(1);
+							}
+							requested_archs = optarg;
 							break;
 					}
 					break;
@@ -944,8 +1522,8 @@ static int xcrun_main(int argc, char *argv[])
 
 			++argc_offset;
 
-			/* We don't want to parse any more arguments after these are set. */
-			if (ch == 'f' || ch == 'r')
+			/* We don't want to parse any more arguments after the tool to run. */
+			if (ch == 'r')
 				break;
 		}
 	} else { /* We are just executing a program. */
@@ -960,11 +1538,23 @@ static int xcrun_main(int argc, char *argv[])
 	}
 
 	/* Don't continue if we are missing arguments. */
-	if ((verbose_f == 1 || log_f == 1) && tool_called == NULL) {
+	if ((verbose_f == 1 || log_f == 1) && tool_called == NULL && daemon_f == 0 && rebuild_f == 0 && warm_f == 0 && exec_batch_f == 0 && materialize_dir == NULL && stats_f == 0 && find_all_f == 0 && show_sdks_f == 0) {
 		fprintf(stderr, "xcrun: error: specified arguments require -r or -f arguments.\n");
 		exit(1);
 	}
 
+	/* -j only means something to --exec-batch. */
+	if (batch_jobs != 0 && exec_batch_f == 0) {
+		fprintf(stderr, "xcrun: error: -j requires --exec-batch.\n");
+		exit(1);
+	}
+
+	/* --arch only changes how the target triple is shown. */
+	if (requested_archs != NULL && ssdktt_f == 0) {
+		fprintf(stderr, "xcrun: error: --arch requires --show-sdk-target-triple.\n");
+		exit(1);
+	}
+
 	/* Print help? */
 	if (help_f == 1 || argc < 2)
 		usage();
@@ -973,68 +1563,104 @@ static int xcrun_main(int argc, char *argv[])
 	if (version_f == 1)
 		version();
 
-	/* If our SDK and/or Toolchain hasn't been specified, fall back to environment or defaults. */
-	if (current_sdk == NULL) {
-		current_sdk = (char *)malloc(255);
-		if ((sdk_env = getenv("SDKROOT")) != NULL)
-			stripext(current_sdk, basename(sdk_env));
-		else
-			current_sdk = strdup(get_default_info(XCRUN_DEFAULT_CFG).sdk);
+	/* Run as the resolver daemon? */
+	if (daemon_f == 1)
+		exit((daemon_serve(resolve_query, verbose_f) == 0) ? 0 : 1);
+
+	/* Summarize the invocation log? */
+	if (stats_f == 1) {
+		/* Summarizing the log is not a call worth recording in it. */
+		trace_skip_log();
+		show_stats();
+		exit(0);
 	}
 
-	if (current_toolchain == NULL) {
-		current_toolchain = (char *)malloc(255);
-		if ((toolchain_env = getenv("TOOLCHAINS")) != NULL)
-			stripext(current_toolchain, basename(toolchain_env));
-		else
-			current_toolchain = strdup(get_default_info(XCRUN_DEFAULT_CFG).toolchain);
+	/* Clear the lookup cache? */
+	if (killcache_f == 1) {
+		/* A shared store keeps the caches for each developer dir apart. */
+		if (getenv(XCRUN_CACHE_DIR_ENV) != NULL && developer_dir == NULL && (developer_dir = find_developer_dir()) == NULL)
+			exit(1);
+		if (cache_kill() != 0)
+			fprintf(stderr, "xcrun: warning: failed to invalidate lookup cache. (errno=%s)\n", strerror(errno));
+		/* A running daemon has to forget what it knows as well. */
+		(void)daemon_flush();
+		/* Invalidating the cache is a valid request on its own. */
+		if (tool_called == NULL && nshow_fields == 0 && export_format == -1)
+			exit(0);
 	}
 
-	/* Show SDK path? */
-	if (ssdkp_f == 1) {
-		printf("%s\n", get_sdk_path(current_sdk));
+	/* Don't use the lookup cache? */
+	if (nocache_f == 1)
+		nocache_mode = 1;
+
+	/* Turn on verbose mode? */
+	if (verbose_f == 1)
+		verbose_mode = 1;
+
+	/* Turn on logging mode? */
+	if (log_f == 1)
+		logging_mode = 1;
+
+	/* Compile the sdk and toolchain registry? */
+	if (rebuild_f == 1) {
+		rebuild_registry();
 		exit(0);
 	}
 
-	/* Show SDK version? */
-	if (ssdkv_f == 1) {
-		printf("%s SDK version %s\n", get_sdk_info(get_sdk_path(current_sdk)).name, get_sdk_info(get_sdk_path(current_sdk)).version);
+	/* Prepare the developer dir for the first build? */
+	if (warm_f == 1) {
+		warm_developer_dir();
 		exit(0);
 	}
 
-	/* Show SDK toolchain path? */
-	if (ssdkpp_f == 1) {
-		printf("%s\n", get_toolchain_path(current_toolchain));
+	/* Run a batch of commands? */
+	if (exec_batch_f == 1)
+		exit(exec_batch(batch_jobs));
+
+	/* Link every tool into one directory? */
+	if (materialize_dir != NULL) {
+		materialize(materialize_dir);
 		exit(0);
 	}
 
-	/* Show SDK toolchain version? */
-	if (ssdkpv_f == 1) {
-		printf("%s SDK Toolchain version %s (%s)\n", get_sdk_info(get_sdk_path(current_sdk)).name, get_toolchain_info(get_toolchain_path(current_toolchain)).version, get_toolchain_info(get_toolchain_path(current_toolchain)).name);
+	/* List the installed sdks and toolchains? */
+	if (show_sdks_f == 1) {
+		trace_set_outcome("show");
+		show_sdks();
 		exit(0);
 	}
 
-	/* Show SDK target triple ? */
-	if (ssdktt_f == 1) {
-		printf("%s\n", get_target_triple(current_sdk));
+	/* Print the environment tools would be called with? */
+	if (export_format != -1) {
+		trace_set_outcome("export-env");
+		export_environment(export_format);
 		exit(0);
 	}
 
-	/* Clear the lookup cache? */
-	if (killcache_f == 1)
-		fprintf(stderr, "xcrun: warning: --kill-cache not supported.\n");
-
-	/* Don't use the lookup cache? */
-	if (nocache_f == 1)
-		fprintf(stderr, "xcrun: warning: --no-cache not supported.\n");
-
-	/* Turn on verbose mode? */
-	if (verbose_f == 1)
-		verbose_mode = 1;
+	/* Show the requested SDK information, all in one pass. */
+	if (nshow_fields > 0) {
+		/* If our SDK and/or Toolchain hasn't been specified, fall back to environment or defaults. */
+		if (query_daemon(NULL, &reply) == 0)
+			show_reply = &reply;
+		else
+			select_sdk_and_toolchain();
+		trace_set_outcome("show");
+		for (i = 0; i < nshow_fields; i++)
+			show_field(show_fields[i], show_reply);
+		/* With --find, the tools' paths follow the requested fields. */
+		if (find_f != 1 && find_all_f != 1)
+			exit(0);
+	}
 
-	/* Turn on logging mode? */
-	if (log_f == 1)
-		logging_mode = 1;
+	/* Find several tools in one go? The names right after the first -f name are tools to find too. */
+	if (find_f == 1 && (nfind_names > 0 || find_all_f == 1)) {
+		argv[find_names - 1] = tool_called;
+		exit(find_tools(argv + find_names - 1, nfind_names + 1, find_all_f));
+	} else if (find_all_f == 1) {
+		if (tool_called != NULL)
+			argv[--optind] = tool_called;
+		exit(find_tools(argv + optind, argc - optind, find_all_f));
+	}
 
 	/* Before we continue, double check if we have a tool to call. */
 	if (tool_called == NULL) {
@@ -1042,25 +1668,21 @@ static int xcrun_main(int argc, char *argv[])
 		exit(1);
 	}
 
-	/* Search for program? */
+	/* Search for program? A failure has already been reported by request_command. */
 	if (find_f == 1) {
 		finding_mode = 1;
 		if (request_command(tool_called, 0, NULL) != -1)
 			retval = 0;
-		else {
-			fprintf(stderr, "xcrun: error: unable to locate command \'%s\' (errno=%s)\n", tool_called, strerror(errno));
+		else
 			exit(1);
-		}
 	}
 
 	/* Search and execute program. (default behavior) */
 	if (find_f != 1) {
 		if (request_command(tool_called, (argc - argc_offset),  (argv += ((argc - argc_offset) - (argc - argc_offset) + (argc_offset)))) != -1)
 			retval = -1; /* NOREACH */
-		else {
-			fprintf(stderr, "xcrun: error: failed to execute command \'%s\'. aborting.\n", tool_called);
+		else
 			exit(1);
-		}
 	}
 
 	return retval;
@@ -1077,7 +1699,7 @@ static int get_multicall_state(const char *cmd, const char *state[], int state_s
 {
 	int i;
 
-	for (i = 0; i < (state_size - 1); i++) {
+	for (i = 0; i < state_size; i++) {
 		if (strcmp(cmd, state[i]) == 0)
 			return (i + 1);
 	}
@@ -1091,15 +1713,20 @@ int main(int argc, char *argv[])
 	int call_state;
 	char *this_tool = NULL;
 
+	/* Start the clock for XCRUN_TRACE before doing anything else. */
+	trace_init();
+
 	/* Strip out any path name that may have been passed into argv[0] */
 	this_tool = basename(argv[0]);
 	progname = this_tool;
+	trace_set_tool(this_tool);
 
-	/* Get our developer dir */
-	developer_dir = get_developer_path();
+	/* Tell how much work resolving took (in verbose mode). */
+	atexit(report_fs_calls);
+	atexit(trace_flush);
 
 	/* Check if we are being treated as a multi-call binary. */
-	call_state = get_multicall_state(this_tool, multicall_tool_names, 4);
+	call_state = get_multicall_state(this_tool, multicall_tool_names, 5);
 
 	/* Execute based on the state that we were called in. */
 	switch (call_state) {
@@ -1115,17 +1742,27 @@ int main(int argc, char *argv[])
 			retval = xcrun_main(argc, argv);
 			break;
 		case 4: /* xcrun_nocache */
+			nocache_mode = 1;
 			retval = xcrun_main(argc, argv);
 			break;
+		case 5: /* xcrun-tool */
+			/* This name only exists for links named <target triple>-<tool> made with older versions. */
+			fprintf(stderr, "xcrun-tool: error: this tool must not be called directly.\n");
+			exit(1);
 		case -1:
 		default: /* called as tool name */
-			/* Locate and execute the command */
+			/* Tools prefixed with the sdk's target triple (e.g. arm-apple-darwin11-ld) run the tool itself. */
+			this_tool = strip_target_triple(this_tool);
+
+			/* Compiler drivers run the real compiler with the sdk's target, sysroot and toolchain. */
+			if ((current_driver = get_compiler_driver(this_tool)) != NULL)
+				this_tool = (char *)current_driver->compiler;
+
+			/* Locate and execute the command, a failure has already been reported. */
 			if (request_command(this_tool, argc, argv) != -1)
 				retval = -1; /* NOREACH */
-			else {
-				fprintf(stderr, "xcrun: error: failed to execute command \'%s\'. aborting.\n", this_tool);
+			else
 				exit(1);
-			}
 			break;
 	}
 